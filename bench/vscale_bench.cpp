@@ -0,0 +1,532 @@
+/*
+* Бенчмарки клиента на заглушке API в том же процессе.
+*
+* 	vscale_bench [--quick] [сценарий...]
+*
+* Без аргументов выполняются все сценарии. --quick сокращает нагрузку,
+* в таком виде бенчмарк запускается ctest как проверка работоспособности.
+*/
+#include <vscale/vscale.h>
+#include "stub_server.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BENCH_DURATION 				std::chrono::seconds(3)
+#define BENCH_QUICK_DURATION 			std::chrono::milliseconds(300)
+#define BENCH_THREADS 				4
+#define BENCH_ASYNC_WINDOW 			64
+#define BENCH_H2_CONCURRENCY 			200
+#define BENCH_H2_SERVER_DELAY 			std::chrono::milliseconds(2)
+#define BENCH_ALLOC_WARMUP 			20
+#define BENCH_ALLOC_CALLS 			500
+#define BENCH_ALLOC_QUICK_CALLS 		50
+#define BENCH_TRACER_CALLS 			5000
+#define BENCH_TRACER_QUICK_CALLS 		200
+#define BENCH_TRACER_ROUNDS 			5
+#define BENCH_HANDSHAKE_ROUNDS 			200
+#define BENCH_HANDSHAKE_QUICK_ROUNDS 		10
+#define BENCH_SERIALIZE_OPS 			200000
+#define BENCH_SERIALIZE_QUICK_OPS 		5000
+#define BENCH_SERIALIZE_CALLS 			100
+#define BENCH_DECODE_CALLS 			50
+#define BENCH_DECODE_QUICK_CALLS 		3
+
+namespace vscale {
+
+/// Сериализатор тел запросов из src/vscale.cpp, в публичный интерфейс не входит
+void WriteCompactJson(const JsonValue &value, string &out);
+
+} // namespace vscale
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+/// Счетчики operator new текущего потока, пока counting выставлен
+struct AllocationCounter {
+	bool counting;
+	uint64_t allocations, bytes;
+};
+
+thread_local AllocationCounter allocation_counter = {false, 0, 0};
+
+} // namespace
+
+void *operator new(size_t size) {
+	if (allocation_counter.counting) {
+		++allocation_counter.allocations;
+		allocation_counter.bytes += size;
+	}
+	void *pointer = malloc(size != 0 ? size : 1);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void operator delete(void *pointer) noexcept {
+	free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+	free(pointer);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchOptions {
+	bool quick;
+	Clock::duration duration;
+};
+
+/// Задержки вызовов в наносекундах
+class Latencies {
+public:
+	void Add(Clock::duration value) {
+		m_values.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(value).count());
+	}
+
+	void Merge(const Latencies &other) {
+		m_values.insert(m_values.end(), other.m_values.begin(), other.m_values.end());
+	}
+
+	size_t Count() const {
+		return m_values.size();
+	}
+
+	/// Квантиль q (от 0 до 1) в микросекундах
+	double Percentile(double q) {
+		if (m_values.empty())
+			return 0;
+		std::sort(m_values.begin(), m_values.end());
+		const size_t index = std::min(m_values.size() - 1, (size_t) (q * m_values.size()));
+		return m_values[index] / 1000.0;
+	}
+
+private:
+	std::vector<int64_t> m_values;
+};
+
+double Seconds(Clock::duration value) {
+	return std::chrono::duration<double>(value).count();
+}
+
+void Report(const char *name, Latencies &latencies, Clock::duration elapsed) {
+	printf("  %-28s %10.0f calls/s   p50 %8.1f us   p99 %8.1f us   p999 %8.1f us\n", name,
+			latencies.Count() / Seconds(elapsed), latencies.Percentile(0.5), latencies.Percentile(0.99),
+			latencies.Percentile(0.999));
+}
+
+/// Заглушка с небольшим ответом на GET /v1/account
+void ServeAccount(StubServer &server) {
+	server.Handle("GET", "/v1/account", [](const StubRequest &, StubResponse &response) {
+		response.body = "{\"info\": {\"actdate\": \"2016-01-01\", \"country\": \"\", \"email\": \"bench@example.com\","
+				" \"id\": \"1\", \"locale\": \"ru\", \"middlename\": \"\", \"mobile\": \"+70000000000\","
+				" \"name\": \"Bench\", \"state\": \"1\", \"surname\": \"Bench\"}, \"status\": \"ok\"}";
+	});
+}
+
+/*
+* Пропускная способность и задержки: синхронные вызовы из нескольких потоков
+* и асинхронные вызовы с окном BENCH_ASYNC_WINDOW запросов из одного потока.
+*/
+void Throughput(const BenchOptions &options) {
+	StubServer server(StubServer::smPlain, false);
+	ServeAccount(server);
+	Transport::SetBaseURL(server.BaseURL());
+	Account account("token");
+
+	for (unsigned threads = 1; threads <= BENCH_THREADS; threads *= 2) {
+		std::vector<Latencies> latencies(threads);
+		std::vector<std::thread> workers;
+		const Clock::time_point started = Clock::now();
+		const Clock::time_point deadline = started + options.duration;
+		for (unsigned i = 0; i < threads; ++i) {
+			workers.emplace_back([&account, &latencies, i, deadline]() {
+				JsonValue response;
+				for (Clock::time_point now = Clock::now(); now < deadline;) {
+					account.Info(response);
+					const Clock::time_point done = Clock::now();
+					latencies[i].Add(done - now);
+					now = done;
+				}
+			});
+		}
+		for (auto &worker : workers)
+			worker.join();
+		const Clock::duration elapsed = Clock::now() - started;
+		for (unsigned i = 1; i < threads; ++i)
+			latencies[0].Merge(latencies[i]);
+		const string name = "sync, " + std::to_string(threads) + " thread(s)";
+		Report(name.c_str(), latencies[0], elapsed);
+	}
+
+	Latencies latencies;
+	std::vector<std::pair<std::future<JsonValue>, Clock::time_point>> window;
+	const Clock::time_point started = Clock::now();
+	const Clock::time_point deadline = started + options.duration;
+	while (Clock::now() < deadline) {
+		while (window.size() < BENCH_ASYNC_WINDOW)
+			window.emplace_back(account.InfoAsync(), Clock::now());
+		for (auto &call : window) {
+			call.first.get();
+			latencies.Add(Clock::now() - call.second);
+		}
+		window.clear();
+	}
+	const string name = "async, window " + std::to_string(BENCH_ASYNC_WINDOW);
+	Report(name.c_str(), latencies, Clock::now() - started);
+}
+
+/*
+* HTTP/1.1 и HTTP/2 поверх TLS: волны по BENCH_H2_CONCURRENCY одновременных
+* асинхронных запросов. Сервер отвечает с задержкой, как настоящий API, поэтому
+* HTTP/1.1 держит открытым соединение на каждый одновременный запрос, а HTTP/2
+* мультиплексирует их в одно.
+*/
+void Http2(const BenchOptions &options) {
+	const Transport::HttpVersion versions[] = {Transport::hvHTTP1_1, Transport::hvHTTP2};
+	for (Transport::HttpVersion version : versions) {
+		StubServer server(StubServer::smTLS, false);
+		server.Handle("GET", "/v1/scalets/", [](const StubRequest &request, StubResponse &response) {
+			std::this_thread::sleep_for(BENCH_H2_SERVER_DELAY);
+			response.body = "{\"ctid\": " + request.path.substr(request.path.rfind('/') + 1) + "}";
+		});
+		Transport::SetBaseURL(server.BaseURL());
+		Transport::SetHttpVersion(version);
+		Scalets scalets("token");
+
+		Latencies latencies;
+		std::vector<std::pair<std::future<JsonValue>, Clock::time_point>> wave;
+		const Clock::time_point started = Clock::now();
+		const Clock::time_point deadline = started + options.duration;
+		while (Clock::now() < deadline) {
+			for (int id = 0; id < BENCH_H2_CONCURRENCY; ++id)
+				wave.emplace_back(scalets.InfoAsync(id), Clock::now());
+			for (auto &call : wave) {
+				call.first.get();
+				latencies.Add(Clock::now() - call.second);
+			}
+			wave.clear();
+		}
+		const Clock::duration elapsed = Clock::now() - started;
+		const StubServer::Stats stats = server.GetStats();
+		const string name = string(version == Transport::hvHTTP2 ? "h2" : "http/1.1") + ", "
+				+ std::to_string(BENCH_H2_CONCURRENCY) + " concurrent";
+		Report(name.c_str(), latencies, elapsed);
+		printf("  %-28s %10llu connections (%llu h2), %llu TLS handshakes\n", "", (unsigned long long) stats.connections,
+				(unsigned long long) stats.http2_connections, (unsigned long long) stats.handshakes);
+	}
+}
+
+/*
+* Выделения памяти (operator new; malloc внутри libcurl не учитывается) на один
+* синхронный GET в установившемся режиме. Тело ответа - объект с одной строкой
+* заданного размера, разбор которой стоит одного выделения при любом размере,
+* поэтому рост выделений с размером ответа означал бы перевыделения буфера ответа.
+*/
+void Allocations(const BenchOptions &options) {
+	StubServer server(StubServer::smPlain, false);
+	server.Handle("GET", "/v1/account", [](const StubRequest &request, StubResponse &response) {
+		const size_t size = (size_t) atol(request.Header("x-token").c_str());
+		response.body = "{\"info\": \"" + string(size, 'x') + "\"}";
+		response.compress = false;
+	});
+	Transport::SetBaseURL(server.BaseURL());
+
+	const size_t sizes[] = {1 << 10, 64 << 10, 512 << 10};
+	const unsigned calls = options.quick ? BENCH_ALLOC_QUICK_CALLS : BENCH_ALLOC_CALLS;
+	for (size_t size : sizes) {
+		// Размер ответа передается токеном, чтобы у каждого размера был свой клиент
+		Account account(std::to_string(size));
+		JsonValue response;
+		for (unsigned i = 0; i < BENCH_ALLOC_WARMUP; ++i)
+			account.Info(response);
+
+		allocation_counter.allocations = 0;
+		allocation_counter.bytes = 0;
+		allocation_counter.counting = true;
+		for (unsigned i = 0; i < calls; ++i)
+			account.Info(response);
+		allocation_counter.counting = false;
+
+		printf("  %-28s %10.1f allocs/call %12.0f bytes/call\n", (std::to_string(size >> 10) + " KB response").c_str(),
+				(double) allocation_counter.allocations / calls, (double) allocation_counter.bytes / calls);
+	}
+}
+
+/// Обработчик трассировки, который ничего не делает
+class EmptyTracer : public Tracer {
+public:
+	void *OnStart(const Call &, string &) override {
+		return nullptr;
+	}
+
+	void OnComplete(const Call &) override {}
+};
+
+/// Процессорное время вызывающего потока на один синхронный GET, наносекунды
+double CpuPerCall(Account &account, unsigned calls) {
+	JsonValue response;
+	timespec begin, end;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+	for (unsigned i = 0; i < calls; ++i)
+		account.Info(response);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+	return ((end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec)) / calls;
+}
+
+/*
+* Стоимость трассировки: процессорное время вызывающего потока на вызов без
+* обработчика, с пустым обработчиком и после его снятия. Процессорное время, в
+* отличие от времени ответа, не включает ожидание заглушки. Режимы чередуются
+* по кругу, берется лучший круг, чтобы сгладить шум планировщика.
+*/
+void Tracing(const BenchOptions &options) {
+	StubServer server(StubServer::smPlain, false);
+	ServeAccount(server);
+	Transport::SetBaseURL(server.BaseURL());
+	Account account("token");
+	CpuPerCall(account, BENCH_ALLOC_WARMUP);
+
+	const unsigned calls = options.quick ? BENCH_TRACER_QUICK_CALLS : BENCH_TRACER_CALLS;
+	const char *const names[] = {"no tracer", "empty tracer", "tracer removed"};
+	double best[3] = {0, 0, 0};
+	for (unsigned round = 0; round < BENCH_TRACER_ROUNDS; ++round) {
+		for (int mode = 0; mode < 3; ++mode) {
+			Tracer::Set(mode == 1 ? std::make_shared<EmptyTracer>() : nullptr);
+			const double cost = CpuPerCall(account, calls);
+			if (round == 0 || cost < best[mode])
+				best[mode] = cost;
+		}
+	}
+	Tracer::Set(nullptr);
+	for (int mode = 0; mode < 3; ++mode)
+		printf("  %-28s %10.0f ns cpu/call   %+8.0f ns vs no tracer\n", names[mode], best[mode], best[mode] - best[0]);
+}
+
+/*
+* Стоимость рукопожатий: каждый круг создает новые объекты десяти классов
+* ресурсов и выполняет по одному вызову каждым, как задачи синхронизации.
+* Первый вызов платит за TCP и TLS, остальные должны идти по уже открытому
+* соединению из общего транспорта, что видно по счетчикам заглушки.
+*/
+void Handshakes(const BenchOptions &options) {
+	StubServer server(StubServer::smTLS, false);
+	server.Handle("GET", "/v1/", [](const StubRequest &, StubResponse &response) {
+		response.body = "[]";
+	});
+	Transport::SetBaseURL(server.BaseURL());
+
+	typedef std::function<void(const string &token, JsonValue &response)> Call;
+	const Call calls[] = {
+		[](const string &token, JsonValue &response) { Account(token).Info(response); },
+		[](const string &token, JsonValue &response) { Scalets(token).List(response); },
+		[](const string &token, JsonValue &response) { ServerTags(token).List(response); },
+		[](const string &token, JsonValue &response) { Backup(token).List(response); },
+		[](const string &token, JsonValue &response) { Background(token).Locations(response); },
+		[](const string &token, JsonValue &response) { Configurations(token).RPlans(response); },
+		[](const string &token, JsonValue &response) { SSHKeys(token).List(response); },
+		[](const string &token, JsonValue &response) { Notifications(token).Info(response); },
+		[](const string &token, JsonValue &response) { Billing(token).Balance(response); },
+		[](const string &token, JsonValue &response) { Domain(token).List(response); },
+	};
+
+	JsonValue response;
+	Latencies first, rest;
+	const unsigned rounds = options.quick ? BENCH_HANDSHAKE_QUICK_ROUNDS : BENCH_HANDSHAKE_ROUNDS;
+	const Clock::time_point started = Clock::now();
+	for (unsigned round = 0; round < rounds; ++round) {
+		for (const Call &call : calls) {
+			const Clock::time_point begin = Clock::now();
+			call("token", response);
+			(round == 0 && &call == calls ? first : rest).Add(Clock::now() - begin);
+		}
+	}
+	const Clock::duration elapsed = Clock::now() - started;
+
+	const StubServer::Stats stats = server.GetStats();
+	printf("  %-28s %10.1f us\n", "first call (cold)", first.Percentile(0.5));
+	Report("fresh object per call", rest, elapsed);
+	printf("  %-28s %10llu calls, %llu connections, %llu TLS handshakes (%llu resumed)\n", "",
+			(unsigned long long) stats.requests, (unsigned long long) stats.connections,
+			(unsigned long long) stats.handshakes, (unsigned long long) stats.resumed);
+}
+
+/// Параметры типичного Scalets::Create
+JsonValue CreateParams() {
+	JsonValue params;
+	params["make_from"] = "ubuntu_16.04_64_001_master";
+	params["rplan"] = "medium";
+	params["do_start"] = true;
+	params["name"] = "bench-scalet-01";
+	params["password"] = "Sup3r-secret-passw0rd";
+	params["location"] = "spb0";
+	for (int id = 1; id <= 4; ++id)
+		params["keys"].append(1000 + id);
+	return params;
+}
+
+/*
+* Сериализация тел запросов: прежний путь (toStyledString в новую строку)
+* против компактного сериализатора в переиспользуемый буфер. Байты на проводе
+* дополнительно измеряются заглушкой по телам запросов Scalets::Create.
+*/
+void Serialization(const BenchOptions &options) {
+	const JsonValue params = CreateParams();
+	const unsigned ops = options.quick ? BENCH_SERIALIZE_QUICK_OPS : BENCH_SERIALIZE_OPS;
+
+	size_t styled_size = 0;
+	Clock::time_point begin = Clock::now();
+	for (unsigned i = 0; i < ops; ++i) {
+		const string body = params.toStyledString();
+		styled_size = strlen(body.c_str());
+	}
+	const double styled_ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / ops;
+
+	string buffer;
+	begin = Clock::now();
+	for (unsigned i = 0; i < ops; ++i) {
+		buffer.clear();
+		WriteCompactJson(params, buffer);
+	}
+	const double compact_ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / ops;
+
+	printf("  %-28s %10.0f ns/op %10zu bytes\n", "toStyledString", styled_ns, styled_size);
+	printf("  %-28s %10.0f ns/op %10zu bytes\n", "WriteCompactJson, reused", compact_ns, buffer.size());
+
+	StubServer server(StubServer::smPlain, false);
+	server.Handle("POST", "/v1/scalets", [](const StubRequest &, StubResponse &response) {
+		response.body = "{\"ctid\": 1}";
+	});
+	Transport::SetBaseURL(server.BaseURL());
+	Scalets scalets("token");
+	JsonValue response;
+	for (unsigned i = 0; i < BENCH_SERIALIZE_CALLS; ++i)
+		scalets.Create(params, response);
+	printf("  %-28s %10.1f bytes/request body on the wire\n", "Scalets::Create",
+			(double) server.GetStats().bytes_in / BENCH_SERIALIZE_CALLS);
+}
+
+/// Список серверов из count элементов, похожий на ответ Scalets::List
+string ScaletList(int count) {
+	string body = "[";
+	for (int id = 1; id <= count; ++id) {
+		body += (id > 1 ? ", " : "") + string("{\"ctid\": ") + std::to_string(id)
+				+ ", \"name\": \"scalet-" + std::to_string(id) + "\", \"status\": \"started\", \"location\": \"spb0\","
+				" \"rplan\": \"medium\", \"made_from\": \"ubuntu_16.04_64_001_master\", \"hostname\": \"cs"
+				+ std::to_string(10000 + id) + ".vscale.io\", \"locked\": false, \"active\": true,"
+				" \"public_address\": {\"address\": \"95.213.0." + std::to_string(id % 250) + "\", \"netmask\": \"255.255.255.0\","
+				" \"gateway\": \"95.213.0.1\"}, \"keys\": [{\"name\": \"deploy\", \"id\": 16}], \"tags\": []}";
+	}
+	return body + "]";
+}
+
+/*
+* Сжатие ответов: Scalets::List для списков разного размера со сжатием и без.
+* Процессорное время вызывающего потока включает распаковку и разбор, но не
+* работу заглушки; время вызова включает и сжатие ответа заглушкой.
+*/
+void Decoding(const BenchOptions &options) {
+	const int counts[] = {100, 1000, 10000};
+	const unsigned calls = options.quick ? BENCH_DECODE_QUICK_CALLS : BENCH_DECODE_CALLS;
+	for (int count : counts) {
+		const string body = ScaletList(count);
+		for (int compressed = 0; compressed < 2; ++compressed) {
+			StubServer server(StubServer::smPlain, false);
+			server.Handle("GET", "/v1/scalets", [&body](const StubRequest &, StubResponse &response) {
+				response.body = body;
+			});
+			Transport::SetBaseURL(server.BaseURL());
+			Transport::SetCompression(compressed != 0);
+			Scalets scalets("token");
+			JsonValue response;
+			scalets.List(response);
+			server.Reset();
+
+			Latencies latencies;
+			timespec cpu_begin, cpu_end;
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_begin);
+			for (unsigned i = 0; i < calls; ++i) {
+				const Clock::time_point begin = Clock::now();
+				scalets.List(response);
+				latencies.Add(Clock::now() - begin);
+			}
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+			const double cpu_us = ((cpu_end.tv_sec - cpu_begin.tv_sec) * 1e6 + (cpu_end.tv_nsec - cpu_begin.tv_nsec) / 1e3) / calls;
+
+			const string name = std::to_string(count) + " scalets, " + (compressed ? "gzip" : "identity");
+			printf("  %-28s %10.0f bytes   p50 %8.1f us   client cpu %8.1f us/call\n", name.c_str(),
+					(double) server.GetStats().bytes_out / calls, latencies.Percentile(0.5), cpu_us);
+		}
+	}
+	Transport::SetCompression(true);
+}
+
+struct Scenario {
+	const char *name;
+	const char *description;
+	void (*run)(const BenchOptions &options);
+};
+
+const Scenario SCENARIOS[] = {
+	{"throughput", "calls/sec and latency percentiles, sync and async", Throughput},
+	{"h2", "connections and p99 at 200 concurrent requests, HTTP/1.1 vs HTTP/2 over TLS", Http2},
+	{"alloc", "steady-state heap allocations per GET for growing response sizes", Allocations},
+	{"handshake", "connections and handshakes for calls through fresh resource objects over TLS", Handshakes},
+	{"serialize", "request body serialization ns/op and bytes on the wire, styled vs compact", Serialization},
+	{"decode", "Scalets::List transfer size, time and client CPU with and without compression", Decoding},
+	{"tracer", "caller CPU per GET without a tracer, with an empty one and after removing it", Tracing},
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+	BenchOptions options;
+	options.quick = false;
+	std::vector<string> selected;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--quick") == 0) {
+			options.quick = true;
+		} else if (strcmp(argv[i], "--help") == 0) {
+			printf("usage: %s [--quick] [scenario...]\n", argv[0]);
+			for (const auto &scenario : SCENARIOS)
+				printf("  %-12s %s\n", scenario.name, scenario.description);
+			return 0;
+		} else {
+			selected.push_back(argv[i]);
+		}
+	}
+	options.duration = options.quick ? Clock::duration(BENCH_QUICK_DURATION) : Clock::duration(BENCH_DURATION);
+
+	// Одинаковые одновременные запросы должны доходить до заглушки, а не объединяться
+	SingleFlight::Disable();
+	RetryPolicy::Disable();
+	int status = 0;
+	for (const auto &scenario : SCENARIOS) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), scenario.name) == selected.end())
+			continue;
+		printf("%s: %s\n", scenario.name, scenario.description);
+		try {
+			scenario.run(options);
+		} catch (const std::exception &e) {
+			fprintf(stderr, "%s failed: %s\n", scenario.name, e.what());
+			status = 1;
+		}
+		Transport::SetHttpVersion(Transport::hvHTTP1_1);
+		Transport::SetBaseURL("");
+	}
+	return status;
+}
@@ -0,0 +1,84 @@
+#ifndef __VSCALE_CONSUMPTION_H__
+#define __VSCALE_CONSUMPTION_H__
+
+#include <vscale/vscale.h>
+#include <map>
+
+namespace vscale {
+
+/*
+* @brief Списания за период
+* @detail Суммы в единицах API. Даты в формате ГГГГ-ММ-ДД.
+*/
+struct ConsumptionReport {
+	string start_date, end_date;
+	double total;
+	/// Списания по дням
+	std::map<string, double> days;
+	/// Списания по серверам
+	std::map<int, double> scalets;
+	/// Списания по серверам по дням
+	std::map<int, std::map<string, double>> scalet_days;
+};
+
+/*
+* @brief Получение списаний за длинные периоды
+* @detail Период разбивается на календарные месяцы, которые запрашиваются параллельно
+* через Billing::ConsumptionAsync, а ответы сводятся по дням и серверам. Закрытые месяцы
+* (последний день которых старше settle_days дней) не меняются, поэтому запрашиваются
+* целиком один раз и кешируются навсегда: в памяти и, если задан cache_dir, в файлах,
+* которые переживают перезапуск. Сеть используется только для текущего месяца и
+* месяцев, которых еще нет в кеше. Объект можно использовать из нескольких потоков.
+*/
+class ConsumptionFetcher {
+public:
+	struct Options {
+		/// Максимальное количество одновременно выполняемых запросов
+		size_t concurrency;
+		/// Каталог файлового кеша закрытых месяцев; пусто - только кеш в памяти
+		string cache_dir;
+		/// Количество дней после окончания месяца, в течение которых списания за него могут измениться
+		unsigned settle_days;
+
+		Options(): concurrency(4), settle_days(1) {}
+	};
+
+	struct Stats {
+		/// Количество запросов к API и месяцев, взятых из кеша в памяти и из файлового кеша
+		uint64_t requests, memory_hits, disk_hits;
+		/// Количество закрытых месяцев в кеше в памяти
+		size_t cached_months;
+	};
+
+	/*
+	* @brief Конструктор, принимающий токен для выполнения запроса
+	* @param [in] token Токен для выполнения запроса
+	* @param [in] options Параллельность и кеширование
+	*/
+	ConsumptionFetcher(const string &token, const Options &options = Options());
+
+	/// Виртуальный деструктор
+	virtual ~ConsumptionFetcher();
+
+	/*
+	* @brief Списания за период
+	* @detail При неверной дате или ошибке запроса генерируется BadRequest.
+	* @param [in] start_date Начальная дата (включительно)
+	* @param [in] end_date Конечная дата (включительно)
+	*/
+	virtual ConsumptionReport Fetch(const string &start_date, const string &end_date);
+
+	/// Счетчики запросов и кеша
+	virtual Stats GetStats() const;
+
+private:
+	ConsumptionFetcher(const ConsumptionFetcher &) = delete;
+	ConsumptionFetcher &operator=(const ConsumptionFetcher &) = delete;
+
+	class Store;
+	std::shared_ptr<Store> m_store;
+};
+
+} // namespace vscale
+
+#endif // __VSCALE_CONSUMPTION_H__
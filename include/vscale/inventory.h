@@ -0,0 +1,147 @@
+#ifndef __VSCALE_INVENTORY_H__
+#define __VSCALE_INVENTORY_H__
+
+#include <vscale/vscale.h>
+#include <chrono>
+
+namespace vscale {
+
+/*
+* @brief Ресурсная запись вместе с идентификатором домена
+*/
+struct DomainRecordEntry {
+	int domain_id;
+	DomainRecordInfo record;
+};
+
+/*
+* @brief Локальное зеркало серверов, тегов серверов, доменов, их ресурсных записей и резервных копий
+* @detail Refresh запрашивает списки ресурсов (условными запросами, поэтому неизменившиеся
+* списки не передаются повторно) и обновляет зеркало инкрементально: разбираются и
+* переиндексируются только добавленные и изменившиеся объекты, пропавшие удаляются.
+* Поиск выполняется по хеш-индексам без обращения к API: по идентификатору, имени,
+* тегу, локации, публичному адресу сервера, имени и содержимому ресурсной записи,
+* серверу резервной копии. Объект можно использовать из нескольких потоков.
+*
+* Зеркало можно сохранить в двоичный снимок и загрузить из него при следующем запуске:
+* файл отображается в память и без разбора JSON загружается в индексы. Снимок содержит
+* версию формата и время обновления зеркала; свежесть загруженных данных проверяется
+* через Age, а RefreshAsync сверяет их с API в фоне и перезаписывает снимок.
+*/
+class Inventory {
+public:
+	struct Stats {
+		size_t scalets, tags, domains, records, backups;
+		/// Количество обновлений, добавленных или измененных и удаленных объектов за все обновления
+		uint64_t refreshes, upserts, removals;
+	};
+
+	/*
+	* @brief Конструктор, принимающий токен для выполнения запроса
+	* @param [in] token Токен для выполнения запроса
+	*/
+	Inventory(const string &token);
+
+	/// Виртуальный деструктор
+	virtual ~Inventory();
+
+	/*
+	* @brief Обновить зеркало
+	* @detail Списки запрашиваются параллельно. Зеркало изменяется, только если все
+	* запросы выполнены успешно, иначе генерируется BadRequest и зеркало остается прежним.
+	*/
+	virtual void Refresh();
+
+	/*
+	* @brief Обновить зеркало в фоновом потоке
+	* @detail Деструктор ждет завершения запущенных обновлений.
+	* @param [in] snapshot Путь снимка, который перезаписывается после успешного обновления
+	* @return Результат обновления (исключение BadRequest при ошибке)
+	*/
+	virtual std::future<void> RefreshAsync(const string &snapshot = string());
+
+	/*
+	* @brief Сохранить зеркало в снимок
+	* @detail Снимок записывается во временный файл и атомарно заменяет прежний.
+	* При ошибке записи генерируется BadRequest.
+	* @param [in] path Путь снимка
+	*/
+	virtual void Save(const string &path) const;
+
+	/*
+	* @brief Загрузить зеркало из снимка
+	* @param [in] path Путь снимка
+	* @return false, если файла нет, он поврежден, другой версии формата или сохранен для другого токена
+	*/
+	virtual bool Load(const string &path);
+
+	/// Время с последнего обновления зеркала (для загруженного снимка - с обновления перед сохранением)
+	virtual std::chrono::seconds Age() const;
+
+	/*
+	* @brief Сервер по идентификатору
+	* @return false, если сервера нет в зеркале
+	*/
+	virtual bool ScaletById(int ctid, ScaletInfo &result) const;
+
+	/// Серверы с именем name
+	virtual std::vector<ScaletInfo> ScaletsByName(const string &name) const;
+
+	/// Серверы с тегом tag
+	virtual std::vector<ScaletInfo> ScaletsByTag(const string &tag) const;
+
+	/// Серверы в локации location
+	virtual std::vector<ScaletInfo> ScaletsByLocation(const string &location) const;
+
+	/// Серверы с тегом tag в локации location
+	virtual std::vector<ScaletInfo> ScaletsByTag(const string &tag, const string &location) const;
+
+	/// Серверы с публичным адресом address
+	virtual std::vector<ScaletInfo> ScaletsByAddress(const string &address) const;
+
+	/*
+	* @brief Тег сервера по идентификатору или имени
+	* @return false, если тега нет в зеркале
+	*/
+	virtual bool TagById(int id, TagInfo &result) const;
+	virtual bool TagByName(const string &name, TagInfo &result) const;
+
+	/*
+	* @brief Домен по идентификатору или имени
+	* @return false, если домена нет в зеркале
+	*/
+	virtual bool DomainById(int id, DomainInfo &result) const;
+	virtual bool DomainByName(const string &name, DomainInfo &result) const;
+
+	/// Ресурсные записи домена
+	virtual std::vector<DomainRecordEntry> RecordsByDomain(int domain_id) const;
+
+	/// Ресурсные записи с именем name
+	virtual std::vector<DomainRecordEntry> RecordsByName(const string &name) const;
+
+	/// Ресурсные записи с содержимым content, например указывающие на адрес
+	virtual std::vector<DomainRecordEntry> RecordsByContent(const string &content) const;
+
+	/*
+	* @brief Резервная копия по идентификатору
+	* @return false, если резервной копии нет в зеркале
+	*/
+	virtual bool BackupById(const string &id, BackupInfo &result) const;
+
+	/// Резервные копии сервера
+	virtual std::vector<BackupInfo> BackupsByScalet(int ctid) const;
+
+	/// Размер зеркала и счетчики обновлений
+	virtual Stats GetStats() const;
+
+private:
+	Inventory(const Inventory &) = delete;
+	Inventory &operator=(const Inventory &) = delete;
+
+	class Store;
+	std::shared_ptr<Store> m_store;
+};
+
+} // namespace vscale
+
+#endif // __VSCALE_INVENTORY_H__
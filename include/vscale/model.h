@@ -0,0 +1,146 @@
+#ifndef __VSCALE_MODEL_H__
+#define __VSCALE_MODEL_H__
+
+#include <json/json.h>
+#include <string>
+#include <vector>
+
+namespace vscale {
+
+using std::string;
+typedef Json::Value JsonValue;
+
+/*
+* @brief Строка, хранящаяся в единственном экземпляре на весь процесс
+* @detail Используется для часто повторяющихся значений (локация, тарифный план, статус):
+* объект занимает один указатель, копирование и сравнение не требуют работы со строкой.
+* Интернированные строки не освобождаются до завершения процесса.
+*/
+class InternedString {
+public:
+	/// Пустая строка
+	InternedString();
+
+	/*
+	* @brief Конструктор, возвращающий единственный экземпляр строки value
+	* @param [in] value Значение строки
+	*/
+	explicit InternedString(const string &value);
+
+	/// Значение строки
+	const string &str() const {
+		return *m_value;
+	}
+
+	bool empty() const {
+		return m_value->empty();
+	}
+
+	bool operator==(const InternedString &other) const {
+		return m_value == other.m_value;
+	}
+
+	bool operator!=(const InternedString &other) const {
+		return m_value != other.m_value;
+	}
+
+private:
+	const string *m_value;
+};
+
+/*
+* @brief Сетевой адрес сервера
+*/
+struct AddressInfo {
+	string address, netmask, gateway;
+};
+
+/*
+* @brief Краткая ссылка на связанный объект (ssh-ключ, тег)
+*/
+struct ObjectRef {
+	int id;
+	string name;
+};
+
+/*
+* @brief Информация о сервере
+*/
+struct ScaletInfo {
+	int ctid;
+	string name, hostname, made_from, created, deleted;
+	InternedString status, location, rplan;
+	bool locked, active;
+	AddressInfo public_address, private_address;
+	std::vector<ObjectRef> keys, tags;
+
+	/// Заполняет структуру из объекта json, полученного от API
+	static ScaletInfo FromJson(const JsonValue &value);
+};
+
+/*
+* @brief Информация о теге сервера
+*/
+struct TagInfo {
+	int id;
+	string name;
+	std::vector<int> scalets;
+
+	/// Заполняет структуру из объекта json, полученного от API
+	static TagInfo FromJson(const JsonValue &value);
+};
+
+/*
+* @brief Информация о домене
+*/
+struct DomainInfo {
+	int id;
+	string name, created, changed;
+	std::vector<ObjectRef> tags;
+
+	/// Заполняет структуру из объекта json, полученного от API
+	static DomainInfo FromJson(const JsonValue &value);
+};
+
+/*
+* @brief Ресурсная запись домена
+*/
+struct DomainRecordInfo {
+	int id, ttl, priority;
+	string name, content;
+	InternedString type;
+
+	/// Заполняет структуру из объекта json, полученного от API
+	static DomainRecordInfo FromJson(const JsonValue &value);
+};
+
+/*
+* @brief Информация о резервной копии
+*/
+struct BackupInfo {
+	string id, name, created;
+	int scalet;
+	double size;
+	InternedString status, location;
+	bool active;
+
+	/// Заполняет структуру из объекта json, полученного от API
+	static BackupInfo FromJson(const JsonValue &value);
+};
+
+/*
+* @brief Информация о текущей операции
+*/
+struct TaskInfo {
+	string id, insert_date, started_date, done_date;
+	int scalet;
+	InternedString method, location;
+	bool done, error;
+
+	/// Заполняет структуру из объекта json, полученного от API
+	static TaskInfo FromJson(const JsonValue &value);
+};
+
+} // namespace vscale
+
+#endif // __VSCALE_MODEL_H__
@@ -0,0 +1,124 @@
+#ifndef __VSCALE_PROVISIONER_H__
+#define __VSCALE_PROVISIONER_H__
+
+#include <vscale/vscale.h>
+
+namespace vscale {
+
+/*
+* @brief Конвейер создания серверов
+* @detail Каждый сервер проходит этапы: создание, ожидание завершения создания (через общий
+* цикл опроса TaskWatcher) с получением адреса, добавление в теги, создание PTR-записи и
+* ресурсной записи домена. Этапы выполняются асинхронно и независимо для разных серверов:
+* пока один сервер создается, другой уже добавляется в теги. У каждого этапа свой предел
+* одновременно выполняемых операций, сервер ждет в очереди этапа, пока предел исчерпан.
+* Перед запуском конвейера регистрируются SSH-ключи из Options::keys (уже загруженные
+* ключи с тем же содержимым используются повторно), их идентификаторы добавляются в
+* параметры создания каждого сервера.
+*
+* Обновление тега заменяет весь список его серверов, поэтому обновления одного тега
+* выполняются последовательно, а серверы, дошедшие до этапа за время обновления,
+* добавляются следующим обновлением одним запросом.
+*
+* Ошибка на любом этапе останавливает конвейер только для этого сервера; уже созданный
+* сервер не удаляется, его идентификатор возвращается в результате.
+*/
+class Provisioner {
+public:
+	enum Stage {
+		psKeys,
+		psCreate,
+		psWait,
+		psTag,
+		psPTR,
+		psRecord,
+		psCount
+	};
+
+	/*
+	* @brief Описание создаваемого сервера
+	*/
+	struct Node {
+		/// Параметры Scalets::Create
+		JsonValue params;
+		/// Идентификаторы тегов серверов; пусто - этап пропускается
+		std::vector<int> tags;
+		/// Содержимое PTR-записи для публичного адреса; пусто - этап пропускается
+		string ptr;
+		/// Домен и имя A-записи на публичный адрес; 0 - этап пропускается
+		int domain_id;
+		string record_name;
+		int ttl;
+
+		Node(): domain_id(0), ttl(3600) {}
+	};
+
+	/*
+	* @brief Результат создания одного сервера
+	* @detail Если success выставлен в false, stage - этап, на котором произошла ошибка,
+	* иначе psCount.
+	*/
+	struct Result {
+		int ctid;
+		string address;
+		bool success;
+		Stage stage;
+		string error;
+	};
+
+	/*
+	* @brief Параметры конвейера
+	*/
+	struct Options {
+		/// Предел одновременно выполняемых операций для каждого этапа
+		size_t concurrency[psCount];
+		/// Параметры SSHKeys::Create регистрируемых ключей
+		std::vector<JsonValue> keys;
+
+		Options();
+	};
+
+	/*
+	* @brief Счетчики этапа
+	* @detail latency - время выполнения операции этапа без ожидания в очереди,
+	* throughput - успешные операции в секунду времени, когда этап был занят.
+	*/
+	struct StageStats {
+		uint64_t started, succeeded, failed;
+		double mean_latency_ms, max_latency_ms, busy_seconds, throughput;
+	};
+
+	/*
+	* @brief Конструктор, принимающий токен для выполнения запроса
+	* @param [in] token Токен для выполнения запроса
+	* @param [in] options Параметры конвейера
+	*/
+	Provisioner(const string &token, const Options &options = Options());
+
+	/// Виртуальный деструктор
+	virtual ~Provisioner();
+
+	/*
+	* @brief Создать серверы
+	* @detail Если не удалось зарегистрировать SSH-ключи или получить список тегов,
+	* генерируется BadRequest и ни один сервер не создается.
+	* @param [in] nodes Описания серверов
+	* @return Результаты в порядке nodes
+	*/
+	virtual std::vector<Result> Run(const std::vector<Node> &nodes);
+
+	/// Счетчики этапа за все запуски конвейера
+	virtual StageStats GetStats(Stage stage) const;
+
+private:
+	Provisioner(const Provisioner &) = delete;
+	Provisioner &operator=(const Provisioner &) = delete;
+
+	class Store;
+	class Pipeline;
+	std::shared_ptr<Store> m_store;
+};
+
+} // namespace vscale
+
+#endif // __VSCALE_PROVISIONER_H__
@@ -0,0 +1,62 @@
+#ifndef __VSCALE_TASK_WATCHER_H__
+#define __VSCALE_TASK_WATCHER_H__
+
+#include <vscale/vscale.h>
+
+namespace vscale {
+
+/*
+* @brief Ожидание завершения операций над серверами
+* @detail Все объекты TaskWatcher с одинаковым токеном используют один общий цикл опроса
+* Scalets::Tasks в отдельном потоке, поэтому сотни ожидающих операций стоят один запрос
+* на каждый период опроса. Период адаптивный: для каждого вида операции (method)
+* запоминается типичная длительность, опрос выполняется к ожидаемому моменту завершения
+* ближайшей операции и реже, пока операции далеки от завершения или сильно задерживаются.
+* Операция считается завершенной, когда в списке операций она отмечена как done; поле
+* error итога - операция завершилась ошибкой. Если операции нет в списке несколько
+* опросов подряд, ожидание завершается исключением BadRequest. Результат передается через std::future и, если передан, обработчик,
+* который вызывается в потоке опроса. Если список операций не удается получить несколько
+* раз подряд, ожидание завершается исключением BadRequest.
+*/
+class TaskWatcher {
+public:
+	typedef std::function<void(const TaskInfo &task, std::exception_ptr error)> TaskCompletion;
+
+	/*
+	* @brief Конструктор, принимающий токен для выполнения запроса
+	* @param [in] token Токен для выполнения запроса
+	*/
+	TaskWatcher(const string &token);
+
+	/// Виртуальный деструктор
+	virtual ~TaskWatcher();
+
+	/*
+	* @brief Ожидать завершения операции
+	* @param [in] task_id Идентификатор операции
+	* @param [in] done Обработчик завершения
+	* @return Последнее известное состояние операции (поле error - операция завершилась ошибкой)
+	*/
+	virtual std::future<TaskInfo> Wait(const string &task_id, TaskCompletion done = TaskCompletion()) const;
+
+	/*
+	* @brief Ожидать завершения всех текущих операций над сервером
+	* @param [in] ctid Идентификатор сервера
+	* @param [in] done Обработчик завершения
+	* @detail Отслеживается первая найденная незавершенная операция над сервером. Если ее
+	* нет, результатом считается последняя завершенная операция над сервером.
+	* @return Итоговое состояние операции над сервером
+	*/
+	virtual std::future<TaskInfo> WaitScalet(int ctid, TaskCompletion done = TaskCompletion()) const;
+
+	/// Количество ожидающих операций в общем цикле опроса
+	virtual size_t Pending() const;
+
+private:
+	class Poller;
+	std::shared_ptr<Poller> m_poller;
+};
+
+} // namespace vscale
+
+#endif // __VSCALE_TASK_WATCHER_H__
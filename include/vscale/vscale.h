@@ -2,8 +2,15 @@
 #define __VSCALE_H__
 
 #include <json/json.h>
+#include <vscale/model.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 #include <exception>
 
 namespace vscale {
@@ -11,6 +18,24 @@ namespace vscale {
 using std::string;
 typedef Json::Value JsonValue;
 
+/*
+* @brief Обработчик завершения асинхронного запроса
+* @detail Вызывается в фоновом потоке ввода-вывода, а если ответ взят из ResponseCache -
+* сразу в вызывающем потоке. Обработчик запроса, объединенного SingleFlight с другим,
+* всегда вызывается в потоке ввода-вывода. При успешном выполнении error пуст,
+* иначе содержит исключение BadRequest, а response не заполнен.
+*/
+typedef std::function<void(const JsonValue &response, std::exception_ptr error)> Completion;
+
+/*
+* @brief Обработчик элемента списка при потоковом разборе ответа
+* @detail Вызывается для каждого элемента по мере получения тела ответа. Исключение,
+* сгенерированное обработчиком, прерывает запрос и передается вызывающему.
+* В режиме Transport::hvHTTP2 запрос выполняется в общем соединении фоновым потоком
+* ввода-вывода, в нем же вызывается обработчик, а вызывающий поток ждет завершения.
+*/
+typedef std::function<void(const JsonValue &element)> ElementHandler;
+
 class BadRequest : public std::exception {
 public:
 	BadRequest(const string &what);
@@ -20,20 +45,378 @@ private:
 	string m_what;
 };
 
+/*
+* @brief Запрос отклонен клиентским ограничителем частоты
+* @detail Генерируется только при политике RateLimit::rpFailFast
+*/
+class RateLimited : public BadRequest {
+public:
+	RateLimited(const string &what);
+};
+
+/*
+* @brief Результат одного запроса пакетной операции
+* @detail Ошибка одного запроса не прерывает пакет: она сохраняется в error,
+* а success выставляется в false. Пакетные методы (*Bulk) блокируют вызывающий поток
+* до завершения пакета, а запросы пакета завершаются в фоновом потоке ввода-вывода,
+* поэтому их нельзя вызывать из Completion (генерируется BadRequest) и из обработчиков
+* TaskWatcher (пакет с BulkOptions::wait ждал бы поток, который сам и блокирует).
+*/
+template <typename Id>
+struct BulkResult {
+	Id id;
+	bool success;
+	JsonValue response;
+	string error;
+};
+
+/*
+* @brief Ход пакетной операции над питанием серверов
+*/
+struct BulkProgress {
+	/// Количество серверов в пакете, обработанных и завершившихся ошибкой
+	size_t total, completed, failed;
+	/// Номер текущей волны (с нуля) и количество волн
+	size_t wave, waves;
+};
+
+/*
+* @brief Параметры пакетной операции над питанием серверов
+* @detail Серверы обрабатываются волнами по wave штук (0 - все серверы одной волной),
+* следующая волна начинается после завершения предыдущей. Внутри волны одновременно
+* выполняется не более concurrency операций. Если wait выставлен, операция над сервером
+* считается завершенной не по ответу API, а после завершения операции над сервером,
+* которое отслеживает общий цикл опроса TaskWatcher. Обработчик progress вызывается
+* после завершения каждой операции в фоновом потоке; вызовы не пересекаются.
+*/
+struct BulkOptions {
+	size_t concurrency;
+	size_t wave;
+	bool wait;
+	std::function<void(const BulkProgress &progress, const BulkResult<int> &result)> progress;
+
+	BulkOptions(): concurrency(16), wave(0), wait(true) {}
+};
+
+/*
+* @brief Глобальные настройки транспорта
+*/
+class Transport {
+public:
+	enum HttpVersion {
+		hvHTTP1_1,
+		hvHTTP2
+	};
+
+	/*
+	* @brief Выбрать версию протокола HTTP
+	* @detail В режиме hvHTTP2 все запросы, в том числе синхронные, выполняются общим
+	* фоновым потоком ввода-вывода и мультиплексируются в одно соединение. Если сервер
+	* не поддерживает HTTP/2, используется HTTP/1.1. По умолчанию hvHTTP1_1.
+	*/
+	static void SetHttpVersion(HttpVersion version);
+
+	/// Текущая версия протокола HTTP
+	static HttpVersion GetHttpVersion();
+
+	/*
+	* @brief Включить сжатие ответов
+	* @detail Сервер получает заголовок Accept-Encoding со всеми кодировками, поддерживаемыми
+	* libcurl (gzip, deflate, brotli, zstd), ответ распаковывается потоково по мере получения.
+	* По умолчанию включено.
+	*/
+	static void SetCompression(bool enabled);
+
+	/// Включено ли сжатие ответов
+	static bool GetCompression();
+
+	/*
+	* @brief Установить базовый адрес API
+	* @detail Применяется ко всем последующим запросам, в том числе уже созданных объектов.
+	* Пустая строка восстанавливает адрес по умолчанию https://api.vscale.io
+	*/
+	static void SetBaseURL(const string &url);
+
+	/// Текущий базовый адрес API
+	static string GetBaseURL();
+};
+
+/*
+* @brief Кэш ответов справочных методов
+* @detail Кэширует почти неизменяемые справочники (Background::Locations, Background::Images,
+* Configurations::RPlans, Configurations::BillingPrices) в памяти процесса. Ключом служит
+* адрес запроса и токен. По умолчанию кэш выключен. При превышении max_entries вытесняются
+* записи, которые дольше всего не запрашивались.
+*/
+class ResponseCache {
+public:
+	enum Endpoint {
+		epLocations,
+		epImages,
+		epRPlans,
+		epBillingPrices
+	};
+
+	struct Stats {
+		uint64_t hits, misses, evictions;
+		size_t entries;
+	};
+
+	/*
+	* @brief Включить кэш
+	* @param [in] max_entries Максимальное количество хранимых ответов
+	*/
+	static void Enable(size_t max_entries = 256);
+
+	/// Выключить кэш и удалить все сохраненные ответы
+	static void Disable();
+
+	/*
+	* @brief Установить время жизни ответов метода
+	* @detail По умолчанию справочники локаций и тарифов хранятся час, образов и цен - 10 минут
+	*/
+	static void SetTTL(Endpoint endpoint, std::chrono::seconds ttl);
+
+	/// Удалить сохраненные ответы метода
+	static void Invalidate(Endpoint endpoint);
+
+	/// Удалить все сохраненные ответы
+	static void Clear();
+
+	/// Счетчики попаданий и промахов
+	static Stats GetStats();
+};
+
+/*
+* @brief Политика повторов запросов
+* @detail Идемпотентные запросы (GET, PUT, DELETE), завершившиеся временной ошибкой
+* (сбой соединения, таймаут, ответ 429 или 5xx), повторяются с экспоненциально растущей
+* случайной задержкой (decorrelated jitter). Если сервер вернул Retry-After, задержка
+* не меньше указанной в нем. Асинхронные запросы повторяются без блокировки потока.
+* По умолчанию включено: 3 попытки, задержка от 100 мс до 5 с, бюджет вызова 30 с.
+*/
+class RetryPolicy {
+public:
+	struct Stats {
+		uint64_t retries, give_ups;
+	};
+
+	/*
+	* @brief Включить повторы
+	* @param [in] max_attempts Максимальное количество попыток, включая первую
+	* @param [in] base_delay Минимальная задержка перед повтором
+	* @param [in] max_delay Максимальная задержка перед повтором
+	* @param [in] budget Максимальное время вызова со всеми повторами
+	*/
+	static void Enable(unsigned max_attempts = 3,
+			std::chrono::milliseconds base_delay = std::chrono::milliseconds(100),
+			std::chrono::milliseconds max_delay = std::chrono::milliseconds(5000),
+			std::chrono::milliseconds budget = std::chrono::milliseconds(30000));
+
+	/// Выключить повторы
+	static void Disable();
+
+	/// Количество повторов и отказов после исчерпания попыток или бюджета
+	static Stats GetStats();
+};
+
+/*
+* @brief Клиентское ограничение частоты запросов
+* @detail Token bucket с отдельным ведром на каждый токен API, общим для всех объектов
+* ресурсов в процессе. Ведро вмещает burst запросов и пополняется со скоростью
+* requests_per_second. При политике rpBlock запрос, для которого нет свободного места,
+* ожидает своей очереди (асинхронный - откладывается без блокировки потока), при
+* rpFailFast - сразу завершается исключением RateLimited. Повторы тоже расходуют ведро.
+* По умолчанию выключено.
+*/
+class RateLimit {
+public:
+	enum Policy {
+		rpBlock,
+		rpFailFast
+	};
+
+	struct Stats {
+		uint64_t delayed, rejected;
+	};
+
+	/*
+	* @brief Включить ограничение
+	* @param [in] requests_per_second Допустимая устойчивая частота запросов на токен
+	* @param [in] burst Количество запросов, которое можно выполнить подряд без ожидания
+	* @param [in] policy Ожидать или отклонять запросы сверх лимита
+	*/
+	static void Enable(double requests_per_second, unsigned burst, Policy policy = rpBlock);
+
+	/// Выключить ограничение
+	static void Disable();
+
+	/// Количество отложенных и отклоненных запросов
+	static Stats GetStats();
+};
+
+/*
+* @brief Объединение одинаковых одновременных GET-запросов
+* @detail Пока GET-запрос выполняется, такие же запросы (тот же адрес и токен) из других
+* потоков или асинхронных вызовов не отправляются повторно, а получают его результат
+* (или ошибку). По умолчанию включено.
+*/
+class SingleFlight {
+public:
+	struct Stats {
+		/// Выполненные запросы и запросы, получившие результат другого
+		uint64_t flights, coalesced;
+	};
+
+	/// Включить объединение
+	static void Enable();
+
+	/// Выключить объединение
+	static void Disable();
+
+	/// Счетчики выполненных и объединенных запросов
+	static Stats GetStats();
+};
+
+/*
+* @brief Метрики запросов
+* @detail После каждой попытки выполнения запроса собирается разбивка времени по фазам
+* (разрешение имени, соединение, TLS, ожидание ответа сервера, передача тела) и объем
+* отправленных и полученных данных. Значения агрегируются без блокировок в гистограммы
+* по шаблонам методов API (например "scalets/{id}/restart") и, если установлен, передаются
+* в MetricsSink. По умолчанию сбор включен.
+*/
+class Metrics {
+public:
+	enum Phase {
+		phNameLookup,
+		phConnect,
+		phTLS,
+		phServer,
+		phTransfer,
+		phTotal,
+		phCount
+	};
+
+	/*
+	* @brief Гистограмма длительностей в микросекундах
+	* @detail Корзина i содержит количество значений в диапазоне [2^i, 2^(i+1)), корзина 0 - [0, 2)
+	*/
+	struct Histogram {
+		std::vector<uint64_t> buckets;
+		uint64_t count, sum;
+
+		/// Верхняя граница корзины, в которую попадает квантиль q (от 0 до 1)
+		uint64_t Percentile(double q) const;
+	};
+
+	/// Накопленные метрики одного метода API
+	struct Endpoint {
+		string endpoint;
+		uint64_t requests, errors, bytes_sent, bytes_received;
+		Histogram phases[phCount];
+	};
+
+	/// Метрики одной попытки выполнения запроса
+	struct Sample {
+		string endpoint;
+		const char *method;
+		long status;
+		bool error;
+		int64_t phases[phCount];
+		uint64_t bytes_sent, bytes_received;
+	};
+
+	/*
+	* @brief Получатель метрик
+	* @detail Вызывается в потоке, выполнившем запрос (для асинхронных запросов - в потоке
+	* ввода-вывода), поэтому не должен блокироваться.
+	*/
+	class Sink {
+	public:
+		virtual ~Sink() {}
+		virtual void Record(const Sample &sample) = 0;
+	};
+
+	/// Включить сбор метрик
+	static void Enable();
+
+	/// Выключить сбор метрик
+	static void Disable();
+
+	/// Установить получатель метрик, nullptr - отключить
+	static void SetSink(std::shared_ptr<Sink> sink);
+
+	/// Текущие значения метрик по всем методам API
+	static std::vector<Endpoint> Snapshot();
+
+	/// Обнулить накопленные метрики
+	static void Reset();
+};
+
+/*
+* @brief Обработчик трассировки запросов
+* @detail Вызывается для каждой попытки выполнения запроса: перед отправкой, при получении
+* первого байта ответа и по завершении. Обработчики вызываются в потоке, выполняющем запрос
+* (для асинхронных запросов - в потоке ввода-вывода), и не должны блокироваться. Исключения
+* обработчиков игнорируются. Пока обработчик не установлен, трассировка не выполняется.
+*/
+class Tracer {
+public:
+	/// Сведения о попытке выполнения запроса
+	struct Call {
+		/// Шаблон метода API, например "scalets/{id}/restart"
+		string endpoint;
+		const char *method;
+		string url;
+		/// Код ответа, 0 до получения ответа
+		long status;
+		/// Длительность фаз запроса в микросекундах, заполняется по завершении
+		int64_t phases[Metrics::phCount];
+		/// Текст ошибки (VSCALE-ERROR-MESSAGE или ошибка соединения), пустой при успехе
+		string error;
+		/// Значение, возвращенное OnStart
+		void *context;
+	};
+
+	virtual ~Tracer() {}
+
+	/*
+	* @brief Начало попытки выполнения запроса
+	* @param [in] call Сведения о запросе
+	* @param [out] header Строка заголовка контекста трассировки (например "traceparent: 00-...")
+	* для добавления к запросу, пустая - не добавлять
+	* @return Контекст, передаваемый в остальные обработчики этой попытки
+	*/
+	virtual void *OnStart(const Call &call, string &header) = 0;
+
+	/// Получен первый байт ответа (строка статуса)
+	virtual void OnFirstByte(const Call &call) {}
+
+	/// Попытка завершена, успешно или с ошибкой
+	virtual void OnComplete(const Call &call) = 0;
+
+	/// Установить обработчик трассировки, nullptr - выключить трассировку
+	static void Set(std::shared_ptr<Tracer> tracer);
+};
+
 /*
 * @brief Базовый класс хранящий данные для выполнения запросов к Vscale
 * @detail Нельзя создавать объекты данного класса. Используется только
 * в наследовании для доступа потомкам к данным для выполнения запросов.
 * В случае завершение запроса с ошибкой, будет сгенерировано исключение типа BadRequest
+* Методы с суффиксом Async не блокируют вызывающий поток: запрос выполняется общим
+* фоновым потоком ввода-вывода, результат возвращается через std::future
+* (ошибка - исключением BadRequest из future::get) и, если передан, через обработчик Completion.
 */
 class VscalePrivateData {
 protected:
 	VscalePrivateData() = delete;
 
 	/*
-	* @brief Конструктор, принимающий адрес для выполнения запроса и токен
+	* @brief Конструктор, принимающий токен для выполнения запроса
 	*/
-	VscalePrivateData(const string &url, const string &token);
+	VscalePrivateData(const string &token);
 
 	struct PrivateData;
 	std::shared_ptr<PrivateData> m_data;
@@ -63,6 +446,9 @@ public:
 	* @endcode
 	*/
 	virtual void Info(JsonValue &response) const;
+
+	/// Асинхронный вариант Info
+	virtual std::future<JsonValue> InfoAsync(Completion done = Completion()) const;
 };
 
 /*
@@ -90,6 +476,23 @@ public:
 	*/
 	virtual void List(JsonValue &response) const;
 
+	/// Асинхронный вариант List
+	virtual std::future<JsonValue> ListAsync(Completion done = Completion()) const;
+
+	/*
+	* @brief Список серверов в виде структур
+	* @param [out] result Список серверов
+	*/
+	virtual void List(std::vector<ScaletInfo> &result) const;
+
+	/*
+	* @brief Потоковое получение списка серверов
+	* @detail Серверы передаются в обработчик по одному по мере получения ответа,
+	* весь список в памяти не хранится
+	* @param [in] handler Обработчик, вызываемый для каждого сервера
+	*/
+	virtual void List(const ElementHandler &handler) const;
+
 	/*
 	* @brief Создать сервер с переданными параметрами
 	* @param [in] params Параметры создаваемого сервера
@@ -97,6 +500,9 @@ public:
 	*/
 	virtual void Create(const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Create
+	virtual std::future<JsonValue> CreateAsync(const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Удалить сервер
 	* @param [in] id Идентификатор сервера
@@ -104,6 +510,9 @@ public:
 	*/
 	virtual void Delete(int id, JsonValue &response) const;
 
+	/// Асинхронный вариант Delete
+	virtual std::future<JsonValue> DeleteAsync(int id, Completion done = Completion()) const;
+
 	/*
 	* @brief Информация о сервере
 	* @param [in] id Идентификатор сервера
@@ -111,6 +520,25 @@ public:
 	*/
 	virtual void Info(int id, JsonValue &response) const;
 
+	/// Асинхронный вариант Info
+	virtual std::future<JsonValue> InfoAsync(int id, Completion done = Completion()) const;
+
+	/*
+	* @brief Информация о сервере в виде структуры
+	* @param [in] id Идентификатор сервера
+	* @param [out] result Информация о сервере
+	*/
+	virtual void Info(int id, ScaletInfo &result) const;
+
+	/*
+	* @brief Информация о нескольких серверах
+	* @detail Запросы выполняются параллельно, одновременно выполняется не более concurrency запросов
+	* @param [in] ids Идентификаторы серверов
+	* @param [in] concurrency Максимальное количество одновременных запросов
+	* @return Результаты в порядке следования идентификаторов
+	*/
+	virtual std::vector<BulkResult<int>> InfoBulk(const std::vector<int> &ids, size_t concurrency) const;
+
 	/*
 	* @brief Перезапуск сервера
 	* @param [in] id Идентификатор сервера
@@ -118,6 +546,19 @@ public:
 	*/
 	virtual void Restart(int id, JsonValue &response) const;
 
+	/// Асинхронный вариант Restart
+	virtual std::future<JsonValue> RestartAsync(int id, Completion done = Completion()) const;
+
+	/*
+	* @brief Перезапуск нескольких серверов
+	* @detail Ошибка одного сервера не прерывает пакет. При wave > 0 выполняется
+	* поочередный перезапуск: в каждый момент перезапускается не более одной волны.
+	* @param [in] ids Идентификаторы серверов
+	* @param [in] options Параллельность, размер волны, ожидание завершения и обработчик хода
+	* @return Результаты в порядке ids
+	*/
+	virtual std::vector<BulkResult<int>> RestartBulk(const std::vector<int> &ids, const BulkOptions &options = BulkOptions()) const;
+
 	/*
 	* @brief Откатить ОС или восстановить из резервной копии
 	* @param [in] id Идентификатор сервера
@@ -126,6 +567,9 @@ public:
 	*/
 	virtual void Rebuild(int id, const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Rebuild
+	virtual std::future<JsonValue> RebuildAsync(int id, const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Выключение сервера
 	* @param [in] id Идентификатор сервера
@@ -133,6 +577,12 @@ public:
 	*/
 	virtual void Stop(int id, JsonValue &response) const;
 
+	/// Асинхронный вариант Stop
+	virtual std::future<JsonValue> StopAsync(int id, Completion done = Completion()) const;
+
+	/// Выключение нескольких серверов, см. RestartBulk
+	virtual std::vector<BulkResult<int>> StopBulk(const std::vector<int> &ids, const BulkOptions &options = BulkOptions()) const;
+
 	/*
 	* @brief Включение сервера
 	* @param [in] id Идентификатор сервера
@@ -140,6 +590,12 @@ public:
 	*/
 	virtual void Start(int id, JsonValue &response) const;
 
+	/// Асинхронный вариант Start
+	virtual std::future<JsonValue> StartAsync(int id, Completion done = Completion()) const;
+
+	/// Включение нескольких серверов, см. RestartBulk
+	virtual std::vector<BulkResult<int>> StartBulk(const std::vector<int> &ids, const BulkOptions &options = BulkOptions()) const;
+
 	/*
 	* @brief Апгрейд конфигурации
 	* @detail Переводит сервер на другой тарифный план (только в сторону увеличения)
@@ -149,18 +605,33 @@ public:
 	*/
 	virtual void Upgrade(int id, const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Upgrade
+	virtual std::future<JsonValue> UpgradeAsync(int id, const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Просмотр информации о статусе текущих операций
 	* @param [out] response Информация о статусе
 	*/
 	virtual void Tasks(JsonValue &response) const;
 
+	/// Асинхронный вариант Tasks
+	virtual std::future<JsonValue> TasksAsync(Completion done = Completion()) const;
+
+	/*
+	* @brief Список текущих операций в виде структур
+	* @param [out] result Список операций
+	*/
+	virtual void Tasks(std::vector<TaskInfo> &result) const;
+
 	/*
 	* @brief Создание резервной копии
 	* @params [in] params данные резервной копии
 	* @param [out] response Информация о статусе
 	*/
 	virtual void Backup(int id, const JsonValue &params, JsonValue &response) const;
+
+	/// Асинхронный вариант Backup
+	virtual std::future<JsonValue> BackupAsync(int id, const JsonValue &params, Completion done = Completion()) const;
 };
 
 /*
@@ -188,6 +659,15 @@ public:
 	*/
 	virtual void List(JsonValue &response) const;
 
+	/// Асинхронный вариант List
+	virtual std::future<JsonValue> ListAsync(Completion done = Completion()) const;
+
+	/*
+	* @brief Список тегов в виде структур
+	* @param [out] result Список тегов
+	*/
+	virtual void List(std::vector<TagInfo> &result) const;
+
 	/*
 	* @brief Создание нового тега
 	* @param [in] params Параметры создаваемого тега
@@ -195,6 +675,9 @@ public:
 	*/
 	virtual void Create(const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Create
+	virtual std::future<JsonValue> CreateAsync(const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Обновление информации о теге
 	* @param [id] id Идентификатор тега
@@ -203,12 +686,18 @@ public:
 	*/
 	virtual void Update(int id, const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Update
+	virtual std::future<JsonValue> UpdateAsync(int id, const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Удаление тега
 	* @param [id] id Идентификатор тега
 	* @param [out] response Информация об удаленном теге
 	*/
 	virtual void Delete(int id, JsonValue &response) const;
+
+	/// Асинхронный вариант Delete
+	virtual std::future<JsonValue> DeleteAsync(int id, Completion done = Completion()) const;
 };
 
 /*
@@ -237,17 +726,38 @@ public:
 	*/
 	virtual void List(JsonValue &response) const;
 
+	/// Асинхронный вариант List
+	virtual std::future<JsonValue> ListAsync(Completion done = Completion()) const;
+
+	/*
+	* @brief Список резервных копий в виде структур
+	* @param [out] result Список резервных копий
+	*/
+	virtual void List(std::vector<BackupInfo> &result) const;
+
 	/*
 	* @brief Удаление резервной копии
 	* @param [out] response Информация о резервной копии
 	*/
 	virtual void Delete(const string &id, JsonValue &response) const;
 
+	/// Асинхронный вариант Delete
+	virtual std::future<JsonValue> DeleteAsync(const string &id, Completion done = Completion()) const;
+
 	/*
 	* @brief Информация о резервной копии
 	* @param [out] response Информация о резервной копии
 	*/
 	virtual void Info(const string &id, JsonValue &response) const;
+
+	/// Асинхронный вариант Info
+	virtual std::future<JsonValue> InfoAsync(const string &id, Completion done = Completion()) const;
+
+	/*
+	* @brief Информация о резервной копии в виде структуры
+	* @param [out] result Информация о резервной копии
+	*/
+	virtual void Info(const string &id, BackupInfo &result) const;
 };
 
 /*
@@ -271,11 +781,17 @@ public:
 	*/
 	virtual void Locations(JsonValue &response) const;
 
+	/// Асинхронный вариант Locations
+	virtual std::future<JsonValue> LocationsAsync(Completion done = Completion()) const;
+
 	/*
 	* @brief Получение списка доступных образов
 	* @param [out] response Список образов
 	*/
 	virtual void Images(JsonValue &response) const;
+
+	/// Асинхронный вариант Images
+	virtual std::future<JsonValue> ImagesAsync(Completion done = Completion()) const;
 };
 
 /*
@@ -299,11 +815,17 @@ public:
 	*/
 	virtual void RPlans(JsonValue &response) const;
 
+	/// Асинхронный вариант RPlans
+	virtual std::future<JsonValue> RPlansAsync(Completion done = Completion()) const;
+
 	/*
 	* @brief Информация о стоимости использования каждой из доступных конфигураций за час и за месяц
 	* @param [out] response
 	*/
 	virtual void BillingPrices(JsonValue &response) const;
+
+	/// Асинхронный вариант BillingPrices
+	virtual std::future<JsonValue> BillingPricesAsync(Completion done = Completion()) const;
 };
 
 /*
@@ -332,6 +854,9 @@ public:
 	*/
 	virtual void List(JsonValue &response) const;
 
+	/// Асинхронный вариант List
+	virtual std::future<JsonValue> ListAsync(Completion done = Completion()) const;
+
 	/*
 	* @brief Добавление нового ключа
 	* @param [in] params Параметры создаваемого ssh-ключа
@@ -339,12 +864,18 @@ public:
 	*/
 	virtual void Create(const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Create
+	virtual std::future<JsonValue> CreateAsync(const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Удаление ключа из клиентской панели
 	* @param [in] Идентификатор ключа
 	* @param [out] response Информация об удаленном ssh-ключе
 	*/
 	virtual void Delete(int id, JsonValue &response) const;
+
+	/// Асинхронный вариант Delete
+	virtual std::future<JsonValue> DeleteAsync(int id, Completion done = Completion()) const;
 };
 
 /*
@@ -368,11 +899,17 @@ public:
 	*/
 	virtual void Update(const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Update
+	virtual std::future<JsonValue> UpdateAsync(const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Просмотр настроек уведомлений об исчерпании баланса
 	* @param [out] response
 	*/
 	virtual void Info(JsonValue &response) const;
+
+	/// Асинхронный вариант Info
+	virtual std::future<JsonValue> InfoAsync(Completion done = Completion()) const;
 };
 
 /*
@@ -395,11 +932,25 @@ public:
 	*/
 	virtual void Balance(JsonValue &response) const;
 
+	/// Асинхронный вариант Balance
+	virtual std::future<JsonValue> BalanceAsync(Completion done = Completion()) const;
+
 	/*
 	* @brief Просмотр информации о пополнении счёта
 	*/
 	virtual void Payments(JsonValue &response) const;
 
+	/// Асинхронный вариант Payments
+	virtual std::future<JsonValue> PaymentsAsync(Completion done = Completion()) const;
+
+	/*
+	* @brief Потоковое получение информации о пополнении счёта
+	* @detail Записи первого массива в ответе передаются в обработчик по одному
+	* по мере получения ответа
+	* @param [in] handler Обработчик, вызываемый для каждой записи
+	*/
+	virtual void Payments(const ElementHandler &handler) const;
+
 	/*
 	* @brief Просмотр информации о списаниях
 	* @param [in] start_date Начальная дата
@@ -412,6 +963,9 @@ public:
 	* #endcode
 	*/
 	virtual void Consumption(const string &start_date, const string &end_date, JsonValue &response) const;
+
+	/// Асинхронный вариант Consumption
+	virtual std::future<JsonValue> ConsumptionAsync(const string &start_date, const string &end_date, Completion done = Completion()) const;
 };
 
 /*
@@ -440,6 +994,9 @@ public:
 	*/
 	virtual void List(JsonValue &) const;
 
+	/// Асинхронный вариант List
+	virtual std::future<JsonValue> ListAsync(Completion done = Completion()) const;
+
 	/*
 	* @brief Создание домена
 	* @param [in] params Параметры создаваемого домена
@@ -447,6 +1004,9 @@ public:
 	*/
 	virtual void Create(const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Create
+	virtual std::future<JsonValue> CreateAsync(const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Изменение информации о домене
 	* @param [in] params Параметры домена
@@ -454,6 +1014,9 @@ public:
 	*/
 	virtual void Update(int id, const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Update
+	virtual std::future<JsonValue> UpdateAsync(int id, const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Удаление домена
 	* @param [in] id Идентификатор домена
@@ -461,12 +1024,18 @@ public:
 	*/
 	virtual void Delete(int id, JsonValue &response) const;
 
+	/// Асинхронный вариант Delete
+	virtual std::future<JsonValue> DeleteAsync(int id, Completion done = Completion()) const;
+
 	/*
 	* @brief Информация о домене
 	* @param [in] id Идентификатор домена
 	* @param [out] response Описание изменённого домена
 	*/
 	virtual void Info(int id, JsonValue &response) const;
+
+	/// Асинхронный вариант Info
+	virtual std::future<JsonValue> InfoAsync(int id, Completion done = Completion()) const;
 };
 
 /*
@@ -496,6 +1065,24 @@ public:
 	*/
 	virtual void List(int domain_id, JsonValue &response) const;
 
+	/// Асинхронный вариант List
+	virtual std::future<JsonValue> ListAsync(int domain_id, Completion done = Completion()) const;
+
+	/*
+	* @brief Список записей домена в виде структур
+	* @param [in] domain_id Идентификатор домена
+	* @param [out] result Список записей
+	*/
+	virtual void List(int domain_id, std::vector<DomainRecordInfo> &result) const;
+
+	/*
+	* @brief Потоковое получение списка записей домена
+	* @detail Записи передаются в обработчик по одной по мере получения ответа
+	* @param [in] domain_id Идентификатор домена
+	* @param [in] handler Обработчик, вызываемый для каждой записи
+	*/
+	virtual void List(int domain_id, const ElementHandler &handler) const;
+
 	/*
 	* @brief Создать ресурсную запись для домена
 	* @params [in] domain_id Идентификатор домена
@@ -504,6 +1091,9 @@ public:
 	*/
 	virtual void Create(int domain_id, const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Create
+	virtual std::future<JsonValue> CreateAsync(int domain_id, const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Обновить ресурсную запись для домена
 	* @params [in] domain_id Идентификатор домена
@@ -513,6 +1103,9 @@ public:
 	*/
 	virtual void Update(int domain_id, int record_id, const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Update
+	virtual std::future<JsonValue> UpdateAsync(int domain_id, int record_id, const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Удалить ресурсную запись домена
 	* @params [in] domain_id Идентификатор домена
@@ -520,6 +1113,9 @@ public:
 	*/
 	virtual void Delete(int domain_id, int record_id) const;
 
+	/// Асинхронный вариант Delete
+	virtual std::future<JsonValue> DeleteAsync(int domain_id, int record_id, Completion done = Completion()) const;
+
 	/*
 	* @brief Получить ресурсную запись
 	* @params [in] domain_id Идентификатор домена
@@ -527,6 +1123,27 @@ public:
 	* @param [out] response Выбранная ресурсная запись
 	*/
 	virtual void Info(int domain_id, int record_id, JsonValue &response) const;
+
+	/// Асинхронный вариант Info
+	virtual std::future<JsonValue> InfoAsync(int domain_id, int record_id, Completion done = Completion()) const;
+
+	/*
+	* @brief Получить ресурсную запись в виде структуры
+	* @params [in] domain_id Идентификатор домена
+	* @params [in] record_id Идентификатор ресурсной записи
+	* @param [out] result Выбранная ресурсная запись
+	*/
+	virtual void Info(int domain_id, int record_id, DomainRecordInfo &result) const;
+
+	/*
+	* @brief Получить несколько ресурсных записей
+	* @detail Запросы выполняются параллельно, одновременно выполняется не более concurrency запросов
+	* @params [in] ids Пары идентификаторов домена и ресурсной записи
+	* @param [in] concurrency Максимальное количество одновременных запросов
+	* @return Результаты в порядке следования идентификаторов
+	*/
+	virtual std::vector<BulkResult<std::pair<int, int>>> InfoBulk(const std::vector<std::pair<int, int>> &ids,
+			size_t concurrency) const;
 };
 
 /*
@@ -555,6 +1172,9 @@ public:
 	*/
 	virtual void List(JsonValue &response) const;
 
+	/// Асинхронный вариант List
+	virtual std::future<JsonValue> ListAsync(Completion done = Completion()) const;
+
 	/*
 	* @brief Создать тег
 	* @param [in] params Параметры создаваемого тега
@@ -562,6 +1182,9 @@ public:
 	*/
 	virtual void Create(const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Create
+	virtual std::future<JsonValue> CreateAsync(const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Обновить тег
 	* @param [id] Идентификатор тега
@@ -570,6 +1193,9 @@ public:
 	*/
 	virtual void Update(int id, const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Update
+	virtual std::future<JsonValue> UpdateAsync(int id, const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Удалить тег
 	* @param [id] Идентификатор тега
@@ -577,12 +1203,18 @@ public:
 	*/
 	virtual void Delete(int id) const;
 
+	/// Асинхронный вариант Delete
+	virtual std::future<JsonValue> DeleteAsync(int id, Completion done = Completion()) const;
+
 	/*
 	* @brief Информация о теге
 	* @param [id] Идентификатор тега
 	* @param [out] response Информация о теге
 	*/
 	virtual void Info(int id, JsonValue &response) const;
+
+	/// Асинхронный вариант Info
+	virtual std::future<JsonValue> InfoAsync(int id, Completion done = Completion()) const;
 };
 
 /*
@@ -611,6 +1243,9 @@ public:
 	*/
 	virtual void List(JsonValue &) const;
 
+	/// Асинхронный вариант List
+	virtual std::future<JsonValue> ListAsync(Completion done = Completion()) const;
+
 	/*
 	* @brief Создать обратную запись
 	* @param [in] params Параметры создаваемой обратной записи
@@ -618,6 +1253,9 @@ public:
 	*/
 	virtual void Create(const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Create
+	virtual std::future<JsonValue> CreateAsync(const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Изменить обратную запись
 	* @param [in] id Идентификатор обратной записи
@@ -626,6 +1264,9 @@ public:
 	*/
 	virtual void Update(int id, const JsonValue &params, JsonValue &response) const;
 
+	/// Асинхронный вариант Update
+	virtual std::future<JsonValue> UpdateAsync(int id, const JsonValue &params, Completion done = Completion()) const;
+
 	/*
 	* @brief Удалить обратную запись
 	* @param [in] id Идентификатор обратной записи
@@ -633,12 +1274,18 @@ public:
 	*/
 	virtual void Delete(int id) const;
 
+	/// Асинхронный вариант Delete
+	virtual std::future<JsonValue> DeleteAsync(int id, Completion done = Completion()) const;
+
 	/*
 	* @brief Информация об обратной записи
 	* @param [in] id Идентификатор обратной записи
 	* @param [out] response Информация об изменённой обратной записи
 	*/
 	virtual void Info(int id, JsonValue &response) const;
+
+	/// Асинхронный вариант Info
+	virtual std::future<JsonValue> InfoAsync(int id, Completion done = Completion()) const;
 };
 
 } // namespace vscale
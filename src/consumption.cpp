@@ -0,0 +1,335 @@
+#include <vscale/consumption.h>
+#include "internal.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <mutex>
+
+#define CONSUMPTION_CACHE_PREFIX 		"consumption-"
+#define CONSUMPTION_CACHE_SUFFIX 		".json"
+#define CONSUMPTION_BAD_DATE_MESSAGE 		"invalid date: "
+#define CONSUMPTION_BAD_RANGE_MESSAGE 		"end date is before start date"
+#define SECONDS_PER_DAY 			86400
+
+namespace vscale {
+
+namespace {
+
+/// Номер дня от 1970-01-01 по дате григорианского календаря
+long DaysFromCivil(int year, unsigned month, unsigned day) {
+	year -= month <= 2;
+	const long era = (year >= 0 ? year : year - 399) / 400;
+	const unsigned year_of_era = (unsigned) (year - era * 400);
+	const unsigned day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	return era * 146097 + (long) day_of_era - 719468;
+}
+
+void CivilFromDays(long days, int &year, unsigned &month, unsigned &day) {
+	days += 719468;
+	const long era = (days >= 0 ? days : days - 146096) / 146097;
+	const unsigned day_of_era = (unsigned) (days - era * 146097);
+	const unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+	const unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+	const unsigned shifted = (5 * day_of_year + 2) / 153;
+	day = day_of_year - (153 * shifted + 2) / 5 + 1;
+	month = shifted < 10 ? shifted + 3 : shifted - 9;
+	year = (int) (year_of_era + era * 400) + (month <= 2);
+}
+
+/// Месяцы нумеруются как год * 12 + (месяц - 1)
+long MonthStart(int month) {
+	return DaysFromCivil(month / 12, (unsigned) (month % 12) + 1, 1);
+}
+
+int MonthOf(long days) {
+	int year;
+	unsigned month, day;
+	CivilFromDays(days, year, month, day);
+	return year * 12 + (int) month - 1;
+}
+
+long ParseDate(const string &date) {
+	int year;
+	unsigned month, day;
+	char tail;
+	if (sscanf(date.c_str(), "%4d-%2u-%2u%c", &year, &month, &day, &tail) != 3 || month < 1 || month > 12 || day < 1)
+		throw BadRequest(CONSUMPTION_BAD_DATE_MESSAGE + date);
+	const long result = DaysFromCivil(year, month, day);
+	if (MonthOf(result) != year * 12 + (int) month - 1)
+		throw BadRequest(CONSUMPTION_BAD_DATE_MESSAGE + date);
+	return result;
+}
+
+string FormatDate(long days) {
+	int year;
+	unsigned month, day;
+	CivilFromDays(days, year, month, day);
+	char buffer[16];
+	snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u", year, month, day);
+	return buffer;
+}
+
+string FormatMonth(int month) {
+	char buffer[16];
+	snprintf(buffer, sizeof(buffer), "%04d-%02d", month / 12, month % 12 + 1);
+	return buffer;
+}
+
+/// Сумма в виде числа, строки или объекта с полем summ
+double Amount(const JsonValue &value) {
+	if (value.isNumeric())
+		return value.asDouble();
+	if (value.isString())
+		return atof(value.asCString());
+	if (value.isObject())
+		return Amount(value["summ"]);
+	return 0;
+}
+
+} // namespace
+
+/*
+* Кеш закрытых месяцев и запросы недостающих. Ответ API - объект, ключи
+* которого - даты, а значения содержат сумму за день (summ) и объект scalets
+* с суммами по идентификаторам серверов.
+*/
+class ConsumptionFetcher::Store {
+public:
+	Store(const string &token, const Options &options)
+			: m_billing(token), m_options(options), m_requests(0), m_memory_hits(0), m_disk_hits(0) {
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) Fnv1a(FNV_OFFSET_BASIS, token.data(), token.size()));
+		m_token_hash = buffer;
+	}
+
+	ConsumptionReport Fetch(const string &start_date, const string &end_date) {
+		const long first = ParseDate(start_date);
+		const long last = ParseDate(end_date);
+		if (last < first)
+			throw BadRequest(CONSUMPTION_BAD_RANGE_MESSAGE);
+
+		ConsumptionReport report;
+		report.start_date = FormatDate(first);
+		report.end_date = FormatDate(last);
+		report.total = 0;
+
+		const long today = (long) (time(nullptr) / SECONDS_PER_DAY);
+		const long until = std::min(last, today);
+		std::vector<Part> parts;
+		for (int month = MonthOf(first); first <= until && MonthStart(month) <= until; ++month) {
+			Part part;
+			part.month = month;
+			part.from = MonthStart(month);
+			part.to = MonthStart(month + 1) - 1;
+			part.closed = part.to + (long) m_options.settle_days < today;
+			if (!part.closed)
+				part.to = std::min(part.to, today);
+			part.cached = part.closed && Cached(month, part.days);
+			parts.push_back(std::move(part));
+		}
+
+		// Ответы разбираются в порядке завершения, чтобы медленный месяц не
+		// задерживал запуск следующих
+		const size_t concurrency = std::max(m_options.concurrency, (size_t) 1);
+		std::shared_ptr<Completed> completed = std::make_shared<Completed>();
+		size_t inflight = 0;
+		for (size_t index = 0; index < parts.size(); ++index) {
+			Part &part = parts[index];
+			if (part.cached)
+				continue;
+			if (inflight >= concurrency) {
+				Collect(parts[completed->Next()]);
+				--inflight;
+			}
+			// API не включает end_date в период, поэтому запрашивается период до
+			// следующего за part.to дня, а дни вне месяца отбрасываются при разборе
+			part.pending = m_billing.ConsumptionAsync(FormatDate(part.from), FormatDate(part.to + 1),
+					[completed, index](const JsonValue &, std::exception_ptr) { completed->Push(index); });
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				++m_requests;
+			}
+			++inflight;
+		}
+		for (; inflight > 0; --inflight)
+			Collect(parts[completed->Next()]);
+
+		const string from = report.start_date;
+		const string to = report.end_date;
+		for (const auto &part : parts) {
+			for (auto it = part.days->lower_bound(from); it != part.days->end() && it->first <= to; ++it) {
+				report.total += it->second.total;
+				report.days[it->first] += it->second.total;
+				for (const auto &scalet : it->second.scalets) {
+					report.scalets[scalet.first] += scalet.second;
+					report.scalet_days[scalet.first][it->first] += scalet.second;
+				}
+			}
+		}
+		return report;
+	}
+
+	Stats GetStats() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Stats stats;
+		stats.requests = m_requests;
+		stats.memory_hits = m_memory_hits;
+		stats.disk_hits = m_disk_hits;
+		stats.cached_months = m_months.size();
+		return stats;
+	}
+
+private:
+	/// Списания за день: сумма и суммы по серверам
+	struct Day {
+		double total;
+		std::map<int, double> scalets;
+
+		Day(): total(0) {}
+	};
+
+	typedef std::map<string, Day> Days;
+
+	struct Part {
+		int month;
+		long from, to;
+		bool closed, cached;
+		std::shared_ptr<const Days> days;
+		std::future<JsonValue> pending;
+	};
+
+	/*
+	* Номера завершенных запросов. Обработчики завершения держат объект,
+	* поэтому он переживает Fetch, прерванный ошибкой.
+	*/
+	struct Completed {
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<size_t> parts;
+
+		void Push(size_t index) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				parts.push_back(index);
+			}
+			cv.notify_one();
+		}
+
+		size_t Next() {
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this] { return !parts.empty(); });
+			const size_t index = parts.front();
+			parts.pop_front();
+			return index;
+		}
+	};
+
+	/// Дни ответа с from по to включительно
+	static Days Parse(const JsonValue &response, long from, long to) {
+		Days days;
+		if (!response.isObject())
+			return days;
+		const string first = FormatDate(from);
+		const string last = FormatDate(to);
+		for (auto it = response.begin(); it != response.end(); ++it) {
+			const JsonValue &value = *it;
+			const string date = it.name().substr(0, 10);
+			if (!value.isObject() || date < first || date > last)
+				continue;
+			Day &day = days[date];
+			double scalets_total = 0;
+			const JsonValue &scalets = value["scalets"];
+			if (scalets.isObject()) {
+				for (auto scalet = scalets.begin(); scalet != scalets.end(); ++scalet) {
+					const double amount = Amount(*scalet);
+					day.scalets[atoi(scalet.name().c_str())] += amount;
+					scalets_total += amount;
+				}
+			}
+			day.total += value.isMember("summ") ? Amount(value["summ"]) : scalets_total;
+		}
+		return days;
+	}
+
+	void Collect(Part &part) {
+		const JsonValue response = part.pending.get();
+		std::shared_ptr<const Days> days = std::make_shared<Days>(Parse(response, part.from, part.to));
+		if (part.closed)
+			Keep(part.month, response, days);
+		part.days = days;
+	}
+
+	string CachePath(int month) const {
+		return m_options.cache_dir + "/" CONSUMPTION_CACHE_PREFIX + m_token_hash + "-" + FormatMonth(month) + CONSUMPTION_CACHE_SUFFIX;
+	}
+
+	bool Cached(int month, std::shared_ptr<const Days> &days) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_months.find(month);
+			if (it != m_months.end()) {
+				days = it->second;
+				++m_memory_hits;
+				return true;
+			}
+		}
+		if (m_options.cache_dir.empty())
+			return false;
+
+		std::ifstream file(CachePath(month), std::ios::binary);
+		if (!file)
+			return false;
+		JsonValue response;
+		string errors;
+		if (!Json::parseFromStream(Json::CharReaderBuilder(), file, &response, &errors))
+			return false;
+		days = std::make_shared<Days>(Parse(response, MonthStart(month), MonthStart(month + 1) - 1));
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_months[month] = days;
+		++m_disk_hits;
+		return true;
+	}
+
+	/// Файловый кеш - оптимизация, поэтому ошибки его записи не прерывают запрос
+	void Keep(int month, const JsonValue &response, const std::shared_ptr<const Days> &days) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_months[month] = days;
+		}
+		if (m_options.cache_dir.empty())
+			return;
+
+		Json::StreamWriterBuilder builder;
+		builder["indentation"] = "";
+		// Одновременная запись того же месяца другим объектом или процессом
+		// идет в свой временный файл и не смешивается с этой
+		WriteFileAtomically(CachePath(month), Json::writeString(builder, response));
+	}
+
+	Billing m_billing;
+	const Options m_options;
+	string m_token_hash;
+	mutable std::mutex m_mutex;
+	std::map<int, std::shared_ptr<const Days>> m_months;
+	uint64_t m_requests, m_memory_hits, m_disk_hits;
+};
+
+ConsumptionFetcher::ConsumptionFetcher(const string &token, const Options &options)
+		: m_store(std::make_shared<Store>(token, options)) {}
+ConsumptionFetcher::~ConsumptionFetcher() {}
+
+ConsumptionReport ConsumptionFetcher::Fetch(const string &start_date, const string &end_date) {
+	return m_store->Fetch(start_date, end_date);
+}
+
+ConsumptionFetcher::Stats ConsumptionFetcher::GetStats() const {
+	return m_store->GetStats();
+}
+
+} // namespace vscale
@@ -0,0 +1,33 @@
+#include "internal.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#define ATOMIC_WRITE_TEMP_SUFFIX 		".XXXXXX"
+
+namespace vscale {
+
+bool WriteFileAtomically(const std::string &path, const std::string &data) {
+	std::string temporary = path + ATOMIC_WRITE_TEMP_SUFFIX;
+	const int fd = mkstemp(&temporary[0]);
+	if (fd < 0)
+		return false;
+	size_t written = 0;
+	while (written < data.size()) {
+		const ssize_t result = write(fd, data.data() + written, data.size() - written);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			break;
+		written += (size_t) result;
+	}
+	const bool synced = written == data.size() && fsync(fd) == 0;
+	if (close(fd) != 0 || !synced || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+} // namespace vscale
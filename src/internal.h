@@ -0,0 +1,35 @@
+#ifndef __VSCALE_INTERNAL_H__
+#define __VSCALE_INTERNAL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define FNV_OFFSET_BASIS 			14695981039346656037ULL
+#define FNV_PRIME 				1099511628211ULL
+
+/*
+* Вспомогательные функции, общие для модулей библиотеки. Заголовок не
+* устанавливается вместе с публичными.
+*/
+namespace vscale {
+
+/// Продолжает хеш FNV-1a hash байтами data
+inline uint64_t Fnv1a(uint64_t hash, const void *data, size_t size) {
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	return hash;
+}
+
+/*
+* @brief Записать файл так, чтобы при сбое оставалось прежнее содержимое
+* @detail Данные записываются во временный файл с уникальным именем рядом с path,
+* сбрасываются на диск и атомарно заменяют path. При ошибке временный файл удаляется.
+* @return true, если файл записан
+*/
+bool WriteFileAtomically(const std::string &path, const std::string &data);
+
+} // namespace vscale
+
+#endif // __VSCALE_INTERNAL_H__
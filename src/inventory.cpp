@@ -0,0 +1,938 @@
+#include <vscale/inventory.h>
+#include "internal.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#define INVENTORY_SNAPSHOT_MAGIC 		"VSINVENT"
+#define INVENTORY_SNAPSHOT_VERSION 		1
+#define INVENTORY_BYTE_ORDER_MARK 		0x01020304u
+
+namespace vscale {
+
+typedef std::chrono::system_clock SystemClock;
+
+namespace {
+
+int Id(const JsonValue &value) {
+	if (value.isIntegral())
+		return value.asInt();
+	if (value.isString())
+		return atoi(value.asCString());
+	return 0;
+}
+
+void ReadKey(const JsonValue &value, int &key) {
+	key = Id(value);
+}
+
+void ReadKey(const JsonValue &value, string &key) {
+	key = value.isNull() || value.isObject() || value.isArray() ? string() : value.asString();
+}
+
+/*
+* Отпечаток объекта JSON (FNV-1a по типам и значениям). По нему обновление
+* определяет, изменился ли объект, не храня его исходный JSON. Члены объектов
+* jsoncpp перебираются в порядке имен, поэтому отпечаток не зависит от порядка
+* полей в ответе.
+*/
+uint64_t Fingerprint(const JsonValue &value, uint64_t hash = FNV_OFFSET_BASIS) {
+	const unsigned char type = (unsigned char) value.type();
+	hash = Fnv1a(hash, &type, 1);
+	switch (value.type()) {
+		case Json::nullValue:
+			break;
+		case Json::intValue: {
+			const Json::LargestInt number = value.asLargestInt();
+			hash = Fnv1a(hash, &number, sizeof(number));
+			break;
+		}
+		case Json::uintValue: {
+			const Json::LargestUInt number = value.asLargestUInt();
+			hash = Fnv1a(hash, &number, sizeof(number));
+			break;
+		}
+		case Json::realValue: {
+			const double number = value.asDouble();
+			hash = Fnv1a(hash, &number, sizeof(number));
+			break;
+		}
+		case Json::booleanValue: {
+			const unsigned char flag = value.asBool() ? 1 : 0;
+			hash = Fnv1a(hash, &flag, 1);
+			break;
+		}
+		case Json::stringValue: {
+			const char *begin = nullptr, *end = nullptr;
+			value.getString(&begin, &end);
+			const uint64_t size = (uint64_t) (end - begin);
+			hash = Fnv1a(Fnv1a(hash, &size, sizeof(size)), begin, end - begin);
+			break;
+		}
+		case Json::arrayValue: {
+			const uint64_t size = value.size();
+			hash = Fnv1a(hash, &size, sizeof(size));
+			for (const JsonValue &item : value)
+				hash = Fingerprint(item, hash);
+			break;
+		}
+		case Json::objectValue: {
+			const uint64_t size = value.size();
+			hash = Fnv1a(hash, &size, sizeof(size));
+			for (JsonValue::const_iterator it = value.begin(); it != value.end(); ++it) {
+				const char *end = nullptr;
+				const char *begin = it.memberName(&end);
+				const uint64_t length = (uint64_t) (end - begin);
+				hash = Fnv1a(Fnv1a(hash, &length, sizeof(length)), begin, end - begin);
+				hash = Fingerprint(*it, hash);
+			}
+			break;
+		}
+	}
+	return hash;
+}
+
+/// Объект зеркала: отпечаток исходного JSON и разобранная структура
+template <typename Info>
+struct Entry {
+	uint64_t fingerprint;
+	Info info;
+	/// Идентификатор родительского объекта (домена для ресурсной записи)
+	int parent;
+};
+
+template <typename Key, typename Info>
+using Table = std::unordered_map<Key, Entry<Info>>;
+
+template <typename Key, typename Id = int>
+using Index = std::unordered_multimap<Key, Id>;
+
+/// Полученный список объектов и идентификатор их родителя
+typedef std::pair<int, JsonValue> List;
+
+template <typename Key, typename Id>
+void Reindex(Index<Key, Id> &index, const Key &key, const Id &id, bool add) {
+	if (add) {
+		index.emplace(key, id);
+		return;
+	}
+	auto range = index.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == id) {
+			index.erase(it);
+			return;
+		}
+	}
+}
+
+/*
+* Запись снимка зеркала. Числа записываются в порядке байтов платформы
+* (в заголовке есть метка порядка байтов), строки - длиной и содержимым.
+*/
+class SnapshotWriter {
+public:
+	void Put(uint32_t value) {
+		m_data.append((const char *) &value, sizeof(value));
+	}
+
+	void Put(uint64_t value) {
+		m_data.append((const char *) &value, sizeof(value));
+	}
+
+	void Put(int value) {
+		Put((uint32_t) value);
+	}
+
+	void Put(bool value) {
+		m_data.push_back(value ? 1 : 0);
+	}
+
+	void Put(double value) {
+		m_data.append((const char *) &value, sizeof(value));
+	}
+
+	void Put(const string &value) {
+		Put((uint32_t) value.size());
+		m_data.append(value);
+	}
+
+	void Put(const InternedString &value) {
+		Put(value.str());
+	}
+
+	void Put(const AddressInfo &address) {
+		Put(address.address);
+		Put(address.netmask);
+		Put(address.gateway);
+	}
+
+	void Put(const ObjectRef &ref) {
+		Put(ref.id);
+		Put(ref.name);
+	}
+
+	template <typename Item>
+	void Put(const std::vector<Item> &items) {
+		Put((uint32_t) items.size());
+		for (const Item &item : items)
+			Put(item);
+	}
+
+	void Put(const ScaletInfo &scalet) {
+		Put(scalet.ctid);
+		Put(scalet.name);
+		Put(scalet.hostname);
+		Put(scalet.made_from);
+		Put(scalet.created);
+		Put(scalet.deleted);
+		Put(scalet.status);
+		Put(scalet.location);
+		Put(scalet.rplan);
+		Put(scalet.locked);
+		Put(scalet.active);
+		Put(scalet.public_address);
+		Put(scalet.private_address);
+		Put(scalet.keys);
+		Put(scalet.tags);
+	}
+
+	void Put(const TagInfo &tag) {
+		Put(tag.id);
+		Put(tag.name);
+		Put(tag.scalets);
+	}
+
+	void Put(const DomainInfo &domain) {
+		Put(domain.id);
+		Put(domain.name);
+		Put(domain.created);
+		Put(domain.changed);
+		Put(domain.tags);
+	}
+
+	void Put(const DomainRecordInfo &record) {
+		Put(record.id);
+		Put(record.ttl);
+		Put(record.priority);
+		Put(record.name);
+		Put(record.content);
+		Put(record.type);
+	}
+
+	void Put(const BackupInfo &backup) {
+		Put(backup.id);
+		Put(backup.name);
+		Put(backup.created);
+		Put(backup.scalet);
+		Put(backup.size);
+		Put(backup.status);
+		Put(backup.location);
+		Put(backup.active);
+	}
+
+	template <typename Key, typename Info>
+	void Put(const Table<Key, Info> &table) {
+		Put((uint32_t) table.size());
+		for (const auto &item : table) {
+			Put(item.first);
+			Put(item.second.parent);
+			Put(item.second.fingerprint);
+			Put(item.second.info);
+		}
+	}
+
+	const string &Data() const {
+		return m_data;
+	}
+
+private:
+	string m_data;
+};
+
+/*
+* Чтение снимка из отображенного в память файла. Любой выход за границы
+* данных переводит читателя в состояние ошибки, и снимок отвергается.
+*/
+class SnapshotReader {
+public:
+	SnapshotReader(const char *data, size_t size): m_pos(data), m_end(data + size), m_ok(true) {}
+
+	bool Ok() const {
+		return m_ok;
+	}
+
+	bool AtEnd() const {
+		return m_pos == m_end;
+	}
+
+	void Get(uint32_t &value) {
+		Raw(&value, sizeof(value));
+	}
+
+	void Get(uint64_t &value) {
+		Raw(&value, sizeof(value));
+	}
+
+	void Get(int &value) {
+		uint32_t raw = 0;
+		Get(raw);
+		value = (int) raw;
+	}
+
+	void Get(bool &value) {
+		char flag = 0;
+		Raw(&flag, 1);
+		value = flag != 0;
+	}
+
+	void Get(double &value) {
+		Raw(&value, sizeof(value));
+	}
+
+	void Get(string &value) {
+		uint32_t size = 0;
+		Get(size);
+		if (!Need(size))
+			return;
+		value.assign(m_pos, size);
+		m_pos += size;
+	}
+
+	void Get(InternedString &value) {
+		string text;
+		Get(text);
+		value = InternedString(text);
+	}
+
+	void Get(AddressInfo &address) {
+		Get(address.address);
+		Get(address.netmask);
+		Get(address.gateway);
+	}
+
+	void Get(ObjectRef &ref) {
+		Get(ref.id);
+		Get(ref.name);
+	}
+
+	template <typename Item>
+	void Get(std::vector<Item> &items) {
+		uint32_t size = 0;
+		Get(size);
+		// Каждый элемент занимает хотя бы один байт
+		if (!Need(size))
+			return;
+		items.resize(size);
+		for (Item &item : items)
+			Get(item);
+	}
+
+	void Get(ScaletInfo &scalet) {
+		Get(scalet.ctid);
+		Get(scalet.name);
+		Get(scalet.hostname);
+		Get(scalet.made_from);
+		Get(scalet.created);
+		Get(scalet.deleted);
+		Get(scalet.status);
+		Get(scalet.location);
+		Get(scalet.rplan);
+		Get(scalet.locked);
+		Get(scalet.active);
+		Get(scalet.public_address);
+		Get(scalet.private_address);
+		Get(scalet.keys);
+		Get(scalet.tags);
+	}
+
+	void Get(TagInfo &tag) {
+		Get(tag.id);
+		Get(tag.name);
+		Get(tag.scalets);
+	}
+
+	void Get(DomainInfo &domain) {
+		Get(domain.id);
+		Get(domain.name);
+		Get(domain.created);
+		Get(domain.changed);
+		Get(domain.tags);
+	}
+
+	void Get(DomainRecordInfo &record) {
+		Get(record.id);
+		Get(record.ttl);
+		Get(record.priority);
+		Get(record.name);
+		Get(record.content);
+		Get(record.type);
+	}
+
+	void Get(BackupInfo &backup) {
+		Get(backup.id);
+		Get(backup.name);
+		Get(backup.created);
+		Get(backup.scalet);
+		Get(backup.size);
+		Get(backup.status);
+		Get(backup.location);
+		Get(backup.active);
+	}
+
+	template <typename Key, typename Info>
+	void Get(Table<Key, Info> &table) {
+		uint32_t size = 0;
+		Get(size);
+		if (!Need(size))
+			return;
+		table.reserve(size);
+		for (uint32_t i = 0; i < size && m_ok; ++i) {
+			Key key;
+			Get(key);
+			Entry<Info> &entry = table[key];
+			Get(entry.parent);
+			Get(entry.fingerprint);
+			Get(entry.info);
+		}
+	}
+
+private:
+	bool Need(size_t size) {
+		if (m_ok && (size_t) (m_end - m_pos) < size)
+			m_ok = false;
+		return m_ok;
+	}
+
+	void Raw(void *value, size_t size) {
+		if (!Need(size))
+			return;
+		memcpy(value, m_pos, size);
+		m_pos += size;
+	}
+
+	const char *m_pos, *m_end;
+	bool m_ok;
+};
+
+/// Файл, отображенный в память только для чтения
+class MappedFile {
+public:
+	explicit MappedFile(const string &path): m_data(nullptr), m_size(0) {
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void *data = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED) {
+				m_data = static_cast<const char *>(data);
+				m_size = (size_t) info.st_size;
+			}
+		}
+		close(fd);
+	}
+
+	~MappedFile() {
+		if (m_data != nullptr)
+			munmap(const_cast<char *>(m_data), m_size);
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	const char *Data() const {
+		return m_data;
+	}
+
+	size_t Size() const {
+		return m_size;
+	}
+
+private:
+	const char *m_data;
+	size_t m_size;
+};
+
+} // namespace
+
+class Inventory::Store {
+public:
+	explicit Store(const string &token)
+			: m_scalet_client(token), m_tag_client(token), m_domain_client(token), m_record_client(token),
+			m_backup_client(token), m_token_hash(Fnv1a(FNV_OFFSET_BASIS, token.data(), token.size())),
+			m_refreshes(0), m_upserts(0), m_removals(0) {}
+
+	void Refresh() {
+		std::lock_guard<std::mutex> refresh(m_refresh_mutex);
+		std::future<JsonValue> scalets = m_scalet_client.ListAsync();
+		std::future<JsonValue> tags = m_tag_client.ListAsync();
+		std::future<JsonValue> backups = m_backup_client.ListAsync();
+		std::future<JsonValue> domains = m_domain_client.ListAsync();
+
+		std::vector<List> domain_list(1, List(0, domains.get()));
+		std::vector<std::pair<int, std::future<JsonValue>>> pending;
+		if (domain_list[0].second.isArray()) {
+			for (const JsonValue &domain : domain_list[0].second) {
+				const int id = Id(domain["id"]);
+				pending.emplace_back(id, m_record_client.ListAsync(id));
+			}
+		}
+		std::vector<List> scalet_list(1, List(0, scalets.get()));
+		std::vector<List> tag_list(1, List(0, tags.get()));
+		std::vector<List> backup_list(1, List(0, backups.get()));
+		std::vector<List> record_lists;
+		record_lists.reserve(pending.size());
+		for (auto &records : pending)
+			record_lists.emplace_back(records.first, records.second.get());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Sync(m_scalets, scalet_list, "ctid", &Store::IndexScalet);
+		Sync(m_tags, tag_list, "id", &Store::IndexTag);
+		Sync(m_domains, domain_list, "id", &Store::IndexDomain);
+		Sync(m_records, record_lists, "id", &Store::IndexRecord);
+		Sync(m_backups, backup_list, "id", &Store::IndexBackup);
+		m_updated = SystemClock::now();
+		++m_refreshes;
+	}
+
+	/*
+	* Снимок: заголовок (сигнатура, версия формата, метка порядка байтов,
+	* отпечаток токена, время последнего обновления) и таблицы зеркала.
+	* Файл записывается во временный с уникальным именем, сбрасывается на диск
+	* и атомарно переименовывается, поэтому при сбое остается прежний снимок.
+	*/
+	void Save(const string &path) const {
+		SnapshotWriter writer;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			writer.Put(string(INVENTORY_SNAPSHOT_MAGIC));
+			writer.Put((uint32_t) INVENTORY_SNAPSHOT_VERSION);
+			writer.Put((uint32_t) INVENTORY_BYTE_ORDER_MARK);
+			writer.Put(m_token_hash);
+			writer.Put((uint64_t) SystemClock::to_time_t(m_updated));
+			writer.Put(m_scalets);
+			writer.Put(m_tags);
+			writer.Put(m_domains);
+			writer.Put(m_records);
+			writer.Put(m_backups);
+		}
+
+		if (!WriteFileAtomically(path, writer.Data()))
+			throw BadRequest("cannot write inventory snapshot " + path);
+	}
+
+	/// Обновление в фоновом потоке, который присоединяется при следующем запуске или в JoinWorkers
+	std::future<void> RefreshAsync(const string &snapshot) {
+		std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+		std::future<void> result = promise->get_future();
+		std::shared_ptr<std::atomic<bool>> finished = std::make_shared<std::atomic<bool>>(false);
+
+		std::lock_guard<std::mutex> lock(m_workers_mutex);
+		for (auto it = m_workers.begin(); it != m_workers.end();) {
+			if (*it->second) {
+				it->first.join();
+				it = m_workers.erase(it);
+			} else {
+				++it;
+			}
+		}
+		m_workers.emplace_back(std::thread([this, promise, snapshot, finished]() {
+			try {
+				Refresh();
+				if (!snapshot.empty())
+					Save(snapshot);
+				promise->set_value();
+			} catch (...) {
+				promise->set_exception(std::current_exception());
+			}
+			*finished = true;
+		}), finished);
+		return result;
+	}
+
+	/// Ждет завершения всех запущенных RefreshAsync
+	void JoinWorkers() {
+		std::vector<Worker> workers;
+		{
+			std::lock_guard<std::mutex> lock(m_workers_mutex);
+			workers.swap(m_workers);
+		}
+		for (auto &worker : workers)
+			worker.first.join();
+	}
+
+	bool Load(const string &path) {
+		MappedFile file(path);
+		if (file.Data() == nullptr)
+			return false;
+
+		SnapshotReader reader(file.Data(), file.Size());
+		string magic;
+		uint32_t version = 0, byte_order = 0;
+		uint64_t token_hash = 0, updated = 0;
+		reader.Get(magic);
+		reader.Get(version);
+		reader.Get(byte_order);
+		reader.Get(token_hash);
+		reader.Get(updated);
+		if (!reader.Ok() || magic != INVENTORY_SNAPSHOT_MAGIC || version != INVENTORY_SNAPSHOT_VERSION
+				|| byte_order != INVENTORY_BYTE_ORDER_MARK || token_hash != m_token_hash)
+			return false;
+
+		Table<int, ScaletInfo> scalets;
+		Table<int, TagInfo> tags;
+		Table<int, DomainInfo> domains;
+		Table<int, DomainRecordInfo> records;
+		Table<string, BackupInfo> backups;
+		reader.Get(scalets);
+		reader.Get(tags);
+		reader.Get(domains);
+		reader.Get(records);
+		reader.Get(backups);
+		if (!reader.Ok() || !reader.AtEnd())
+			return false;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Replace(m_scalets, scalets, &Store::IndexScalet);
+		Replace(m_tags, tags, &Store::IndexTag);
+		Replace(m_domains, domains, &Store::IndexDomain);
+		Replace(m_records, records, &Store::IndexRecord);
+		Replace(m_backups, backups, &Store::IndexBackup);
+		m_updated = SystemClock::from_time_t((time_t) updated);
+		return true;
+	}
+
+	std::chrono::seconds Age() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_updated == SystemClock::time_point())
+			return std::chrono::seconds::max();
+		return std::chrono::duration_cast<std::chrono::seconds>(SystemClock::now() - m_updated);
+	}
+
+	bool ScaletById(int ctid, ScaletInfo &result) const {
+		return Find(m_scalets, ctid, result);
+	}
+
+	std::vector<ScaletInfo> ScaletsByName(const string &name) const {
+		return CollectScalets(m_scalets_by_name, name);
+	}
+
+	std::vector<ScaletInfo> ScaletsByTag(const string &tag, const string *location) const {
+		return CollectScalets(m_scalets_by_tag, tag, location);
+	}
+
+	std::vector<ScaletInfo> ScaletsByLocation(const string &location) const {
+		return CollectScalets(m_scalets_by_location, location);
+	}
+
+	std::vector<ScaletInfo> ScaletsByAddress(const string &address) const {
+		return CollectScalets(m_scalets_by_address, address);
+	}
+
+	bool TagById(int id, TagInfo &result) const {
+		return Find(m_tags, id, result);
+	}
+
+	bool TagByName(const string &name, TagInfo &result) const {
+		return FindFirst(m_tags, m_tags_by_name, name, result);
+	}
+
+	bool DomainById(int id, DomainInfo &result) const {
+		return Find(m_domains, id, result);
+	}
+
+	bool DomainByName(const string &name, DomainInfo &result) const {
+		return FindFirst(m_domains, m_domains_by_name, name, result);
+	}
+
+	std::vector<DomainRecordEntry> RecordsByDomain(int domain_id) const {
+		return CollectRecords(m_records_by_domain, domain_id);
+	}
+
+	std::vector<DomainRecordEntry> RecordsByName(const string &name) const {
+		return CollectRecords(m_records_by_name, name);
+	}
+
+	std::vector<DomainRecordEntry> RecordsByContent(const string &content) const {
+		return CollectRecords(m_records_by_content, content);
+	}
+
+	bool BackupById(const string &id, BackupInfo &result) const {
+		return Find(m_backups, id, result);
+	}
+
+	std::vector<BackupInfo> BackupsByScalet(int ctid) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<BackupInfo> result;
+		auto range = m_backups_by_scalet.equal_range(ctid);
+		for (auto it = range.first; it != range.second; ++it)
+			result.push_back(m_backups.at(it->second).info);
+		return result;
+	}
+
+	Stats GetStats() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return Stats{m_scalets.size(), m_tags.size(), m_domains.size(), m_records.size(), m_backups.size(),
+				m_refreshes, m_upserts, m_removals};
+	}
+
+private:
+	/*
+	* Применяет полученные списки к таблице: объекты с неизменившимся отпечатком
+	* пропускаются, измененные разбираются и переиндексируются заново,
+	* отсутствующие во всех списках удаляются.
+	*/
+	template <typename Key, typename Info>
+	void Sync(Table<Key, Info> &table, const std::vector<List> &lists, const char *field,
+			void (Store::*index)(const Entry<Info> &entry, const Key &key, bool add)) {
+		std::unordered_set<Key> seen;
+		for (const List &list : lists) {
+			if (!list.second.isArray())
+				continue;
+			for (const JsonValue &item : list.second) {
+				if (!item.isObject())
+					continue;
+				Key key;
+				ReadKey(item[field], key);
+				seen.insert(key);
+				const uint64_t fingerprint = Fingerprint(item);
+				auto it = table.find(key);
+				if (it != table.end()) {
+					if (it->second.parent == list.first && it->second.fingerprint == fingerprint)
+						continue;
+					(this->*index)(it->second, key, false);
+				}
+				Entry<Info> &entry = table[key];
+				entry.fingerprint = fingerprint;
+				entry.info = Info::FromJson(item);
+				entry.parent = list.first;
+				(this->*index)(entry, key, true);
+				++m_upserts;
+			}
+		}
+		for (auto it = table.begin(); it != table.end();) {
+			if (seen.count(it->first) != 0) {
+				++it;
+				continue;
+			}
+			(this->*index)(it->second, it->first, false);
+			it = table.erase(it);
+			++m_removals;
+		}
+	}
+
+	/// Заменяет таблицу загруженной из снимка и перестраивает ее индексы
+	template <typename Key, typename Info>
+	void Replace(Table<Key, Info> &table, Table<Key, Info> &loaded,
+			void (Store::*index)(const Entry<Info> &entry, const Key &key, bool add)) {
+		for (const auto &item : table)
+			(this->*index)(item.second, item.first, false);
+		table.swap(loaded);
+		for (const auto &item : table)
+			(this->*index)(item.second, item.first, true);
+	}
+
+	void IndexScalet(const Entry<ScaletInfo> &entry, const int &id, bool add) {
+		const ScaletInfo &scalet = entry.info;
+		Reindex(m_scalets_by_name, scalet.name, id, add);
+		Reindex(m_scalets_by_location, scalet.location.str(), id, add);
+		if (!scalet.public_address.address.empty())
+			Reindex(m_scalets_by_address, scalet.public_address.address, id, add);
+	}
+
+	/*
+	* Серверы тега индексируются по списку тегов, а не по ScaletInfo::tags:
+	* в списке серверов теги могут быть ссылками без имени (только id).
+	* Индекс может ссылаться на серверы, которых еще нет в зеркале.
+	*/
+	void IndexTag(const Entry<TagInfo> &entry, const int &id, bool add) {
+		Reindex(m_tags_by_name, entry.info.name, id, add);
+		for (int ctid : entry.info.scalets)
+			Reindex(m_scalets_by_tag, entry.info.name, ctid, add);
+	}
+
+	void IndexDomain(const Entry<DomainInfo> &entry, const int &id, bool add) {
+		Reindex(m_domains_by_name, entry.info.name, id, add);
+	}
+
+	void IndexRecord(const Entry<DomainRecordInfo> &entry, const int &id, bool add) {
+		Reindex(m_records_by_domain, entry.parent, id, add);
+		Reindex(m_records_by_name, entry.info.name, id, add);
+		Reindex(m_records_by_content, entry.info.content, id, add);
+	}
+
+	void IndexBackup(const Entry<BackupInfo> &entry, const string &id, bool add) {
+		Reindex(m_backups_by_scalet, entry.info.scalet, id, add);
+	}
+
+	template <typename Key, typename Info>
+	bool Find(const Table<Key, Info> &table, const Key &key, Info &result) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = table.find(key);
+		if (it == table.end())
+			return false;
+		result = it->second.info;
+		return true;
+	}
+
+	template <typename Info>
+	bool FindFirst(const Table<int, Info> &table, const Index<string> &index, const string &key, Info &result) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = index.find(key);
+		if (it == index.end())
+			return false;
+		result = table.at(it->second).info;
+		return true;
+	}
+
+	std::vector<ScaletInfo> CollectScalets(const Index<string> &index, const string &key, const string *location = nullptr) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<ScaletInfo> result;
+		auto range = index.equal_range(key);
+		for (auto it = range.first; it != range.second; ++it) {
+			auto scalet = m_scalets.find(it->second);
+			if (scalet == m_scalets.end())
+				continue;
+			if (location == nullptr || scalet->second.info.location.str() == *location)
+				result.push_back(scalet->second.info);
+		}
+		return result;
+	}
+
+	template <typename Key>
+	std::vector<DomainRecordEntry> CollectRecords(const Index<Key> &index, const Key &key) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<DomainRecordEntry> result;
+		auto range = index.equal_range(key);
+		for (auto it = range.first; it != range.second; ++it) {
+			const Entry<DomainRecordInfo> &entry = m_records.at(it->second);
+			result.push_back(DomainRecordEntry{entry.parent, entry.info});
+		}
+		return result;
+	}
+
+	typedef std::pair<std::thread, std::shared_ptr<std::atomic<bool>>> Worker;
+
+	Scalets m_scalet_client;
+	ServerTags m_tag_client;
+	Domain m_domain_client;
+	DomainRecord m_record_client;
+	Backup m_backup_client;
+	const uint64_t m_token_hash;
+
+	mutable std::mutex m_mutex;
+	std::mutex m_refresh_mutex;
+	std::mutex m_workers_mutex;
+	std::vector<Worker> m_workers;
+	Table<int, ScaletInfo> m_scalets;
+	Table<int, TagInfo> m_tags;
+	Table<int, DomainInfo> m_domains;
+	Table<int, DomainRecordInfo> m_records;
+	Table<string, BackupInfo> m_backups;
+	Index<string> m_scalets_by_name, m_scalets_by_tag, m_scalets_by_location, m_scalets_by_address;
+	Index<string> m_tags_by_name, m_domains_by_name, m_records_by_name, m_records_by_content;
+	Index<int> m_records_by_domain;
+	Index<int, string> m_backups_by_scalet;
+	SystemClock::time_point m_updated;
+	uint64_t m_refreshes, m_upserts, m_removals;
+};
+
+Inventory::Inventory(const string &token): m_store(std::make_shared<Store>(token)) {}
+Inventory::~Inventory() {
+	m_store->JoinWorkers();
+}
+
+void Inventory::Refresh() {
+	m_store->Refresh();
+}
+
+std::future<void> Inventory::RefreshAsync(const string &snapshot) {
+	return m_store->RefreshAsync(snapshot);
+}
+
+void Inventory::Save(const string &path) const {
+	m_store->Save(path);
+}
+
+bool Inventory::Load(const string &path) {
+	return m_store->Load(path);
+}
+
+std::chrono::seconds Inventory::Age() const {
+	return m_store->Age();
+}
+
+bool Inventory::ScaletById(int ctid, ScaletInfo &result) const {
+	return m_store->ScaletById(ctid, result);
+}
+
+std::vector<ScaletInfo> Inventory::ScaletsByName(const string &name) const {
+	return m_store->ScaletsByName(name);
+}
+
+std::vector<ScaletInfo> Inventory::ScaletsByTag(const string &tag) const {
+	return m_store->ScaletsByTag(tag, nullptr);
+}
+
+std::vector<ScaletInfo> Inventory::ScaletsByLocation(const string &location) const {
+	return m_store->ScaletsByLocation(location);
+}
+
+std::vector<ScaletInfo> Inventory::ScaletsByTag(const string &tag, const string &location) const {
+	return m_store->ScaletsByTag(tag, &location);
+}
+
+std::vector<ScaletInfo> Inventory::ScaletsByAddress(const string &address) const {
+	return m_store->ScaletsByAddress(address);
+}
+
+bool Inventory::TagById(int id, TagInfo &result) const {
+	return m_store->TagById(id, result);
+}
+
+bool Inventory::TagByName(const string &name, TagInfo &result) const {
+	return m_store->TagByName(name, result);
+}
+
+bool Inventory::DomainById(int id, DomainInfo &result) const {
+	return m_store->DomainById(id, result);
+}
+
+bool Inventory::DomainByName(const string &name, DomainInfo &result) const {
+	return m_store->DomainByName(name, result);
+}
+
+std::vector<DomainRecordEntry> Inventory::RecordsByDomain(int domain_id) const {
+	return m_store->RecordsByDomain(domain_id);
+}
+
+std::vector<DomainRecordEntry> Inventory::RecordsByName(const string &name) const {
+	return m_store->RecordsByName(name);
+}
+
+std::vector<DomainRecordEntry> Inventory::RecordsByContent(const string &content) const {
+	return m_store->RecordsByContent(content);
+}
+
+bool Inventory::BackupById(const string &id, BackupInfo &result) const {
+	return m_store->BackupById(id, result);
+}
+
+std::vector<BackupInfo> Inventory::BackupsByScalet(int ctid) const {
+	return m_store->BackupsByScalet(ctid);
+}
+
+Inventory::Stats Inventory::GetStats() const {
+	return m_store->GetStats();
+}
+
+} // namespace vscale
@@ -0,0 +1,160 @@
+#include <vscale/model.h>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_set>
+
+namespace vscale {
+
+namespace {
+
+const string *Intern(const string &value) {
+	static std::mutex mutex;
+	static std::unordered_set<string> strings;
+	std::lock_guard<std::mutex> lock(mutex);
+	return &*strings.insert(value).first;
+}
+
+int Int(const JsonValue &value) {
+	if (value.isIntegral())
+		return value.asInt();
+	if (value.isDouble())
+		return (int) value.asDouble();
+	if (value.isString())
+		return atoi(value.asCString());
+	return 0;
+}
+
+double Double(const JsonValue &value) {
+	if (value.isNumeric())
+		return value.asDouble();
+	if (value.isString())
+		return atof(value.asCString());
+	return 0;
+}
+
+bool Bool(const JsonValue &value) {
+	if (value.isBool())
+		return value.asBool();
+	if (value.isNumeric())
+		return value.asDouble() != 0;
+	return false;
+}
+
+string String(const JsonValue &value) {
+	if (value.isString())
+		return value.asString();
+	if (value.isNull() || value.isObject() || value.isArray())
+		return string();
+	return value.asString();
+}
+
+AddressInfo Address(const JsonValue &value) {
+	AddressInfo address;
+	address.address = String(value["address"]);
+	address.netmask = String(value["netmask"]);
+	address.gateway = String(value["gateway"]);
+	return address;
+}
+
+std::vector<ObjectRef> Refs(const JsonValue &value) {
+	std::vector<ObjectRef> refs;
+	if (!value.isArray())
+		return refs;
+	refs.reserve(value.size());
+	for (const JsonValue &item : value) {
+		ObjectRef ref;
+		ref.id = item.isObject() ? Int(item["id"]) : Int(item);
+		ref.name = item.isObject() ? String(item["name"]) : string();
+		refs.push_back(ref);
+	}
+	return refs;
+}
+
+} // namespace
+
+InternedString::InternedString(): m_value(Intern(string())) {}
+
+InternedString::InternedString(const string &value): m_value(Intern(value)) {}
+
+ScaletInfo ScaletInfo::FromJson(const JsonValue &value) {
+	ScaletInfo scalet;
+	scalet.ctid = Int(value["ctid"]);
+	scalet.name = String(value["name"]);
+	scalet.hostname = String(value["hostname"]);
+	scalet.made_from = String(value["made_from"]);
+	scalet.created = String(value["created"]);
+	scalet.deleted = String(value["deleted"]);
+	scalet.status = InternedString(String(value["status"]));
+	scalet.location = InternedString(String(value["location"]));
+	scalet.rplan = InternedString(String(value["rplan"]));
+	scalet.locked = Bool(value["locked"]);
+	scalet.active = Bool(value["active"]);
+	scalet.public_address = Address(value["public_address"]);
+	scalet.private_address = Address(value["private_address"]);
+	scalet.keys = Refs(value["keys"]);
+	scalet.tags = Refs(value["tags"]);
+	return scalet;
+}
+
+TagInfo TagInfo::FromJson(const JsonValue &value) {
+	TagInfo tag;
+	tag.id = Int(value["id"]);
+	tag.name = String(value["name"]);
+	const JsonValue &scalets = value["scalets"];
+	if (scalets.isArray()) {
+		tag.scalets.reserve(scalets.size());
+		for (const JsonValue &item : scalets)
+			tag.scalets.push_back(item.isObject() ? Int(item["ctid"]) : Int(item));
+	}
+	return tag;
+}
+
+DomainInfo DomainInfo::FromJson(const JsonValue &value) {
+	DomainInfo domain;
+	domain.id = Int(value["id"]);
+	domain.name = String(value["name"]);
+	domain.created = String(value["create_date"]);
+	domain.changed = String(value["change_date"]);
+	domain.tags = Refs(value["tags"]);
+	return domain;
+}
+
+DomainRecordInfo DomainRecordInfo::FromJson(const JsonValue &value) {
+	DomainRecordInfo record;
+	record.id = Int(value["id"]);
+	record.ttl = Int(value["ttl"]);
+	record.priority = Int(value["priority"]);
+	record.name = String(value["name"]);
+	record.content = String(value["content"]);
+	record.type = InternedString(String(value["type"]));
+	return record;
+}
+
+BackupInfo BackupInfo::FromJson(const JsonValue &value) {
+	BackupInfo backup;
+	backup.id = String(value["id"]);
+	backup.name = String(value["name"]);
+	backup.created = String(value["created"]);
+	backup.scalet = Int(value["scalet"]);
+	backup.size = Double(value["size"]);
+	backup.status = InternedString(String(value["status"]));
+	backup.location = InternedString(String(value["location"]));
+	backup.active = Bool(value["active"]);
+	return backup;
+}
+
+TaskInfo TaskInfo::FromJson(const JsonValue &value) {
+	TaskInfo task;
+	task.id = String(value["id"]);
+	task.insert_date = String(value["d_insert"]);
+	task.started_date = String(value["d_start"]);
+	task.done_date = String(value["d_end"]);
+	task.scalet = Int(value["scalet"]);
+	task.method = InternedString(String(value["method"]));
+	task.location = InternedString(String(value["location"]));
+	task.done = Bool(value["done"]);
+	task.error = Bool(value["error"]);
+	return task;
+}
+
+} // namespace vscale
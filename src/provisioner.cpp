@@ -0,0 +1,498 @@
+#include <vscale/provisioner.h>
+#include <vscale/task_watcher.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+#define PROVISION_DEFAULT_CONCURRENCY 		8
+#define PROVISION_DEFAULT_WAIT_CONCURRENCY 	256
+#define PROVISION_RECORD_TYPE 			"A"
+#define PROVISION_NO_CTID_MESSAGE 		"create response has no ctid"
+#define PROVISION_NO_ADDRESS_MESSAGE 		"scalet has no public address"
+#define PROVISION_UNKNOWN_TAG_MESSAGE 		"unknown tag"
+#define PROVISION_TASK_FAILED_MESSAGE 		"scalet operation failed"
+
+namespace vscale {
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+double Milliseconds(Clock::duration duration) {
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+string ErrorMessage(std::exception_ptr error) {
+	try {
+		std::rethrow_exception(error);
+	} catch (const std::exception &e) {
+		return e.what();
+	} catch (...) {
+		return "unknown error";
+	}
+}
+
+} // namespace
+
+Provisioner::Options::Options() {
+	std::fill(concurrency, concurrency + psCount, (size_t) PROVISION_DEFAULT_CONCURRENCY);
+	concurrency[psWait] = PROVISION_DEFAULT_WAIT_CONCURRENCY;
+}
+
+/*
+* Клиенты API, общий цикл опроса операций и счетчики этапов. Счетчики
+* переживают отдельные запуски конвейера.
+*/
+class Provisioner::Store {
+public:
+	Store(const string &token, const Options &options)
+			: options(options), scalets(token), tags(token), ptr(token), records(token), keys(token), watcher(token) {
+		for (auto &counter : m_counters)
+			counter = Counter();
+	}
+
+	Clock::time_point Begin(Stage stage) {
+		const Clock::time_point now = Clock::now();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Counter &counter = m_counters[stage];
+		++counter.started;
+		if (counter.inflight++ == 0)
+			counter.busy_since = now;
+		return now;
+	}
+
+	void End(Stage stage, Clock::time_point begin, bool success) {
+		const Clock::time_point now = Clock::now();
+		const double latency = Milliseconds(now - begin);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Counter &counter = m_counters[stage];
+		if (success)
+			++counter.succeeded;
+		else
+			++counter.failed;
+		counter.total_ms += latency;
+		counter.max_ms = std::max(counter.max_ms, latency);
+		if (--counter.inflight == 0)
+			counter.busy_ms += Milliseconds(now - counter.busy_since);
+	}
+
+	StageStats Stats(Stage stage) const {
+		const Clock::time_point now = Clock::now();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const Counter &counter = m_counters[stage];
+		StageStats stats;
+		stats.started = counter.started;
+		stats.succeeded = counter.succeeded;
+		stats.failed = counter.failed;
+		const uint64_t finished = counter.succeeded + counter.failed;
+		stats.mean_latency_ms = finished != 0 ? counter.total_ms / finished : 0;
+		stats.max_latency_ms = counter.max_ms;
+		double busy_ms = counter.busy_ms;
+		if (counter.inflight != 0)
+			busy_ms += Milliseconds(now - counter.busy_since);
+		stats.busy_seconds = busy_ms / 1000;
+		stats.throughput = busy_ms > 0 ? counter.succeeded / stats.busy_seconds : 0;
+		return stats;
+	}
+
+	/*
+	* Регистрирует ключи из options.keys и возвращает их идентификаторы.
+	* Ключи, уже загруженные с тем же содержимым, повторно не создаются.
+	*/
+	std::vector<int> RegisterKeys() {
+		std::vector<int> ids;
+		if (options.keys.empty())
+			return ids;
+
+		Clock::time_point begin = Begin(psKeys);
+		JsonValue existing;
+		try {
+			keys.List(existing);
+		} catch (...) {
+			End(psKeys, begin, false);
+			throw;
+		}
+		End(psKeys, begin, true);
+
+		std::unordered_map<string, int> known;
+		if (existing.isArray()) {
+			for (const JsonValue &key : existing)
+				known[key["key"].asString()] = key["id"].asInt();
+		}
+
+		std::vector<std::pair<Clock::time_point, std::future<JsonValue>>> pending;
+		for (const JsonValue &key : options.keys) {
+			auto it = known.find(key["key"].asString());
+			if (it != known.end()) {
+				ids.push_back(it->second);
+				continue;
+			}
+			begin = Begin(psKeys);
+			pending.emplace_back(begin, keys.CreateAsync(key));
+		}
+
+		std::exception_ptr error;
+		for (auto &created : pending) {
+			try {
+				ids.push_back(created.second.get()["id"].asInt());
+				End(psKeys, created.first, true);
+			} catch (...) {
+				End(psKeys, created.first, false);
+				error = std::current_exception();
+			}
+		}
+		if (error)
+			std::rethrow_exception(error);
+		return ids;
+	}
+
+	const Options options;
+	Scalets scalets;
+	ServerTags tags;
+	PTRRecords ptr;
+	DomainRecord records;
+	SSHKeys keys;
+	TaskWatcher watcher;
+
+private:
+	struct Counter {
+		uint64_t started, succeeded, failed;
+		double total_ms, max_ms, busy_ms;
+		size_t inflight;
+		Clock::time_point busy_since;
+
+		Counter(): started(0), succeeded(0), failed(0), total_ms(0), max_ms(0), busy_ms(0), inflight(0) {}
+	};
+
+	mutable std::mutex m_mutex;
+	Counter m_counters[psCount];
+};
+
+/*
+* Один запуск конвейера. Каждый этап - очередь серверов и счетчик выполняемых
+* операций; завершение операции переводит сервер в очередь следующего этапа и
+* запускает ожидающих в очереди текущего. Завершения вызываются в фоновых потоках,
+* поэтому объект живет, пока на него ссылается хотя бы один обработчик.
+*
+* Store обработчикам не принадлежит: иначе последний обработчик мог бы уничтожить
+* TaskWatcher в его же потоке опроса. Store принадлежит Provisioner, который живет
+* до возврата из Run, а обработчики обращаются к нему только до завершения сервера,
+* поэтому после последнего Finish используются лишь собственные поля конвейера.
+*/
+class Provisioner::Pipeline : public std::enable_shared_from_this<Pipeline> {
+public:
+	Pipeline(Store *store, const std::vector<Node> &nodes)
+			: m_store(store), m_nodes(nodes), m_results(nodes.size()), m_remaining(nodes.size()) {
+		std::fill(m_inflight, m_inflight + psCount, (size_t) 0);
+		for (int stage = 0; stage < psCount; ++stage)
+			m_limits[stage] = std::max(store->options.concurrency[stage], (size_t) 1);
+		for (auto &result : m_results) {
+			result.ctid = 0;
+			result.success = false;
+			result.stage = psCreate;
+		}
+	}
+
+	/// Идентификаторы ключей добавляются к ключам в параметрах каждого сервера
+	void AddKeys(const std::vector<int> &keys) {
+		for (auto &node : m_nodes) {
+			for (int id : keys)
+				node.params["keys"].append(id);
+		}
+	}
+
+	/// Текущие списки серверов тегов, в которые добавляются серверы
+	void LoadTags() {
+		bool required = false;
+		for (const auto &node : m_nodes)
+			required = required || !node.tags.empty();
+		if (!required)
+			return;
+
+		JsonValue list;
+		m_store->tags.List(list);
+		if (!list.isArray())
+			return;
+		for (const JsonValue &item : list) {
+			const TagInfo info = TagInfo::FromJson(item);
+			Tag &tag = m_tags[info.id];
+			tag.name = info.name;
+			tag.scalets.insert(info.scalets.begin(), info.scalets.end());
+		}
+	}
+
+	std::vector<Result> Run() {
+		for (size_t i = 0; i < m_nodes.size(); ++i)
+			Enter(i, psCreate);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_finished.wait(lock, [this] { return m_remaining == 0; });
+		return m_results;
+	}
+
+private:
+	struct Tag {
+		string name;
+		std::set<int> scalets;
+		bool busy;
+		std::vector<size_t> waiting;
+
+		Tag(): busy(false) {}
+	};
+
+	bool Applicable(size_t index, int stage) const {
+		const Node &node = m_nodes[index];
+		switch (stage) {
+			case psTag:
+				return !node.tags.empty();
+			case psPTR:
+				return !node.ptr.empty();
+			case psRecord:
+				return node.domain_id != 0;
+			default:
+				return true;
+		}
+	}
+
+	void Enter(size_t index, int stage) {
+		while (stage < psCount && !Applicable(index, stage))
+			++stage;
+		if (stage == psCount) {
+			Finish(index, true);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_queues[stage].push_back(index);
+		}
+		Pump((Stage) stage);
+	}
+
+	void Pump(Stage stage) {
+		std::vector<size_t> ready;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			while (m_inflight[stage] < m_limits[stage] && !m_queues[stage].empty()) {
+				ready.push_back(m_queues[stage].front());
+				m_queues[stage].pop_front();
+				++m_inflight[stage];
+			}
+		}
+		for (size_t index : ready)
+			Launch(index, stage, m_store->Begin(stage));
+	}
+
+	void Launch(size_t index, Stage stage, Clock::time_point begin) {
+		std::shared_ptr<Pipeline> self = shared_from_this();
+		const Node &node = m_nodes[index];
+		Result &result = m_results[index];
+
+		switch (stage) {
+			case psCreate:
+				m_store->scalets.CreateAsync(node.params, [self, index, begin](const JsonValue &response, std::exception_ptr error) {
+					if (!error) {
+						self->m_results[index].ctid = response["ctid"].asInt();
+						if (self->m_results[index].ctid == 0)
+							error = std::make_exception_ptr(BadRequest(PROVISION_NO_CTID_MESSAGE));
+					}
+					self->Complete(index, psCreate, begin, error);
+				});
+				break;
+
+			case psWait:
+				m_store->watcher.WaitScalet(result.ctid, [self, index, begin](const TaskInfo &task, std::exception_ptr error) {
+					if (!error && task.error)
+						error = std::make_exception_ptr(BadRequest(PROVISION_TASK_FAILED_MESSAGE));
+					if (error) {
+						self->Complete(index, psWait, begin, error);
+						return;
+					}
+					self->m_store->scalets.InfoAsync(self->m_results[index].ctid,
+							[self, index, begin](const JsonValue &response, std::exception_ptr error) {
+						if (!error)
+							self->m_results[index].address = response["public_address"]["address"].asString();
+						self->Complete(index, psWait, begin, error);
+					});
+				});
+				break;
+
+			case psTag:
+				AddToTags(index, begin);
+				break;
+
+			case psPTR:
+			case psRecord: {
+				if (result.address.empty()) {
+					Complete(index, stage, begin, std::make_exception_ptr(BadRequest(PROVISION_NO_ADDRESS_MESSAGE)));
+					break;
+				}
+				JsonValue params;
+				params["content"] = stage == psPTR ? node.ptr : result.address;
+				Completion done = [self, index, stage, begin](const JsonValue &, std::exception_ptr error) {
+					self->Complete(index, stage, begin, error);
+				};
+				if (stage == psPTR) {
+					params["ip"] = result.address;
+					m_store->ptr.CreateAsync(params, done);
+				} else {
+					params["name"] = node.record_name;
+					params["type"] = PROVISION_RECORD_TYPE;
+					params["ttl"] = node.ttl;
+					m_store->records.CreateAsync(node.domain_id, params, done);
+				}
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+
+	/*
+	* Сервер ставится в очередь каждого своего тега. Этап завершается, когда
+	* сервер попал в успешное обновление всех тегов или одно из них не удалось.
+	*/
+	void AddToTags(size_t index, Clock::time_point begin) {
+		std::vector<int> flush;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tag_begin[index] = begin;
+			m_tags_left[index] = m_nodes[index].tags.size();
+			for (int id : m_nodes[index].tags) {
+				auto it = m_tags.find(id);
+				if (it == m_tags.end()) {
+					m_tag_errors[index] = std::make_exception_ptr(BadRequest(PROVISION_UNKNOWN_TAG_MESSAGE));
+					--m_tags_left[index];
+					continue;
+				}
+				it->second.waiting.push_back(index);
+				if (!it->second.busy) {
+					it->second.busy = true;
+					flush.push_back(id);
+				}
+			}
+		}
+		for (int id : flush)
+			FlushTag(id);
+		FinishTags(std::vector<size_t>(1, index));
+	}
+
+	/// Одно обновление тега для всех ожидающих серверов
+	void FlushTag(int id) {
+		std::vector<size_t> batch;
+		JsonValue params;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			Tag &tag = m_tags[id];
+			batch.swap(tag.waiting);
+			if (batch.empty()) {
+				tag.busy = false;
+				return;
+			}
+			params["name"] = tag.name;
+			JsonValue &scalets = params["scalets"] = JsonValue(Json::arrayValue);
+			for (int ctid : tag.scalets)
+				scalets.append(ctid);
+			for (size_t index : batch)
+				scalets.append(m_results[index].ctid);
+		}
+
+		std::shared_ptr<Pipeline> self = shared_from_this();
+		m_store->tags.UpdateAsync(id, params, [self, id, batch](const JsonValue &, std::exception_ptr error) {
+			{
+				std::lock_guard<std::mutex> lock(self->m_mutex);
+				Tag &tag = self->m_tags[id];
+				for (size_t index : batch) {
+					if (error)
+						self->m_tag_errors[index] = error;
+					else
+						tag.scalets.insert(self->m_results[index].ctid);
+					--self->m_tags_left[index];
+				}
+			}
+			self->FinishTags(batch);
+			self->FlushTag(id);
+		});
+	}
+
+	/// Завершает этап тегов для серверов, у которых не осталось необновленных тегов
+	void FinishTags(const std::vector<size_t> &candidates) {
+		for (size_t index : candidates) {
+			Clock::time_point begin;
+			std::exception_ptr error;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto left = m_tags_left.find(index);
+				if (left == m_tags_left.end() || left->second != 0)
+					continue;
+				m_tags_left.erase(left);
+				begin = m_tag_begin[index];
+				m_tag_begin.erase(index);
+				auto it = m_tag_errors.find(index);
+				if (it != m_tag_errors.end()) {
+					error = it->second;
+					m_tag_errors.erase(it);
+				}
+			}
+			Complete(index, psTag, begin, error);
+		}
+	}
+
+	void Complete(size_t index, Stage stage, Clock::time_point begin, std::exception_ptr error) {
+		m_store->End(stage, begin, !error);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_inflight[stage];
+		}
+		if (error) {
+			m_results[index].stage = stage;
+			m_results[index].error = ErrorMessage(error);
+			Finish(index, false);
+		} else {
+			Enter(index, stage + 1);
+		}
+		Pump(stage);
+	}
+
+	void Finish(size_t index, bool success) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_results[index].success = success;
+		if (success)
+			m_results[index].stage = psCount;
+		if (--m_remaining == 0)
+			m_finished.notify_all();
+	}
+
+	Store *const m_store;
+	size_t m_limits[psCount];
+	std::vector<Node> m_nodes;
+	std::vector<Result> m_results;
+	std::mutex m_mutex;
+	std::condition_variable m_finished;
+	size_t m_remaining;
+	std::deque<size_t> m_queues[psCount];
+	size_t m_inflight[psCount];
+	std::unordered_map<int, Tag> m_tags;
+	std::unordered_map<size_t, size_t> m_tags_left;
+	std::unordered_map<size_t, std::exception_ptr> m_tag_errors;
+	std::unordered_map<size_t, Clock::time_point> m_tag_begin;
+};
+
+Provisioner::Provisioner(const string &token, const Options &options): m_store(std::make_shared<Store>(token, options)) {}
+Provisioner::~Provisioner() {}
+
+std::vector<Provisioner::Result> Provisioner::Run(const std::vector<Node> &nodes) {
+	std::shared_ptr<Pipeline> pipeline = std::make_shared<Pipeline>(m_store.get(), nodes);
+	pipeline->AddKeys(m_store->RegisterKeys());
+	pipeline->LoadTags();
+	return pipeline->Run();
+}
+
+Provisioner::StageStats Provisioner::GetStats(Stage stage) const {
+	return m_store->Stats(stage);
+}
+
+} // namespace vscale
@@ -0,0 +1,339 @@
+#include <vscale/task_watcher.h>
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#define TASK_WATCH_MIN_INTERVAL_MS 		1000
+#define TASK_WATCH_MAX_INTERVAL_MS 		30000
+#define TASK_WATCH_GRACE_POLLS 			2
+#define TASK_WATCH_MAX_FAILURES 		5
+#define TASK_WATCH_DURATION_WEIGHT 		0.3
+#define TASK_WATCHER_STOPPED 			"task watcher stopped"
+#define TASK_WATCH_NOT_FOUND 			"task not found in the task list"
+
+namespace vscale {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::milliseconds Milliseconds;
+
+namespace {
+
+/*
+* Общий цикл опроса списка операций для одного токена. Поток опроса спит,
+* пока нет ожидающих, и просыпается при добавлении нового ожидающего.
+* Поток владеет циклом наравне с TaskWatcher::Poller: последний TaskWatcher
+* может быть уничтожен из обработчика, выполняющегося в самом потоке опроса,
+* и тогда цикл доживает до выхода из потока.
+*/
+class PollLoop : public std::enable_shared_from_this<PollLoop> {
+public:
+	typedef TaskWatcher::TaskCompletion TaskCompletion;
+
+	explicit PollLoop(const string &token): m_scalets(token), m_failures(0), m_changed(false), m_stopped(false) {}
+
+	void Start() {
+		std::shared_ptr<PollLoop> self = shared_from_this();
+		m_thread = std::thread([self] { self->Run(); });
+	}
+
+	/*
+	* Останавливает цикл. Оставшиеся ожидающие завершаются ошибкой в потоке опроса.
+	* Из самого потока опроса его нельзя дождаться, поэтому он отсоединяется.
+	*/
+	void Stop() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopped = true;
+		}
+		m_wakeup.notify_all();
+		if (std::this_thread::get_id() == m_thread.get_id())
+			m_thread.detach();
+		else
+			m_thread.join();
+	}
+
+	std::future<TaskInfo> Add(const string &task_id, int ctid, const TaskCompletion &done) {
+		Waiter waiter;
+		waiter.task_id = task_id;
+		waiter.ctid = ctid;
+		waiter.registered = Clock::now();
+		waiter.last = TaskInfo();
+		waiter.last.id = task_id;
+		waiter.last.scalet = ctid;
+		waiter.seen = false;
+		waiter.estimated = false;
+		waiter.misses = 0;
+		waiter.promise = std::make_shared<std::promise<TaskInfo>>();
+		waiter.done = done;
+		std::future<TaskInfo> result = waiter.promise->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_waiters.push_back(std::move(waiter));
+			m_changed = true;
+		}
+		m_wakeup.notify_all();
+		return result;
+	}
+
+	size_t Pending() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_waiters.size();
+	}
+
+private:
+	struct Waiter {
+		string task_id;
+		int ctid;
+		Clock::time_point registered, expected;
+		TaskInfo last;
+		bool seen, estimated;
+		unsigned misses;
+		/// Ошибка ожидания при успешном опросе (операция не найдена)
+		std::exception_ptr error;
+		std::shared_ptr<std::promise<TaskInfo>> promise;
+		TaskCompletion done;
+	};
+
+	PollLoop(const PollLoop &) = delete;
+	PollLoop &operator=(const PollLoop &) = delete;
+
+	/// Типичная длительность операции данного вида, если она уже известна
+	bool Expected(const InternedString &method, Milliseconds &duration) const {
+		auto it = m_durations.find(method.str());
+		if (it == m_durations.end())
+			return false;
+		duration = Milliseconds((long long) it->second);
+		return true;
+	}
+
+	void Observe(const Waiter &waiter, Clock::time_point now) {
+		if (!waiter.seen || waiter.last.method.empty())
+			return;
+		const double duration = (double) std::chrono::duration_cast<Milliseconds>(now - waiter.registered).count();
+		auto inserted = m_durations.emplace(waiter.last.method.str(), duration);
+		if (!inserted.second)
+			inserted.first->second += TASK_WATCH_DURATION_WEIGHT * (duration - inserted.first->second);
+	}
+
+	/*
+	* Период до следующего опроса. До ожидаемого момента завершения операции
+	* он сокращается вдвое с каждым опросом, после него - растет по мере
+	* задержки. Пока длительность операций этого вида неизвестна, период растет
+	* вместе со временем ожидания. Операции, которые еще не встречались в списке,
+	* опрашиваются с минимальным периодом.
+	*/
+	Milliseconds NextInterval(Clock::time_point now) const {
+		Milliseconds interval(TASK_WATCH_MAX_INTERVAL_MS);
+		for (const auto &waiter : m_waiters) {
+			Milliseconds candidate(TASK_WATCH_MIN_INTERVAL_MS);
+			if (waiter.seen && !waiter.estimated)
+				candidate = std::chrono::duration_cast<Milliseconds>(now - waiter.registered) / 2;
+			else if (waiter.seen && now < waiter.expected)
+				candidate = std::chrono::duration_cast<Milliseconds>(waiter.expected - now) / 2;
+			else if (waiter.seen)
+				candidate = std::chrono::duration_cast<Milliseconds>(now - waiter.expected) / 2;
+			interval = std::min(interval, candidate);
+		}
+		interval *= 1 << std::min(m_failures, 4u);
+		return std::max(Milliseconds(TASK_WATCH_MIN_INTERVAL_MS), std::min(interval, Milliseconds(TASK_WATCH_MAX_INTERVAL_MS)));
+	}
+
+	/*
+	* Обновляет состояние ожидающего по списку операций, возвращает true, если
+	* ожидание завершено. Ожидающий по серверу привязывается к первой найденной
+	* незавершенной операции над ним и дальше следит за ней по идентификатору,
+	* поэтому итог берется из записи этой операции с done и error. Если
+	* незавершенной операции нет несколько опросов подряд, итогом считается
+	* последняя завершенная операция над сервером: она могла завершиться до
+	* первого опроса. Операция, которой так и нет в списке, завершает ожидание
+	* ошибкой.
+	*/
+	bool Update(Waiter &waiter, const std::vector<TaskInfo> &tasks) {
+		const TaskInfo *current = nullptr;
+		const TaskInfo *finished = nullptr;
+		for (const auto &task : tasks) {
+			if (!waiter.task_id.empty()) {
+				if (task.id == waiter.task_id) {
+					current = &task;
+					break;
+				}
+			} else if (task.scalet == waiter.ctid) {
+				if (!task.done) {
+					current = &task;
+					break;
+				}
+				if (finished == nullptr || finished->insert_date < task.insert_date)
+					finished = &task;
+			}
+		}
+
+		if (current == nullptr) {
+			if (++waiter.misses < TASK_WATCH_GRACE_POLLS)
+				return false;
+			if (finished == nullptr) {
+				waiter.error = std::make_exception_ptr(BadRequest(TASK_WATCH_NOT_FOUND));
+				return true;
+			}
+			current = finished;
+		}
+		waiter.misses = 0;
+		if (waiter.task_id.empty())
+			waiter.task_id = current->id;
+
+		Milliseconds duration;
+		if (!waiter.seen || current->method != waiter.last.method) {
+			waiter.estimated = Expected(current->method, duration);
+			if (waiter.estimated)
+				waiter.expected = waiter.registered + duration;
+		}
+		waiter.last = *current;
+		waiter.seen = true;
+		return current->done;
+	}
+
+	static void Deliver(Waiter &waiter, std::exception_ptr error) {
+		if (waiter.done) {
+			try {
+				waiter.done(waiter.last, error);
+			} catch (...) {}
+		}
+		if (error)
+			waiter.promise->set_exception(error);
+		else
+			waiter.promise->set_value(waiter.last);
+	}
+
+	void Run() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;) {
+			m_wakeup.wait(lock, [this] { return m_stopped || !m_waiters.empty(); });
+			if (m_stopped)
+				break;
+
+			m_changed = false;
+			const Clock::time_point next = m_last_poll + NextInterval(Clock::now());
+			if (m_wakeup.wait_until(lock, next, [this] { return m_stopped || m_changed; }))
+				continue;
+
+			lock.unlock();
+			std::vector<TaskInfo> tasks;
+			std::exception_ptr error;
+			try {
+				m_scalets.Tasks(tasks);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			lock.lock();
+			m_last_poll = Clock::now();
+
+			std::list<Waiter> finished;
+			if (error) {
+				if (++m_failures >= TASK_WATCH_MAX_FAILURES) {
+					m_failures = 0;
+					finished.swap(m_waiters);
+				}
+			} else {
+				m_failures = 0;
+				for (auto it = m_waiters.begin(); it != m_waiters.end();) {
+					if (Update(*it, tasks)) {
+						Observe(*it, m_last_poll);
+						finished.splice(finished.end(), m_waiters, it++);
+					} else {
+						++it;
+					}
+				}
+			}
+			if (finished.empty())
+				continue;
+
+			lock.unlock();
+			for (auto &waiter : finished)
+				Deliver(waiter, error ? error : waiter.error);
+			lock.lock();
+		}
+
+		std::list<Waiter> remaining;
+		remaining.swap(m_waiters);
+		lock.unlock();
+		std::exception_ptr error = std::make_exception_ptr(BadRequest(TASK_WATCHER_STOPPED));
+		for (auto &waiter : remaining)
+			Deliver(waiter, error);
+	}
+
+	Scalets m_scalets;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	std::list<Waiter> m_waiters;
+	std::unordered_map<string, double> m_durations;
+	Clock::time_point m_last_poll;
+	unsigned m_failures;
+	bool m_changed, m_stopped;
+	std::thread m_thread;
+};
+
+} // namespace
+
+/// Цикл опроса токена, пока его используют объекты TaskWatcher
+class TaskWatcher::Poller {
+public:
+	static std::shared_ptr<Poller> ForToken(const string &token) {
+		static std::mutex mutex;
+		static std::unordered_map<string, std::weak_ptr<Poller>> pollers;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto it = pollers.begin(); it != pollers.end();) {
+			if (it->second.expired())
+				it = pollers.erase(it);
+			else
+				++it;
+		}
+		std::shared_ptr<Poller> poller = pollers[token].lock();
+		if (!poller) {
+			poller.reset(new Poller(token));
+			pollers[token] = poller;
+		}
+		return poller;
+	}
+
+	~Poller() {
+		m_loop->Stop();
+	}
+
+	std::future<TaskInfo> Add(const string &task_id, int ctid, const TaskCompletion &done) {
+		return m_loop->Add(task_id, ctid, done);
+	}
+
+	size_t Pending() {
+		return m_loop->Pending();
+	}
+
+private:
+	explicit Poller(const string &token): m_loop(std::make_shared<PollLoop>(token)) {
+		m_loop->Start();
+	}
+
+	Poller(const Poller &) = delete;
+	Poller &operator=(const Poller &) = delete;
+
+	std::shared_ptr<PollLoop> m_loop;
+};
+
+TaskWatcher::TaskWatcher(const string &token): m_poller(Poller::ForToken(token)) {}
+TaskWatcher::~TaskWatcher() {}
+
+std::future<TaskInfo> TaskWatcher::Wait(const string &task_id, TaskCompletion done) const {
+	return m_poller->Add(task_id, 0, done);
+}
+
+std::future<TaskInfo> TaskWatcher::WaitScalet(int ctid, TaskCompletion done) const {
+	return m_poller->Add(string(), ctid, done);
+}
+
+size_t TaskWatcher::Pending() const {
+	return m_poller->Pending();
+}
+
+} // namespace vscale
@@ -1,532 +1,3189 @@
 #include <vscale/vscale.h>
+#include <vscale/task_watcher.h>
+#include "internal.h"
 #include <curl/curl.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <list>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #define SUCCESS_RESPONSE_CODE_200 		200
-#define SUCCESS_RESPONSE_CODE_204 		204
+#define SUCCESS_RESPONSE_CODE_299 		299
+#define NOT_MODIFIED_RESPONSE_CODE_304 		304
+#define TOO_MANY_REQUESTS_RESPONSE_CODE_429 	429
+#define SERVER_ERROR_RESPONSE_CODE_500 		500
+#define SERVER_ERROR_RESPONSE_CODE_599 		599
 #define VSCALE_ERROR_MESSAGE			"VSCALE-ERROR-MESSAGE"
 #define DEFAULT_BAD_REQUEST			"bad request with code "
-#define HEADER_TOKEN(A) 			"X-Token: " + A
+#define HANDLE_POOL_SHARDS			16
+#define HANDLE_POOL_SHARD_CAPACITY		32
+#define HANDLE_POOL_IO_CAPACITY			1024
+#define HTTP2_MAX_HOST_CONNECTIONS		2L
+#define HEADER_TOKEN 				"X-Token: "
 #define HEADER_APPLICATION_JSON 		"Content-Type: application/json;charset=UTF-8"
+#define HEADER_ETAG 				"ETag"
+#define HEADER_LAST_MODIFIED 			"Last-Modified"
+#define HEADER_RETRY_AFTER 			"Retry-After"
+#define HEADER_IF_NONE_MATCH 			"If-None-Match"
+#define HEADER_IF_MODIFIED_SINCE 		"If-Modified-Since"
+#define HTTP_EXTRA_HEADERS 			2
+#define ROUTE_URL_BUFFER_SIZE 			512
+#define RESPONSE_BUFFER_MAX_RETAINED 		(1 << 20)
+#define VALIDATOR_CACHE_CAPACITY 		256
+#define METRICS_MAX_ENDPOINTS 			64
+#define METRICS_BUCKETS 			32
+#define METRICS_OTHER_ENDPOINT 			"other"
+#define RATE_LIMITED_MESSAGE 			"rate limit exceeded"
+#define URL_TOO_LONG_MESSAGE 			"request URL is too long"
+#define SCALET_TASK_FAILED_MESSAGE 		"scalet operation failed"
+#define BULK_IN_IO_THREAD_MESSAGE 		"bulk operations cannot be called from the I/O thread"
+
+#define VSCALE_DEFAULT_BASE_URL 		"https://api.vscale.io"
+#define VSCALE_API_PREFIX 			"/v1/"
 
-#define VSCALE_ACCOUNT_API_URL 			"https://api.vscale.io/v1/account"
-#define VSCALE_SCALETS_API_URL 			"https://api.vscale.io/v1/scalets"
-#define VSCALE_SERVER_TAGS_API_URL 		"https://api.vscale.io/v1/scalets/tags"
-#define VSCALE_BACKUP_API_URL 			"https://api.vscale.io/v1/backups"
-#define VSCALE_SSHKEYS_API_URL 			"https://api.vscale.io/v1/sshkeys"
-#define VSCALE_NOTIFICATIONS_API_URL 		"https://api.vscale.io/v1/billing/notify"
-#define VSCALE_DOMAIN_API_URL 			"https://api.vscale.io/v1/domains/"
-#define VSCALE_DOMAIN_TAGS_API_URL 		"https://api.vscale.io/v1/domains/tags/"
-#define VSCALE_PTR_RECORDS_API_URL 		"https://api.vscale.io/v1/domains/ptr/"
-#define VSCALE_LOCATIONS_API_URL 		"https://api.vscale.io/v1/locations"
-#define VSCALE_IMAGES_API_URL 			"https://api.vscale.io/v1/images"
-#define VSCALE_RPLANS_API_URL 			"https://api.vscale.io/v1/rplans"
-#define VSCALE_BILLING_PRICES_API_URL 		"https://api.vscale.io/v1/billing/prices"
-#define VSCALE_BILLING_BALANCE_API_URL 		"https://api.vscale.io/v1/billing/balance"
-#define VSCALE_BILLING_PAYMENTS_API_URL 	"https://api.vscale.io/v1/billing/payments"
-#define VSCALE_BILLING_CONSUMPTION_API_URL 	"https://api.vscale.io/v1/billing/consumption"
+namespace vscale {
+
+/*
+* Общий для всего процесса транспорт: DNS-кэш, TLS-сессии и пул соединений
+* разделяются между всеми easy-хендлами, поэтому рукопожатие с api.vscale.io
+* выполняется один раз, а не для каждого объекта ресурса.
+*/
+class SharedTransport {
+public:
+	static SharedTransport &Instance() {
+		static SharedTransport instance;
+		return instance;
+	}
+
+	/*
+	* connections - разделять ли пул соединений. В режиме HTTP/2 соединения
+	* принадлежат multi хендлу AsyncEngine, который мультиплексирует в них
+	* запросы, поэтому разделяются только DNS-кэш и TLS-сессии.
+	*/
+	CURLSH *Share(bool connections = true) const {
+		return connections ? m_share : m_session_share;
+	}
+
+private:
+	SharedTransport() {
+		curl_global_init(CURL_GLOBAL_ALL);
+		m_share = CreateShare(true);
+		m_session_share = CreateShare(false);
+	}
+
+	~SharedTransport() {
+		if (m_share)
+			curl_share_cleanup(m_share);
+		if (m_session_share)
+			curl_share_cleanup(m_session_share);
+		curl_global_cleanup();
+	}
+
+	CURLSH *CreateShare(bool connections) {
+		CURLSH *share = curl_share_init();
+		if (share) {
+			curl_share_setopt(share, CURLSHOPT_LOCKFUNC, LockCallback);
+			curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, UnlockCallback);
+			curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+			curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+			curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+			if (connections)
+				curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+		}
+		return share;
+	}
+
+	SharedTransport(const SharedTransport &) = delete;
+	SharedTransport &operator=(const SharedTransport &) = delete;
+
+	static void LockCallback(CURL *, curl_lock_data data, curl_lock_access, void *userptr) {
+		static_cast<SharedTransport *>(userptr)->m_locks[data].lock();
+	}
+
+	static void UnlockCallback(CURL *, curl_lock_data data, void *userptr) {
+		static_cast<SharedTransport *>(userptr)->m_locks[data].unlock();
+	}
+
+	CURLSH *m_share, *m_session_share;
+	std::mutex m_locks[CURL_LOCK_DATA_LAST];
+};
+
+/*
+* Глобальные настройки транспорта, задаваемые через класс Transport.
+*/
+class TransportOptions {
+public:
+	static TransportOptions &Instance() {
+		static TransportOptions instance;
+		return instance;
+	}
+
+	std::atomic<int> http_version;
+	std::atomic<bool> compression;
+
+	std::shared_ptr<const string> BaseURL() const {
+		return std::atomic_load(&m_base_url);
+	}
+
+	void SetBaseURL(const string &url) {
+		string base = url.empty() ? VSCALE_DEFAULT_BASE_URL : url;
+		while (base.size() > 1 && base[base.size() - 1] == '/')
+			base.erase(base.size() - 1);
+		std::atomic_store(&m_base_url, std::shared_ptr<const string>(std::make_shared<string>(base)));
+	}
+
+private:
+	TransportOptions(): http_version(Transport::hvHTTP1_1), compression(true),
+			m_base_url(std::make_shared<string>(VSCALE_DEFAULT_BASE_URL)) {}
+
+	std::shared_ptr<const string> m_base_url;
+};
+
+void Transport::SetHttpVersion(HttpVersion version) {
+	TransportOptions::Instance().http_version = version;
+}
+
+Transport::HttpVersion Transport::GetHttpVersion() {
+	return (HttpVersion) TransportOptions::Instance().http_version.load();
+}
+
+void Transport::SetBaseURL(const string &url) {
+	TransportOptions::Instance().SetBaseURL(url);
+}
+
+string Transport::GetBaseURL() {
+	return *TransportOptions::Instance().BaseURL();
+}
+
+void Transport::SetCompression(bool enabled) {
+	TransportOptions::Instance().compression = enabled;
+}
+
+bool Transport::GetCompression() {
+	return TransportOptions::Instance().compression;
+}
+
+/*
+* Установленный обработчик трассировки. Пока он не установлен, запрос
+* проверяет только флаг m_active.
+*/
+class TracerHolder {
+public:
+	static TracerHolder &Instance() {
+		static TracerHolder instance;
+		return instance;
+	}
+
+	bool Active() const {
+		return m_active.load(std::memory_order_relaxed);
+	}
+
+	std::shared_ptr<Tracer> Get() const {
+		return std::atomic_load(&m_tracer);
+	}
+
+	void Set(const std::shared_ptr<Tracer> &tracer) {
+		std::atomic_store(&m_tracer, tracer);
+		m_active = (bool) tracer;
+	}
+
+private:
+	TracerHolder(): m_active(false) {}
+
+	std::atomic<bool> m_active;
+	std::shared_ptr<Tracer> m_tracer;
+};
+
+void Tracer::Set(std::shared_ptr<Tracer> tracer) {
+	TracerHolder::Instance().Set(tracer);
+}
+
+class HttpRequest {
+public:
+	enum MethodRequest {
+		mrGET,
+		mrPOST,
+		mrPUT,
+		mrPATCH,
+		mrDELETE
+	};
+
+	typedef std::function<void(const char *data, size_t size)> BodySink;
+
+	HttpRequest(): m_share(nullptr), m_headers(nullptr), m_extra_count(0), m_method(mrGET), m_not_modified(false), m_first_byte(false) {
+		SharedTransport::Instance();
+		m_trace_node.data = nullptr;
+		m_trace_node.next = nullptr;
+		for (auto &node : m_extra_nodes) {
+			node.data = nullptr;
+			node.next = nullptr;
+		}
+		m_curl = curl_easy_init();
+		if (m_curl)
+			curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	}
+
+	~HttpRequest() {
+		if (m_curl)
+			curl_easy_cleanup(m_curl);
+	}
+
+	HttpRequest(const HttpRequest &) = delete;
+	HttpRequest &operator=(const HttpRequest &) = delete;
+
+	CURL *Handle() const {
+		return m_curl;
+	}
+
+	/// Буфер тела запроса, переиспользуемый между запросами на этом хендле
+	string &Body() {
+		return m_data;
+	}
+
+	/// Валидаторы последнего ответа
+	const string &ETag() const {
+		return m_etag;
+	}
+
+	const string &LastModified() const {
+		return m_last_modified;
+	}
+
+	/// Сервер ответил 304 Not Modified на условный запрос
+	bool NotModified() const {
+		return m_not_modified;
+	}
+
+	long ResponseCode() const {
+		long response_code = 0;
+		curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &response_code);
+		return response_code;
+	}
+
+	/// Запрос завершился ошибкой транспорта или ответом не 2xx и не 304
+	bool Failed(CURLcode code) const {
+		if (code != CURLE_OK)
+			return true;
+		const long response_code = ResponseCode();
+		return !IsSuccess(response_code) && response_code != NOT_MODIFIED_RESPONSE_CODE_304;
+	}
+
+	/// Длительность фаз выполненного запроса в микросекундах
+	void Timings(int64_t phases[Metrics::phCount]) const {
+		curl_off_t namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0;
+		curl_easy_getinfo(m_curl, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+		curl_easy_getinfo(m_curl, CURLINFO_CONNECT_TIME_T, &connect);
+		curl_easy_getinfo(m_curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+		curl_easy_getinfo(m_curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+		curl_easy_getinfo(m_curl, CURLINFO_TOTAL_TIME_T, &total);
+
+		// curl сообщает время от начала запроса, фазы - разности соседних отметок
+		connect = std::max(connect, namelookup);
+		const curl_off_t secured = std::max(appconnect, connect);
+		starttransfer = std::max(starttransfer, secured);
+		total = std::max(total, starttransfer);
+
+		phases[Metrics::phNameLookup] = namelookup;
+		phases[Metrics::phConnect] = connect - namelookup;
+		phases[Metrics::phTLS] = secured - connect;
+		phases[Metrics::phServer] = starttransfer - secured;
+		phases[Metrics::phTransfer] = total - starttransfer;
+		phases[Metrics::phTotal] = total;
+	}
+
+	/// Объем отправленных и полученных данных вместе с заголовками
+	void Transferred(uint64_t &sent, uint64_t &received) const {
+		curl_off_t uploaded = 0, downloaded = 0;
+		long request_size = 0, header_size = 0;
+		curl_easy_getinfo(m_curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+		curl_easy_getinfo(m_curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+		curl_easy_getinfo(m_curl, CURLINFO_REQUEST_SIZE, &request_size);
+		curl_easy_getinfo(m_curl, CURLINFO_HEADER_SIZE, &header_size);
+		sent = (uint64_t) request_size + (uint64_t) uploaded;
+		received = (uint64_t) header_size + (uint64_t) downloaded;
+	}
+
+	/*
+	* Запрос завершился временной ошибкой, после которой его можно повторить:
+	* сбой соединения или таймаут, ответ 429 Too Many Requests или 5xx.
+	*/
+	bool Transient(CURLcode code) const {
+		if (m_sink_error)
+			return false;
+		switch (code) {
+			case CURLE_OK: {
+				const long response_code = ResponseCode();
+				return response_code == TOO_MANY_REQUESTS_RESPONSE_CODE_429
+						|| (response_code >= SERVER_ERROR_RESPONSE_CODE_500 && response_code <= SERVER_ERROR_RESPONSE_CODE_599);
+			}
+			case CURLE_COULDNT_RESOLVE_HOST:
+			case CURLE_COULDNT_CONNECT:
+			case CURLE_OPERATION_TIMEDOUT:
+			case CURLE_SSL_CONNECT_ERROR:
+			case CURLE_SEND_ERROR:
+			case CURLE_RECV_ERROR:
+			case CURLE_GOT_NOTHING:
+			case CURLE_PARTIAL_FILE:
+			case CURLE_HTTP2:
+			case CURLE_HTTP2_STREAM:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	/// Задержка из заголовка Retry-After (в секундах или HTTP-датой), 0 если его нет
+	std::chrono::milliseconds RetryAfter() const {
+		if (m_retry_after.empty())
+			return std::chrono::milliseconds(0);
+		long long seconds = 0;
+		if (isdigit((unsigned char) m_retry_after[0])) {
+			seconds = std::strtoll(m_retry_after.c_str(), nullptr, 10);
+		} else {
+			const time_t date = curl_getdate(m_retry_after.c_str(), nullptr);
+			if (date != -1)
+				seconds = (long long) date - (long long) time(nullptr);
+		}
+		return std::chrono::seconds(std::max(seconds, 0LL));
+	}
+
+	HttpRequest &SetURL(const char *url) {
+		curl_easy_setopt(m_curl, CURLOPT_URL, url);
+		if (strncmp(url, "https://", 8) == 0) {
+			curl_easy_setopt(m_curl, CURLOPT_SSL_VERIFYHOST, 0L);
+			curl_easy_setopt(m_curl, CURLOPT_SSL_VERIFYPEER, 0L);
+		}
+		return *this;
+	}
+
+	/*
+	* Общий список заголовков, построенный один раз для клиента. Хендл им
+	* не владеет: список должен жить, пока хендл выполняет запрос.
+	* Сбрасывает заголовки, добавленные AddHeader.
+	*/
+	HttpRequest &SetHeaders(const struct curl_slist *headers) {
+		m_headers = headers;
+		m_extra_count = 0;
+		return *this;
+	}
+
+	/*
+	* Заголовок только для следующего запроса. Узел списка принадлежит хендлу
+	* и добавляется в начало общего списка, который при этом не копируется.
+	*/
+	HttpRequest &AddHeader(const char *name, const string &value) {
+		if (m_extra_count == HTTP_EXTRA_HEADERS)
+			return *this;
+		string &line = m_extra_values[m_extra_count];
+		line.assign(name).append(": ").append(value);
+		m_extra_nodes[m_extra_count].data = &line[0];
+		++m_extra_count;
+		return *this;
+	}
+
+	/*
+	* Тело ответа накапливается в буфере хендла, который переиспользуется
+	* между запросами. Перед первой частью буфер расширяется по Content-Length;
+	* для сжатого ответа это размер до распаковки, и дальше буфер растет сам.
+	*/
+	static size_t WriteFuncCallback(char *ptr, size_t size, size_t nmemb, void *userdata) {
+		size_t realsize = size * nmemb;
+		if (realsize <= 0)
+			return 0;
+		HttpRequest *request = (HttpRequest *) userdata;
+		string &response = request->m_response;
+		if (response.empty()) {
+			curl_off_t length = -1;
+			curl_easy_getinfo(request->m_curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+			if (length > (curl_off_t) response.capacity() && length <= RESPONSE_BUFFER_MAX_RETAINED)
+				response.reserve((size_t) length);
+		}
+		response.append(ptr, realsize);
+
+		return realsize;
+	}
+
+	static size_t StreamFuncCallback(char *ptr, size_t size, size_t nmemb, void *userdata) {
+		size_t realsize = size * nmemb;
+		if (realsize <= 0)
+			return 0;
+		HttpRequest *request = (HttpRequest *) userdata;
+		long response_code = 0;
+		curl_easy_getinfo(request->m_curl, CURLINFO_RESPONSE_CODE, &response_code);
+		if (!IsSuccess(response_code))
+			return realsize;
+		try {
+			request->m_sink(ptr, realsize);
+		} catch (...) {
+			request->m_sink_error = std::current_exception();
+			return 0;
+		}
+		return realsize;
+	}
+
+	static const char *MethodName(MethodRequest method) {
+		switch (method) {
+			case mrGET:
+				return "GET";
+			case mrPOST:
+				return "POST";
+			case mrPUT:
+				return "PUT";
+			case mrPATCH:
+				return "PATCH";
+			case mrDELETE:
+				return "DELETE";
+			default:
+				return "";
+		}
+	}
+
+	static bool IsSuccess(long response_code) {
+		return response_code >= SUCCESS_RESPONSE_CODE_200 && response_code <= SUCCESS_RESPONSE_CODE_299;
+	}
+
+	/*
+	* Если строка заголовка line имеет имя name (без учета регистра),
+	* записывает его значение без пробелов по краям в value.
+	*/
+	static bool HeaderValue(const char *line, size_t size, const char *name, string &value) {
+		const size_t len = strlen(name);
+		if (size <= len || line[len] != ':')
+			return false;
+		for (size_t i = 0; i < len; ++i) {
+			if (tolower((unsigned char) line[i]) != tolower((unsigned char) name[i]))
+				return false;
+		}
+		const char *begin = line + len + 1, *end = line + size;
+		while (begin != end && isspace((unsigned char) *begin))
+			++begin;
+		while (end != begin && isspace((unsigned char) *(end - 1)))
+			--end;
+		value.assign(begin, end);
+		return true;
+	}
+
+	static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata) {
+		size_t realsize = size * nitems;
+		if (realsize <= 0)
+			return 0;
+		HttpRequest *request = (HttpRequest *) userdata;
+		if (realsize > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+			request->m_error_message.clear();
+			request->m_etag.clear();
+			request->m_last_modified.clear();
+			request->m_retry_after.clear();
+			if (request->m_tracer && !request->m_first_byte) {
+				request->m_first_byte = true;
+				request->m_call.status = request->ResponseCode();
+				try {
+					request->m_tracer->OnFirstByte(request->m_call);
+				} catch (...) {}
+			}
+		} else if (!HeaderValue(buffer, realsize, VSCALE_ERROR_MESSAGE, request->m_error_message)
+				&& !HeaderValue(buffer, realsize, HEADER_ETAG, request->m_etag)
+				&& !HeaderValue(buffer, realsize, HEADER_LAST_MODIFIED, request->m_last_modified)) {
+			HeaderValue(buffer, realsize, HEADER_RETRY_AFTER, request->m_retry_after);
+		}
+		return realsize;
+	}
+
+	/*
+	* Настраивает хендл для выполнения запроса. Тело запроса и ответ хранятся
+	* в самом объекте, поэтому после Prepare хендл можно выполнить как
+	* синхронно, так и через AsyncEngine. Тело запроса предварительно
+	* записывается в буфер Body(). Если передан sink, тело ответа
+	* не накапливается, а по частям передается в него.
+	*/
+	CURLcode Prepare(MethodRequest method=mrGET, const BodySink &sink=BodySink()) {
+		// Буфер ответа сохраняет емкость между запросами, кроме необычно больших ответов
+		if (m_response.capacity() > RESPONSE_BUFFER_MAX_RETAINED)
+			string().swap(m_response);
+		else
+			m_response.clear();
+		m_error_message.clear();
+		m_etag.clear();
+		m_last_modified.clear();
+		m_retry_after.clear();
+		m_not_modified = false;
+		m_sink = sink;
+		m_sink_error = nullptr;
+		m_method = method;
+
+		CURLcode code = curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, nullptr);
+		if (code == CURLE_OK)
+			code = curl_easy_setopt(m_curl, CURLOPT_POSTFIELDS, nullptr);
+		if (code == CURLE_OK)
+			code = curl_easy_setopt(m_curl, CURLOPT_HTTPGET, 1L);
+		if (code == CURLE_OK) {
+			switch (method) {
+				case mrGET:
+					break;
+				case mrPOST:
+					code = curl_easy_setopt(m_curl, CURLOPT_POST, 1L);
+					break;
+				case mrPUT:
+					code = curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "PUT");
+					break;
+				case mrPATCH:
+					code = curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "PATCH");
+					break;
+				case mrDELETE:
+					code = curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+					break;
+				default:
+					code = CURLE_FAILED_INIT;
+			}
+		}
+
+		if (code == CURLE_OK && !m_data.empty()) {
+			curl_easy_setopt(m_curl, CURLOPT_POSTFIELDSIZE, (long) m_data.size());
+			code = curl_easy_setopt(m_curl, CURLOPT_POSTFIELDS, m_data.c_str());
+		}
+
+		if (code == CURLE_OK)
+			code = curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, HeaderList());
+
+		if (code == CURLE_OK) {
+			const bool http2 = TransportOptions::Instance().http_version == Transport::hvHTTP2;
+			CURLSH *share = SharedTransport::Instance().Share(!http2);
+			if (share != m_share) {
+				curl_easy_setopt(m_curl, CURLOPT_SHARE, share);
+				m_share = share;
+			}
+			curl_easy_setopt(m_curl, CURLOPT_HTTP_VERSION, http2 ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_1_1);
+			curl_easy_setopt(m_curl, CURLOPT_PIPEWAIT, http2 ? 1L : 0L);
+			// Пустая строка - все кодировки, поддерживаемые libcurl (gzip, deflate, br, zstd);
+			// ответ распаковывается потоково до передачи в WriteFuncCallback
+			curl_easy_setopt(m_curl, CURLOPT_ACCEPT_ENCODING, TransportOptions::Instance().compression ? "" : nullptr);
+			if (m_sink) {
+				curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, StreamFuncCallback);
+				curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
+			} else {
+				curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, WriteFuncCallback);
+				curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
+			}
+			curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+			curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, this);
+			curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, 30);
+			curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT, 30);
+		}
+
+		return code;
+	}
+
+	/*
+	* Проверяет результат выполненного запроса и возвращает тело ответа.
+	* Тело остается в буфере хендла и действительно до следующего Prepare.
+	* В случае ошибки генерирует BadRequest.
+	*/
+	const string &Complete(CURLcode code) {
+		m_sink = BodySink();
+		if (m_sink_error) {
+			std::exception_ptr error = m_sink_error;
+			m_sink_error = nullptr;
+			std::rethrow_exception(error);
+		}
+		if (code != CURLE_OK)
+			throw BadRequest(curl_easy_strerror(code));
+
+		long response_code = 0;
+		code = curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &response_code);
+		m_not_modified = code == CURLE_OK && response_code == NOT_MODIFIED_RESPONSE_CODE_304;
+		if (code == CURLE_OK && !IsSuccess(response_code) && !m_not_modified) {
+			if (!m_error_message.empty())
+				throw BadRequest(m_error_message);
+			throw BadRequest(DEFAULT_BAD_REQUEST + std::to_string(response_code));
+		}
+
+		return m_response;
+	}
+
+	/// Шаблон метода API и адрес для трассировки. Сохраняются, только пока трассировка включена.
+	void SetTraceTarget(const char *endpoint, const char *url) {
+		if (TracerHolder::Instance().Active()) {
+			m_call.endpoint = endpoint;
+			m_call.url = url;
+		} else if (!m_call.endpoint.empty()) {
+			m_call.endpoint.clear();
+			m_call.url.clear();
+		}
+	}
+
+	/*
+	* Начало трассировки попытки, вызывается непосредственно перед отправкой.
+	* Заголовок контекста трассировки добавляется узлом в начало уже
+	* построенного списка заголовков, сам список не перестраивается.
+	*/
+	void StartTrace() {
+		if (!TracerHolder::Instance().Active())
+			return;
+		m_tracer = TracerHolder::Instance().Get();
+		if (!m_tracer)
+			return;
+
+		m_call.method = MethodName(m_method);
+		m_call.status = 0;
+		std::fill(m_call.phases, m_call.phases + Metrics::phCount, 0);
+		m_call.error.clear();
+		m_call.context = nullptr;
+		m_first_byte = false;
+		m_trace_header.clear();
+		try {
+			m_call.context = m_tracer->OnStart(m_call, m_trace_header);
+		} catch (...) {}
+		if (!m_trace_header.empty()) {
+			m_trace_node.data = &m_trace_header[0];
+			m_trace_node.next = HeaderList();
+			curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, &m_trace_node);
+		}
+	}
+
+	/// Завершение трассировки попытки
+	void FinishTrace(CURLcode code) {
+		if (!m_tracer)
+			return;
+		m_call.status = ResponseCode();
+		Timings(m_call.phases);
+		if (code != CURLE_OK)
+			m_call.error = curl_easy_strerror(code);
+		else if (Failed(code))
+			m_call.error = m_error_message.empty() ? DEFAULT_BAD_REQUEST + std::to_string(m_call.status) : m_error_message;
+		try {
+			m_tracer->OnComplete(m_call);
+		} catch (...) {}
+		m_tracer.reset();
+	}
+
+	const string &Perform(MethodRequest method=mrGET, const BodySink &sink=BodySink()) {
+		CURLcode code = Prepare(method, sink);
+		if (code == CURLE_OK)
+			code = curl_easy_perform(m_curl);
+		return Complete(code);
+	}
+
+private:
+	/// Заголовки следующего запроса: собственные узлы хендла, затем общий список
+	struct curl_slist *HeaderList() {
+		struct curl_slist *head = const_cast<struct curl_slist *>(m_headers);
+		for (size_t i = 0; i < m_extra_count; ++i) {
+			m_extra_nodes[i].next = head;
+			head = &m_extra_nodes[i];
+		}
+		return head;
+	}
+
+	CURL *m_curl;
+	CURLSH *m_share;
+	const struct curl_slist *m_headers;
+	struct curl_slist m_extra_nodes[HTTP_EXTRA_HEADERS];
+	string m_extra_values[HTTP_EXTRA_HEADERS];
+	size_t m_extra_count;
+	string m_data, m_response, m_error_message, m_etag, m_last_modified, m_retry_after;
+	MethodRequest m_method;
+	bool m_not_modified, m_first_byte;
+	std::shared_ptr<Tracer> m_tracer;
+	Tracer::Call m_call;
+	string m_trace_header;
+	struct curl_slist m_trace_node;
+	BodySink m_sink;
+	std::exception_ptr m_sink_error;
+};
+
+/*
+* Потоковый разбор JSON: тело ответа поступает частями, элементы первого
+* встреченного массива выделяются по мере получения и по одному передаются
+* в обработчик. В памяти хранится только текст текущего элемента.
+*/
+class JsonArrayStream {
+public:
+	explicit JsonArrayStream(const ElementHandler &handler)
+			: m_handler(handler), m_reader(Json::CharReaderBuilder().newCharReader()),
+			m_depth(0), m_array_depth(0), m_in_string(false), m_escape(false), m_done(false) {}
+
+	void Feed(const char *data, size_t size) {
+		for (const char *c = data; c != data + size; ++c) {
+			if (m_done)
+				return;
+			if (m_in_string) {
+				if (m_array_depth > 0 && m_depth >= m_array_depth)
+					m_element.push_back(*c);
+				if (m_escape)
+					m_escape = false;
+				else if (*c == '\\')
+					m_escape = true;
+				else if (*c == '"')
+					m_in_string = false;
+				continue;
+			}
+			if (m_array_depth == 0) {
+				if (*c == '"')
+					m_in_string = true;
+				else if (*c == '{')
+					++m_depth;
+				else if (*c == '}')
+					--m_depth;
+				else if (*c == '[')
+					m_array_depth = ++m_depth;
+				continue;
+			}
+			if (m_depth == m_array_depth) {
+				if (*c == ',' || *c == ']') {
+					Flush();
+					if (*c == ']') {
+						--m_depth;
+						m_done = true;
+					}
+					continue;
+				}
+				if (isspace((unsigned char) *c))
+					continue;
+			}
+			m_element.push_back(*c);
+			if (*c == '"') {
+				m_in_string = true;
+			} else if (*c == '{' || *c == '[') {
+				++m_depth;
+			} else if (*c == '}' || *c == ']') {
+				if (--m_depth == m_array_depth)
+					Flush();
+			}
+		}
+	}
+
+	void Finish() {
+		if (!m_done)
+			throw BadRequest("incomplete JSON array in response");
+	}
+
+private:
+	void Flush() {
+		if (m_element.empty())
+			return;
+		JsonValue element;
+		string errors;
+		if (!m_reader->parse(m_element.data(), m_element.data() + m_element.size(), &element, &errors))
+			throw BadRequest("invalid JSON in response: " + errors);
+		m_element.clear();
+		m_handler(element);
+	}
+
+	ElementHandler m_handler;
+	std::unique_ptr<Json::CharReader> m_reader;
+	string m_element;
+	int m_depth, m_array_depth;
+	bool m_in_string, m_escape, m_done;
+};
+
+/// Признак потока ввода-вывода AsyncEngine
+bool &IoThreadFlag() {
+	static thread_local bool io_thread = false;
+	return io_thread;
+}
+
+/*
+* Пул easy-хендлов. Разбит на сегменты по идентификатору потока, поэтому
+* потоки, выполняющие запросы параллельно, не конкурируют за одну блокировку.
+* Если в своем сегменте нет свободного хендла, он забирается из сегмента
+* асинхронных запросов, затем из соседнего, и только затем создается новый.
+* Хендлы асинхронных запросов освобождаются в потоке ввода-вывода, а берутся
+* в потоках, ставящих запросы в очередь, поэтому для них отдельный сегмент,
+* вмещающий все одновременно выполняемые запросы: в сегменте одного потока
+* хендлы сверх HANDLE_POOL_SHARD_CAPACITY удалялись бы и создавались заново.
+*/
+class HandlePool {
+public:
+	struct Recycler {
+		void operator()(HttpRequest *request) const {
+			HandlePool::Instance().Release(request);
+		}
+	};
+
+	typedef std::unique_ptr<HttpRequest, Recycler> Handle;
+
+	static HandlePool &Instance() {
+		static HandlePool instance;
+		return instance;
+	}
+
+	Handle Acquire() {
+		const size_t current = CurrentShard();
+		for (size_t i = 0; i < HANDLE_POOL_SHARDS; ++i) {
+			Shard &shard = m_shards[(current + i) % HANDLE_POOL_SHARDS];
+			std::unique_lock<std::mutex> lock(shard.mutex, std::defer_lock);
+			if (i == 0)
+				lock.lock();
+			else if (!lock.try_lock())
+				continue;
+			if (!shard.free.empty()) {
+				HttpRequest *request = shard.free.back();
+				shard.free.pop_back();
+				return Handle(request);
+			}
+			if (i == 0) {
+				lock.unlock();
+				std::lock_guard<std::mutex> io_lock(m_io_shard.mutex);
+				if (!m_io_shard.free.empty()) {
+					HttpRequest *request = m_io_shard.free.back();
+					m_io_shard.free.pop_back();
+					return Handle(request);
+				}
+			}
+		}
+		return Handle(new HttpRequest);
+	}
+
+private:
+	struct Shard {
+		std::mutex mutex;
+		std::vector<HttpRequest *> free;
+	};
+
+	HandlePool() {
+		SharedTransport::Instance();
+	}
+
+	~HandlePool() {
+		for (auto &shard : m_shards) {
+			for (auto request : shard.free)
+				delete request;
+		}
+		for (auto request : m_io_shard.free)
+			delete request;
+	}
+
+	HandlePool(const HandlePool &) = delete;
+	HandlePool &operator=(const HandlePool &) = delete;
+
+	void Release(HttpRequest *request) {
+		const bool io_thread = IoThreadFlag();
+		Shard &shard = io_thread ? m_io_shard : m_shards[CurrentShard()];
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			if (shard.free.size() < (io_thread ? HANDLE_POOL_IO_CAPACITY : HANDLE_POOL_SHARD_CAPACITY)) {
+				shard.free.push_back(request);
+				return;
+			}
+		}
+		delete request;
+	}
+
+	static size_t CurrentShard() {
+		return std::hash<std::thread::id>()(std::this_thread::get_id()) % HANDLE_POOL_SHARDS;
+	}
+
+	Shard m_shards[HANDLE_POOL_SHARDS];
+	Shard m_io_shard;
+};
+
+/*
+* Асинхронный движок запросов: один curl multi хендл, обслуживаемый фоновым
+* потоком ввода-вывода. Обработчики завершения вызываются в этом потоке.
+* Обработчик может забрать хендл и снова поставить его в очередь, в том числе
+* с задержкой - так выполняются повторы без блокировки потока.
+*/
+class AsyncEngine {
+public:
+	typedef std::function<void(HandlePool::Handle &request, CURLcode code)> Handler;
+
+	static AsyncEngine &Instance() {
+		static AsyncEngine instance;
+		return instance;
+	}
+
+	/// Вызывающий поток - поток ввода-вывода движка. Не создает движок.
+	static bool InIoThread() {
+		return IoThreadFlag();
+	}
+
+	void Submit(HandlePool::Handle request, const Handler &handler,
+			std::chrono::milliseconds delay=std::chrono::milliseconds(0)) {
+		Job job;
+		job.request = std::move(request);
+		job.handler = handler;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (delay.count() > 0)
+				m_delayed.emplace(std::chrono::steady_clock::now() + delay, std::move(job));
+			else
+				m_pending.push_back(std::move(job));
+		}
+		curl_multi_wakeup(m_multi);
+	}
+
+	/// Выполнить task в потоке ввода-вывода
+	void Post(const std::function<void()> &task) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push_back(task);
+		}
+		curl_multi_wakeup(m_multi);
+	}
+
+private:
+	struct Job {
+		HandlePool::Handle request;
+		Handler handler;
+	};
+
+	AsyncEngine(): m_max_host_connections(0), m_stopped(false) {
+		HandlePool::Instance();
+		m_multi = curl_multi_init();
+		curl_multi_setopt(m_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+		m_thread = std::thread(&AsyncEngine::Run, this);
+	}
+
+	~AsyncEngine() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopped = true;
+		}
+		curl_multi_wakeup(m_multi);
+		m_thread.join();
+
+		for (auto &item : m_active)
+			curl_multi_remove_handle(m_multi, item.first);
+		m_active.clear();
+		m_pending.clear();
+		m_delayed.clear();
+		m_tasks.clear();
+		curl_multi_cleanup(m_multi);
+	}
+
+	AsyncEngine(const AsyncEngine &) = delete;
+	AsyncEngine &operator=(const AsyncEngine &) = delete;
+
+	void Run() {
+		IoThreadFlag() = true;
+		for (;;) {
+			std::vector<Job> pending;
+			std::vector<std::function<void()>> tasks;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_stopped)
+					return;
+				pending.swap(m_pending);
+				tasks.swap(m_tasks);
+				const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				while (!m_delayed.empty() && m_delayed.begin()->first <= now) {
+					pending.push_back(std::move(m_delayed.begin()->second));
+					m_delayed.erase(m_delayed.begin());
+				}
+			}
+
+			// Без ограничения curl открывает новое соединение на каждый запрос сверх
+			// лимита потоков HTTP/2, вместо того чтобы дождаться свободного потока
+			const long max_host_connections = TransportOptions::Instance().http_version == Transport::hvHTTP2
+					? HTTP2_MAX_HOST_CONNECTIONS : 0L;
+			if (max_host_connections != m_max_host_connections) {
+				curl_multi_setopt(m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, max_host_connections);
+				m_max_host_connections = max_host_connections;
+			}
+
+			for (auto &job : pending) {
+				CURL *handle = job.request->Handle();
+				job.request->StartTrace();
+				CURLMcode code = curl_multi_add_handle(m_multi, handle);
+				if (code == CURLM_OK)
+					m_active[handle] = std::move(job);
+				else
+					job.handler(job.request, CURLE_FAILED_INIT);
+			}
+			for (const auto &task : tasks)
+				task();
+
+			int running = 0;
+			curl_multi_perform(m_multi, &running);
+
+			CURLMsg *message;
+			int left = 0;
+			while ((message = curl_multi_info_read(m_multi, &left)) != nullptr) {
+				if (message->msg != CURLMSG_DONE)
+					continue;
+				CURL *handle = message->easy_handle;
+				CURLcode result = message->data.result;
+				curl_multi_remove_handle(m_multi, handle);
+
+				auto it = m_active.find(handle);
+				if (it == m_active.end())
+					continue;
+				Job job = std::move(it->second);
+				m_active.erase(it);
+				job.handler(job.request, result);
+			}
+
+			curl_multi_poll(m_multi, nullptr, 0, PollTimeout(), nullptr);
+		}
+	}
+
+	/// Время ожидания до ближайшего отложенного запроса, не более секунды
+	int PollTimeout() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_delayed.empty())
+			return 1000;
+		const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+				m_delayed.begin()->first - std::chrono::steady_clock::now()).count();
+		return (int) std::min<long long>(std::max<long long>(wait + 1, 0), 1000);
+	}
+
+	CURLM *m_multi;
+	long m_max_host_connections;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::vector<Job> m_pending;
+	std::vector<std::function<void()>> m_tasks;
+	std::multimap<std::chrono::steady_clock::time_point, Job> m_delayed;
+	std::unordered_map<CURL *, Job> m_active;
+	bool m_stopped;
+};
+
+void WriteJsonString(const char *begin, const char *end, string &out) {
+	char buffer[8];
+	out.push_back('"');
+	for (const char *c = begin; c != end; ++c) {
+		switch (*c) {
+			case '"': out.append("\\\"", 2); break;
+			case '\\': out.append("\\\\", 2); break;
+			case '\b': out.append("\\b", 2); break;
+			case '\f': out.append("\\f", 2); break;
+			case '\n': out.append("\\n", 2); break;
+			case '\r': out.append("\\r", 2); break;
+			case '\t': out.append("\\t", 2); break;
+			default:
+				if ((unsigned char) *c < 0x20)
+					out.append(buffer, snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned char) *c));
+				else
+					out.push_back(*c);
+		}
+	}
+	out.push_back('"');
+}
+
+/*
+* Компактная сериализация json без отступов и переводов строк. Результат
+* дописывается в out, поэтому при переиспользовании буфера память не выделяется.
+*/
+void WriteCompactJson(const JsonValue &value, string &out) {
+	char buffer[32];
+	switch (value.type()) {
+		case Json::nullValue:
+			out.append("null", 4);
+			break;
+		case Json::intValue:
+			out.append(buffer, snprintf(buffer, sizeof(buffer), "%lld", (long long) value.asLargestInt()));
+			break;
+		case Json::uintValue:
+			out.append(buffer, snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long) value.asLargestUInt()));
+			break;
+		case Json::realValue:
+			if (std::isfinite(value.asDouble()))
+				out.append(buffer, snprintf(buffer, sizeof(buffer), "%.17g", value.asDouble()));
+			else
+				out.append("null", 4);
+			break;
+		case Json::booleanValue:
+			if (value.asBool())
+				out.append("true", 4);
+			else
+				out.append("false", 5);
+			break;
+		case Json::stringValue: {
+			const char *begin = nullptr, *end = nullptr;
+			value.getString(&begin, &end);
+			WriteJsonString(begin, end, out);
+			break;
+		}
+		case Json::arrayValue: {
+			out.push_back('[');
+			for (Json::ArrayIndex i = 0; i < value.size(); ++i) {
+				if (i != 0)
+					out.push_back(',');
+				WriteCompactJson(value[i], out);
+			}
+			out.push_back(']');
+			break;
+		}
+		case Json::objectValue: {
+			out.push_back('{');
+			for (JsonValue::const_iterator it = value.begin(); it != value.end(); ++it) {
+				if (it != value.begin())
+					out.push_back(',');
+				const char *end = nullptr;
+				const char *begin = it.memberName(&end);
+				WriteJsonString(begin, end, out);
+				out.push_back(':');
+				WriteCompactJson(*it, out);
+			}
+			out.push_back('}');
+			break;
+		}
+	}
+}
+
+JsonValue ParseResponse(const string &body) {
+	JsonValue value;
+	if (body.empty())
+		return value;
+	static thread_local std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+	string errors;
+	if (!reader->parse(body.data(), body.data() + body.size(), &value, &errors))
+		throw BadRequest("invalid JSON in response: " + errors);
+	return value;
+}
+
+template <typename T>
+ElementHandler CollectInto(std::vector<T> &result) {
+	result.clear();
+	return [&result](const JsonValue &element) {
+		result.push_back(T::FromJson(element));
+	};
+}
+
+BadRequest::BadRequest(const string &what): m_what(what) {}
+
+const char* BadRequest::what() const throw() {
+	return m_what.c_str();
+}
+
+RateLimited::RateLimited(const string &what): BadRequest(what) {}
+
+/*
+* Ограниченное по размеру отображение с вытеснением давно не используемых
+* записей. Не потокобезопасно, блокировка остается на вызывающем.
+*/
+template <typename Value>
+class LruMap {
+public:
+	explicit LruMap(size_t capacity): m_capacity(capacity), m_evictions(0) {}
+
+	Value *Find(const string &key) {
+		auto it = m_index.find(key);
+		if (it == m_index.end())
+			return nullptr;
+		m_items.splice(m_items.begin(), m_items, it->second);
+		return &it->second->second;
+	}
+
+	void Put(const string &key, const Value &value) {
+		auto it = m_index.find(key);
+		if (it != m_index.end()) {
+			it->second->second = value;
+			m_items.splice(m_items.begin(), m_items, it->second);
+			return;
+		}
+		m_items.emplace_front(key, value);
+		m_index[key] = m_items.begin();
+		Trim();
+	}
+
+	void Erase(const string &key) {
+		auto it = m_index.find(key);
+		if (it == m_index.end())
+			return;
+		m_items.erase(it->second);
+		m_index.erase(it);
+	}
+
+	template <typename Predicate>
+	void EraseIf(Predicate predicate) {
+		for (auto it = m_items.begin(); it != m_items.end();) {
+			if (predicate(it->second)) {
+				m_index.erase(it->first);
+				it = m_items.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	void Clear() {
+		m_items.clear();
+		m_index.clear();
+	}
+
+	void SetCapacity(size_t capacity) {
+		m_capacity = capacity;
+		Trim();
+	}
+
+	size_t Size() const {
+		return m_index.size();
+	}
+
+	uint64_t Evictions() const {
+		return m_evictions;
+	}
+
+private:
+	void Trim() {
+		while (m_index.size() > m_capacity) {
+			m_index.erase(m_items.back().first);
+			m_items.pop_back();
+			++m_evictions;
+		}
+	}
+
+	typedef std::list<std::pair<string, Value>> Items;
+
+	size_t m_capacity;
+	uint64_t m_evictions;
+	Items m_items;
+	std::unordered_map<string, typename Items::iterator> m_index;
+};
+
+class ResponseCacheStore {
+public:
+	static ResponseCacheStore &Instance() {
+		static ResponseCacheStore instance;
+		return instance;
+	}
+
+	bool Enabled() const {
+		return m_enabled.load(std::memory_order_relaxed);
+	}
+
+	void Enable(size_t max_entries) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.SetCapacity(max_entries);
+		m_enabled = true;
+	}
+
+	void Disable() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_enabled = false;
+		m_entries.Clear();
+	}
+
+	void SetTTL(ResponseCache::Endpoint endpoint, std::chrono::seconds ttl) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_ttl[endpoint] = ttl;
+	}
+
+	bool Find(const string &key, JsonValue &value) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry *entry = m_entries.Find(key);
+		if (entry == nullptr || entry->expires <= std::chrono::steady_clock::now()) {
+			if (entry != nullptr)
+				m_entries.Erase(key);
+			++m_misses;
+			return false;
+		}
+		++m_hits;
+		value = entry->value;
+		return true;
+	}
+
+	void Store(ResponseCache::Endpoint endpoint, const string &key, const JsonValue &value) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_enabled)
+			return;
+		m_entries.Put(key, Entry{endpoint, std::chrono::steady_clock::now() + m_ttl[endpoint], value});
+	}
+
+	void Invalidate(ResponseCache::Endpoint endpoint) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.EraseIf([endpoint](const Entry &entry) { return entry.endpoint == endpoint; });
+	}
+
+	void Clear() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.Clear();
+	}
+
+	ResponseCache::Stats GetStats() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return ResponseCache::Stats{m_hits, m_misses, m_entries.Evictions(), m_entries.Size()};
+	}
+
+private:
+	struct Entry {
+		ResponseCache::Endpoint endpoint;
+		std::chrono::steady_clock::time_point expires;
+		JsonValue value;
+	};
+
+	ResponseCacheStore(): m_enabled(false), m_entries(0), m_hits(0), m_misses(0) {
+		m_ttl[ResponseCache::epLocations] = std::chrono::hours(1);
+		m_ttl[ResponseCache::epImages] = std::chrono::minutes(10);
+		m_ttl[ResponseCache::epRPlans] = std::chrono::hours(1);
+		m_ttl[ResponseCache::epBillingPrices] = std::chrono::minutes(10);
+	}
+
+	std::atomic<bool> m_enabled;
+	std::mutex m_mutex;
+	LruMap<Entry> m_entries;
+	std::chrono::seconds m_ttl[ResponseCache::epBillingPrices + 1];
+	uint64_t m_hits, m_misses;
+};
+
+void ResponseCache::Enable(size_t max_entries) {
+	ResponseCacheStore::Instance().Enable(max_entries);
+}
+
+void ResponseCache::Disable() {
+	ResponseCacheStore::Instance().Disable();
+}
+
+void ResponseCache::SetTTL(Endpoint endpoint, std::chrono::seconds ttl) {
+	ResponseCacheStore::Instance().SetTTL(endpoint, ttl);
+}
+
+void ResponseCache::Invalidate(Endpoint endpoint) {
+	ResponseCacheStore::Instance().Invalidate(endpoint);
+}
+
+void ResponseCache::Clear() {
+	ResponseCacheStore::Instance().Clear();
+}
+
+ResponseCache::Stats ResponseCache::GetStats() {
+	return ResponseCacheStore::Instance().GetStats();
+}
+
+/*
+* Хранилище валидаторов (ETag, Last-Modified) и разобранных ответов для
+* повторных GET-запросов списков. При ответе 304 Not Modified возвращается
+* сохраненный ответ без повторной загрузки и разбора тела.
+*/
+class ValidatorStore {
+public:
+	typedef std::shared_ptr<const JsonValue> Snapshot;
+
+	struct Validator {
+		string etag, last_modified;
+		Snapshot response;
+	};
+
+	static ValidatorStore &Instance() {
+		static ValidatorStore instance;
+		return instance;
+	}
+
+	bool Find(const string &key, Validator &validator) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Validator *found = m_validators.Find(key);
+		if (found == nullptr)
+			return false;
+		validator = *found;
+		return true;
+	}
+
+	void Store(const string &key, const HttpRequest &http, const JsonValue &response) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (http.ETag().empty() && http.LastModified().empty()) {
+			m_validators.Erase(key);
+			return;
+		}
+		m_validators.Put(key, Validator{http.ETag(), http.LastModified(), std::make_shared<JsonValue>(response)});
+	}
+
+private:
+	ValidatorStore(): m_validators(VALIDATOR_CACHE_CAPACITY) {}
+
+	std::mutex m_mutex;
+	LruMap<Validator> m_validators;
+};
+
+class RetryStore {
+public:
+	static RetryStore &Instance() {
+		static RetryStore instance;
+		return instance;
+	}
+
+	void Enable(unsigned max_attempts, std::chrono::milliseconds base_delay,
+			std::chrono::milliseconds max_delay, std::chrono::milliseconds budget) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_max_attempts = std::max(max_attempts, 1u);
+		m_base_delay = base_delay;
+		m_max_delay = std::max(max_delay, base_delay);
+		m_budget = budget;
+	}
+
+	void Disable() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_max_attempts = 1;
+	}
+
+	void Get(unsigned &max_attempts, std::chrono::milliseconds &base_delay,
+			std::chrono::milliseconds &max_delay, std::chrono::milliseconds &budget) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		max_attempts = m_max_attempts;
+		base_delay = m_base_delay;
+		max_delay = m_max_delay;
+		budget = m_budget;
+	}
+
+	RetryPolicy::Stats GetStats() const {
+		return RetryPolicy::Stats{m_retries.load(), m_give_ups.load()};
+	}
+
+	std::atomic<uint64_t> m_retries, m_give_ups;
+
+private:
+	RetryStore(): m_retries(0), m_give_ups(0), m_max_attempts(3), m_base_delay(100),
+			m_max_delay(5000), m_budget(30000) {}
+
+	std::mutex m_mutex;
+	unsigned m_max_attempts;
+	std::chrono::milliseconds m_base_delay, m_max_delay, m_budget;
+};
+
+void RetryPolicy::Enable(unsigned max_attempts, std::chrono::milliseconds base_delay,
+		std::chrono::milliseconds max_delay, std::chrono::milliseconds budget) {
+	RetryStore::Instance().Enable(max_attempts, base_delay, max_delay, budget);
+}
+
+void RetryPolicy::Disable() {
+	RetryStore::Instance().Disable();
+}
+
+RetryPolicy::Stats RetryPolicy::GetStats() {
+	return RetryStore::Instance().GetStats();
+}
+
+/*
+* Состояние повторов одного вызова. Задержка выбирается по схеме
+* decorrelated jitter: случайно между base_delay и утроенной предыдущей
+* задержкой, но не больше max_delay. Retry-After сервера увеличивает ее.
+* Неидемпотентные запросы (POST, PATCH) не повторяются.
+*/
+class RetryState {
+public:
+	explicit RetryState(HttpRequest::MethodRequest method)
+		: m_idempotent(method == HttpRequest::mrGET || method == HttpRequest::mrPUT || method == HttpRequest::mrDELETE),
+		  m_attempt(1), m_start(std::chrono::steady_clock::now()), m_delay(0) {}
+
+	/// Нужно ли повторить запрос и через какое время
+	bool Next(const HttpRequest &http, CURLcode code, std::chrono::milliseconds &delay) {
+		if (!m_idempotent || !http.Transient(code))
+			return false;
+
+		RetryStore &store = RetryStore::Instance();
+		unsigned max_attempts;
+		std::chrono::milliseconds base_delay, max_delay, budget;
+		store.Get(max_attempts, base_delay, max_delay, budget);
+		if (max_attempts <= 1)
+			return false;
+
+		if (m_attempt >= max_attempts) {
+			++store.m_give_ups;
+			return false;
+		}
+
+		static thread_local std::minstd_rand random((unsigned) std::hash<std::thread::id>()(std::this_thread::get_id())
+				^ (unsigned) std::chrono::steady_clock::now().time_since_epoch().count());
+		typedef std::chrono::milliseconds::rep Rep;
+		const Rep lower = base_delay.count();
+		const Rep upper = std::max(lower, m_delay.count() * 3);
+		m_delay = std::chrono::milliseconds(std::min(max_delay.count(),
+				std::uniform_int_distribution<Rep>(lower, upper)(random)));
+		m_delay = std::max(m_delay, http.RetryAfter());
+
+		if (std::chrono::steady_clock::now() + m_delay - m_start > budget) {
+			++store.m_give_ups;
+			return false;
+		}
+
+		++m_attempt;
+		++store.m_retries;
+		delay = m_delay;
+		return true;
+	}
+
+private:
+	bool m_idempotent;
+	unsigned m_attempt;
+	std::chrono::steady_clock::time_point m_start;
+	std::chrono::milliseconds m_delay;
+};
+
+/*
+* Ограничитель частоты запросов: ведро на каждый токен. При ожидании место
+* резервируется сразу (уровень ведра уходит в минус), поэтому ожидающие
+* потоки выстраиваются в очередь с интервалом 1/rate и суммарная частота
+* держится на допустимом максимуме, а не колеблется.
+*/
+class RateLimiter {
+public:
+	static RateLimiter &Instance() {
+		static RateLimiter instance;
+		return instance;
+	}
+
+	void Enable(double rate, unsigned burst, RateLimit::Policy policy) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_rate = rate;
+		m_burst = std::max(burst, 1u);
+		m_policy = policy;
+		m_buckets.clear();
+		m_enabled = rate > 0;
+	}
+
+	void Disable() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_enabled = false;
+		m_buckets.clear();
+	}
+
+	/*
+	* Занимает место в ведре токена и возвращает, сколько нужно подождать
+	* перед отправкой запроса. При политике rpFailFast генерирует RateLimited.
+	*/
+	std::chrono::milliseconds Acquire(const string &token) {
+		if (!m_enabled.load(std::memory_order_relaxed))
+			return std::chrono::milliseconds(0);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_enabled)
+			return std::chrono::milliseconds(0);
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		auto inserted = m_buckets.emplace(token, Bucket{(double) m_burst, now});
+		Bucket &bucket = inserted.first->second;
+		if (!inserted.second) {
+			const double elapsed = std::chrono::duration<double>(now - bucket.updated).count();
+			bucket.level = std::min((double) m_burst, bucket.level + elapsed * m_rate);
+			bucket.updated = now;
+		}
+
+		if (bucket.level >= 1) {
+			bucket.level -= 1;
+			return std::chrono::milliseconds(0);
+		}
+		if (m_policy == RateLimit::rpFailFast) {
+			++m_rejected;
+			throw RateLimited(RATE_LIMITED_MESSAGE);
+		}
+		bucket.level -= 1;
+		++m_delayed;
+		return std::chrono::milliseconds((long long) std::ceil(-bucket.level / m_rate * 1000));
+	}
+
+	RateLimit::Stats GetStats() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return RateLimit::Stats{m_delayed, m_rejected};
+	}
+
+private:
+	struct Bucket {
+		double level;
+		std::chrono::steady_clock::time_point updated;
+	};
+
+	RateLimiter(): m_enabled(false), m_rate(0), m_burst(1), m_policy(RateLimit::rpBlock),
+			m_delayed(0), m_rejected(0) {}
+
+	std::atomic<bool> m_enabled;
+	std::mutex m_mutex;
+	double m_rate;
+	unsigned m_burst;
+	RateLimit::Policy m_policy;
+	std::unordered_map<string, Bucket> m_buckets;
+	uint64_t m_delayed, m_rejected;
+};
+
+void RateLimit::Enable(double requests_per_second, unsigned burst, Policy policy) {
+	RateLimiter::Instance().Enable(requests_per_second, burst, policy);
+}
+
+void RateLimit::Disable() {
+	RateLimiter::Instance().Disable();
+}
+
+RateLimit::Stats RateLimit::GetStats() {
+	return RateLimiter::Instance().GetStats();
+}
+
+/*
+* Хранилище метрик. Таблица шаблонов методов с открытой адресацией
+* заполняется через compare-and-swap, счетчики и корзины гистограмм -
+* атомарные, поэтому запись метрик не требует блокировок. Если таблица
+* заполнена, метрики учитываются в общей записи "other".
+*/
+class MetricsRegistry {
+public:
+	static MetricsRegistry &Instance() {
+		static MetricsRegistry instance;
+		return instance;
+	}
+
+	bool Enabled() const {
+		return m_enabled.load(std::memory_order_relaxed);
+	}
+
+	void SetEnabled(bool enabled) {
+		m_enabled = enabled;
+	}
+
+	void SetSink(const std::shared_ptr<Metrics::Sink> &sink) {
+		std::atomic_store(&m_sink, sink);
+		m_has_sink = (bool) sink;
+	}
+
+	/// Учитывает завершившуюся попытку выполнения запроса
+	void Record(const char *endpoint, HttpRequest::MethodRequest method, const HttpRequest &http, CURLcode code) {
+		if (!Enabled())
+			return;
+
+		Metrics::Sample sample;
+		sample.method = HttpRequest::MethodName(method);
+		sample.status = http.ResponseCode();
+		sample.error = http.Failed(code);
+		http.Timings(sample.phases);
+		http.Transferred(sample.bytes_sent, sample.bytes_received);
+
+		Slot &slot = Find(endpoint);
+		slot.requests.fetch_add(1, std::memory_order_relaxed);
+		if (sample.error)
+			slot.errors.fetch_add(1, std::memory_order_relaxed);
+		slot.bytes_sent.fetch_add(sample.bytes_sent, std::memory_order_relaxed);
+		slot.bytes_received.fetch_add(sample.bytes_received, std::memory_order_relaxed);
+		for (int phase = 0; phase < Metrics::phCount; ++phase) {
+			const uint64_t value = (uint64_t) std::max<int64_t>(sample.phases[phase], 0);
+			slot.sums[phase].fetch_add(value, std::memory_order_relaxed);
+			slot.buckets[phase][Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		if (m_has_sink.load(std::memory_order_relaxed)) {
+			std::shared_ptr<Metrics::Sink> sink = std::atomic_load(&m_sink);
+			if (sink) {
+				try {
+					sample.endpoint = endpoint;
+					sink->Record(sample);
+				} catch (...) {}
+			}
+		}
+	}
+
+	std::vector<Metrics::Endpoint> Snapshot() const {
+		std::vector<Metrics::Endpoint> result;
+		for (const Slot &slot : m_slots) {
+			const string *name = slot.name.load(std::memory_order_acquire);
+			if (name == nullptr || slot.requests.load(std::memory_order_relaxed) == 0)
+				continue;
+			Metrics::Endpoint endpoint;
+			endpoint.endpoint = *name;
+			endpoint.requests = slot.requests.load(std::memory_order_relaxed);
+			endpoint.errors = slot.errors.load(std::memory_order_relaxed);
+			endpoint.bytes_sent = slot.bytes_sent.load(std::memory_order_relaxed);
+			endpoint.bytes_received = slot.bytes_received.load(std::memory_order_relaxed);
+			for (int phase = 0; phase < Metrics::phCount; ++phase) {
+				Metrics::Histogram &histogram = endpoint.phases[phase];
+				histogram.buckets.resize(METRICS_BUCKETS);
+				histogram.count = 0;
+				histogram.sum = slot.sums[phase].load(std::memory_order_relaxed);
+				for (size_t i = 0; i < METRICS_BUCKETS; ++i) {
+					histogram.buckets[i] = slot.buckets[phase][i].load(std::memory_order_relaxed);
+					histogram.count += histogram.buckets[i];
+				}
+			}
+			result.push_back(std::move(endpoint));
+		}
+		return result;
+	}
+
+	void Reset() {
+		for (Slot &slot : m_slots) {
+			slot.requests = 0;
+			slot.errors = 0;
+			slot.bytes_sent = 0;
+			slot.bytes_received = 0;
+			for (int phase = 0; phase < Metrics::phCount; ++phase) {
+				slot.sums[phase] = 0;
+				for (auto &bucket : slot.buckets[phase])
+					bucket = 0;
+			}
+		}
+	}
+
+private:
+	struct Slot {
+		std::atomic<uint64_t> key;
+		std::atomic<const string *> name;
+		std::atomic<uint64_t> requests, errors, bytes_sent, bytes_received;
+		std::atomic<uint64_t> sums[Metrics::phCount];
+		std::atomic<uint64_t> buckets[Metrics::phCount][METRICS_BUCKETS];
+	};
+
+	MetricsRegistry(): m_enabled(true), m_has_sink(false) {
+		for (Slot &slot : m_slots) {
+			slot.key = 0;
+			slot.name = nullptr;
+		}
+		Reset();
+		m_slots[METRICS_MAX_ENDPOINTS].key = 1;
+		m_slots[METRICS_MAX_ENDPOINTS].name = new string(METRICS_OTHER_ENDPOINT);
+	}
+
+	~MetricsRegistry() {
+		for (Slot &slot : m_slots)
+			delete slot.name.load();
+	}
+
+	MetricsRegistry(const MetricsRegistry &) = delete;
+	MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+	static size_t Bucket(uint64_t value) {
+		size_t bucket = 0;
+		while (value > 1 && bucket + 1 < METRICS_BUCKETS) {
+			value >>= 1;
+			++bucket;
+		}
+		return bucket;
+	}
+
+	Slot &Find(const char *endpoint) {
+		// Ключи 0 (свободная запись) и 1 ("other") зарезервированы
+		const uint64_t key = std::max<uint64_t>(Fnv1a(FNV_OFFSET_BASIS, endpoint, strlen(endpoint)), 2);
+
+		for (size_t i = 0; i < METRICS_MAX_ENDPOINTS; ++i) {
+			Slot &slot = m_slots[(key + i) % METRICS_MAX_ENDPOINTS];
+			uint64_t current = slot.key.load(std::memory_order_acquire);
+			if (current == 0 && slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+				slot.name.store(new string(endpoint), std::memory_order_release);
+				return slot;
+			}
+			if (current == key)
+				return slot;
+		}
+		return m_slots[METRICS_MAX_ENDPOINTS];
+	}
+
+	std::atomic<bool> m_enabled, m_has_sink;
+	std::shared_ptr<Metrics::Sink> m_sink;
+	Slot m_slots[METRICS_MAX_ENDPOINTS + 1];
+};
+
+uint64_t Metrics::Histogram::Percentile(double q) const {
+	if (count == 0 || buckets.empty())
+		return 0;
+	const uint64_t rank = (uint64_t) std::ceil(std::min(std::max(q, 0.0), 1.0) * count);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < buckets.size(); ++i) {
+		seen += buckets[i];
+		if (seen >= rank && seen > 0)
+			return (uint64_t(2) << i) - 1;
+	}
+	return (uint64_t(2) << (buckets.size() - 1)) - 1;
+}
+
+void Metrics::Enable() {
+	MetricsRegistry::Instance().SetEnabled(true);
+}
+
+void Metrics::Disable() {
+	MetricsRegistry::Instance().SetEnabled(false);
+}
+
+void Metrics::SetSink(std::shared_ptr<Sink> sink) {
+	MetricsRegistry::Instance().SetSink(sink);
+}
+
+std::vector<Metrics::Endpoint> Metrics::Snapshot() {
+	return MetricsRegistry::Instance().Snapshot();
+}
+
+void Metrics::Reset() {
+	MetricsRegistry::Instance().Reset();
+}
+
+/*
+* Таблица выполняющихся GET-запросов. Первый вызов с данным ключом
+* становится ведущим и выполняет запрос, остальные только добавляют
+* свои обработчики, которые вызываются с тем же результатом.
+*/
+class FlightTable {
+public:
+	static FlightTable &Instance() {
+		static FlightTable instance;
+		return instance;
+	}
+
+	bool Enabled() const {
+		return m_enabled.load(std::memory_order_relaxed);
+	}
+
+	void SetEnabled(bool enabled) {
+		m_enabled = enabled;
+	}
+
+	/// Добавляет обработчик к запросу key. Возвращает true, если запрос нужно выполнить
+	bool Join(const string &key, const Completion &waiter) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto inserted = m_flights.emplace(key, std::vector<Completion>());
+		inserted.first->second.push_back(waiter);
+		if (inserted.second)
+			++m_flights_count;
+		else
+			++m_coalesced;
+		return inserted.second;
+	}
+
+	/// Завершает запрос key и передает результат всем ожидающим
+	void Land(const string &key, const JsonValue &response, std::exception_ptr error) {
+		std::vector<Completion> waiters;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_flights.find(key);
+			if (it == m_flights.end())
+				return;
+			waiters.swap(it->second);
+			m_flights.erase(it);
+		}
+		for (auto &waiter : waiters)
+			waiter(response, error);
+	}
+
+	SingleFlight::Stats GetStats() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return SingleFlight::Stats{m_flights_count, m_coalesced};
+	}
+
+private:
+	FlightTable(): m_enabled(true), m_flights_count(0), m_coalesced(0) {}
+
+	std::atomic<bool> m_enabled;
+	std::mutex m_mutex;
+	std::unordered_map<string, std::vector<Completion>> m_flights;
+	uint64_t m_flights_count, m_coalesced;
+};
+
+void SingleFlight::Enable() {
+	FlightTable::Instance().SetEnabled(true);
+}
+
+void SingleFlight::Disable() {
+	FlightTable::Instance().SetEnabled(false);
+}
+
+SingleFlight::Stats SingleFlight::GetStats() {
+	return FlightTable::Instance().GetStats();
+}
+
+/// Методы API, описанные в таблице ROUTES
+enum RouteId {
+	rtAccountInfo,
+	rtScaletsList,
+	rtScaletsCreate,
+	rtScaletsDelete,
+	rtScaletsInfo,
+	rtScaletsRestart,
+	rtScaletsRebuild,
+	rtScaletsStop,
+	rtScaletsStart,
+	rtScaletsUpgrade,
+	rtScaletsBackup,
+	rtTasksList,
+	rtServerTagsList,
+	rtServerTagsCreate,
+	rtServerTagsUpdate,
+	rtServerTagsDelete,
+	rtBackupList,
+	rtBackupDelete,
+	rtBackupInfo,
+	rtLocations,
+	rtImages,
+	rtRPlans,
+	rtBillingPrices,
+	rtSSHKeysList,
+	rtSSHKeysCreate,
+	rtSSHKeysDelete,
+	rtNotificationsInfo,
+	rtNotificationsUpdate,
+	rtBillingBalance,
+	rtBillingPayments,
+	rtBillingConsumption,
+	rtDomainList,
+	rtDomainCreate,
+	rtDomainUpdate,
+	rtDomainDelete,
+	rtDomainInfo,
+	rtDomainRecordList,
+	rtDomainRecordCreate,
+	rtDomainRecordUpdate,
+	rtDomainRecordDelete,
+	rtDomainRecordInfo,
+	rtDomainTagsList,
+	rtDomainTagsCreate,
+	rtDomainTagsUpdate,
+	rtDomainTagsDelete,
+	rtDomainTagsInfo,
+	rtPTRRecordsList,
+	rtPTRRecordsCreate,
+	rtPTRRecordsUpdate,
+	rtPTRRecordsDelete,
+	rtPTRRecordsInfo,
+	rtCount
+};
+
+/// Требование метода API к телу запроса
+enum RouteBody {
+	/// Без тела
+	rbNone,
+	/// Переданный объект параметров
+	rbParams,
+	/// {"id": "<первый параметр пути>"}
+	rbId
+};
+
+/*
+* Описание метода API: HTTP-метод, шаблон пути от базового адреса API
+* и требование к телу запроса. Параметры шаблона {...} подставляются
+* по порядку. Путь без префикса версии служит именем метода в метриках
+* и трассировке.
+*/
+struct Route {
+	RouteId id;
+	HttpRequest::MethodRequest method;
+	const char *path;
+	RouteBody body;
+	/// Повторный GET выполняется условно (If-None-Match, If-Modified-Since)
+	bool revalidate;
+};
+
+constexpr Route ROUTES[] = {
+	{rtAccountInfo, 	HttpRequest::mrGET, 	"/v1/account", 					rbNone, 	false},
+	{rtScaletsList, 	HttpRequest::mrGET, 	"/v1/scalets", 					rbNone, 	true},
+	{rtScaletsCreate, 	HttpRequest::mrPOST, 	"/v1/scalets", 					rbParams, 	false},
+	{rtScaletsDelete, 	HttpRequest::mrDELETE, 	"/v1/scalets/{id}", 				rbNone, 	false},
+	{rtScaletsInfo, 	HttpRequest::mrGET, 	"/v1/scalets/{id}", 				rbNone, 	false},
+	{rtScaletsRestart, 	HttpRequest::mrPATCH, 	"/v1/scalets/{id}/restart", 			rbId, 		false},
+	{rtScaletsRebuild, 	HttpRequest::mrPATCH, 	"/v1/scalets/{id}/rebuild", 			rbParams, 	false},
+	{rtScaletsStop, 	HttpRequest::mrPATCH, 	"/v1/scalets/{id}/stop", 			rbId, 		false},
+	{rtScaletsStart, 	HttpRequest::mrPATCH, 	"/v1/scalets/{id}/start", 			rbId, 		false},
+	{rtScaletsUpgrade, 	HttpRequest::mrPOST, 	"/v1/scalets/{id}/upgrade", 			rbParams, 	false},
+	{rtScaletsBackup, 	HttpRequest::mrPOST, 	"/v1/scalets/{id}/backup", 			rbParams, 	false},
+	{rtTasksList, 		HttpRequest::mrGET, 	"/v1/tasks", 					rbNone, 	false},
+	{rtServerTagsList, 	HttpRequest::mrGET, 	"/v1/scalets/tags", 				rbNone, 	true},
+	{rtServerTagsCreate, 	HttpRequest::mrPOST, 	"/v1/scalets/tags", 				rbParams, 	false},
+	{rtServerTagsUpdate, 	HttpRequest::mrPUT, 	"/v1/scalets/tags/{id}", 			rbParams, 	false},
+	{rtServerTagsDelete, 	HttpRequest::mrDELETE, 	"/v1/scalets/tags/{id}", 			rbNone, 	false},
+	{rtBackupList, 		HttpRequest::mrGET, 	"/v1/backups", 					rbNone, 	true},
+	{rtBackupDelete, 	HttpRequest::mrDELETE, 	"/v1/backups/{id}", 				rbNone, 	false},
+	{rtBackupInfo, 		HttpRequest::mrGET, 	"/v1/backups/{id}", 				rbNone, 	false},
+	{rtLocations, 		HttpRequest::mrGET, 	"/v1/locations", 				rbNone, 	false},
+	{rtImages, 		HttpRequest::mrGET, 	"/v1/images", 					rbNone, 	false},
+	{rtRPlans, 		HttpRequest::mrGET, 	"/v1/rplans", 					rbNone, 	false},
+	{rtBillingPrices, 	HttpRequest::mrGET, 	"/v1/billing/prices", 				rbNone, 	false},
+	{rtSSHKeysList, 	HttpRequest::mrGET, 	"/v1/sshkeys", 					rbNone, 	true},
+	{rtSSHKeysCreate, 	HttpRequest::mrPOST, 	"/v1/sshkeys", 					rbParams, 	false},
+	{rtSSHKeysDelete, 	HttpRequest::mrDELETE, 	"/v1/sshkeys/{id}", 				rbNone, 	false},
+	{rtNotificationsInfo, 	HttpRequest::mrGET, 	"/v1/billing/notify", 				rbNone, 	false},
+	{rtNotificationsUpdate, HttpRequest::mrPUT, 	"/v1/billing/notify", 				rbParams, 	false},
+	{rtBillingBalance, 	HttpRequest::mrGET, 	"/v1/billing/balance", 				rbNone, 	false},
+	{rtBillingPayments, 	HttpRequest::mrGET, 	"/v1/billing/payments", 			rbNone, 	false},
+	{rtBillingConsumption, 	HttpRequest::mrGET, 	"/v1/billing/consumption?start={start}&end={end}", rbNone, false},
+	{rtDomainList, 		HttpRequest::mrGET, 	"/v1/domains/", 				rbNone, 	true},
+	{rtDomainCreate, 	HttpRequest::mrPOST, 	"/v1/domains/", 				rbParams, 	false},
+	{rtDomainUpdate, 	HttpRequest::mrPATCH, 	"/v1/domains/{id}", 				rbParams, 	false},
+	{rtDomainDelete, 	HttpRequest::mrDELETE, 	"/v1/domains/{id}", 				rbNone, 	false},
+	{rtDomainInfo, 		HttpRequest::mrGET, 	"/v1/domains/{id}", 				rbNone, 	false},
+	{rtDomainRecordList, 	HttpRequest::mrGET, 	"/v1/domains/{domain_id}/records", 		rbNone, 	true},
+	{rtDomainRecordCreate, 	HttpRequest::mrPOST, 	"/v1/domains/{domain_id}/records", 		rbParams, 	false},
+	{rtDomainRecordUpdate, 	HttpRequest::mrPOST, 	"/v1/domains/{domain_id}/records/{record_id}", 	rbParams, 	false},
+	{rtDomainRecordDelete, 	HttpRequest::mrDELETE, 	"/v1/domains/{domain_id}/records/{record_id}", 	rbNone, 	false},
+	{rtDomainRecordInfo, 	HttpRequest::mrGET, 	"/v1/domains/{domain_id}/records/{record_id}", 	rbNone, 	false},
+	{rtDomainTagsList, 	HttpRequest::mrGET, 	"/v1/domains/tags/", 				rbNone, 	true},
+	{rtDomainTagsCreate, 	HttpRequest::mrPOST, 	"/v1/domains/tags/", 				rbParams, 	false},
+	{rtDomainTagsUpdate, 	HttpRequest::mrPUT, 	"/v1/domains/tags/{id}", 			rbParams, 	false},
+	{rtDomainTagsDelete, 	HttpRequest::mrDELETE, 	"/v1/domains/tags/{id}", 			rbNone, 	false},
+	{rtDomainTagsInfo, 	HttpRequest::mrGET, 	"/v1/domains/tags/{id}", 			rbNone, 	false},
+	{rtPTRRecordsList, 	HttpRequest::mrGET, 	"/v1/domains/ptr/", 				rbNone, 	true},
+	{rtPTRRecordsCreate, 	HttpRequest::mrPOST, 	"/v1/domains/ptr/", 				rbParams, 	false},
+	{rtPTRRecordsUpdate, 	HttpRequest::mrPUT, 	"/v1/domains/ptr/{id}", 			rbParams, 	false},
+	{rtPTRRecordsDelete, 	HttpRequest::mrDELETE, 	"/v1/domains/ptr/{id}", 			rbNone, 	false},
+	{rtPTRRecordsInfo, 	HttpRequest::mrGET, 	"/v1/domains/ptr/{id}", 			rbNone, 	false}
+};
+
+/// Таблица упорядочена по RouteId и все пути начинаются с префикса версии API
+constexpr bool RoutesValid(size_t index = 0) {
+	return index == rtCount || (ROUTES[index].id == (RouteId) index
+			&& ROUTES[index].path[0] == '/' && ROUTES[index].path[1] == 'v' && ROUTES[index].path[2] == '1'
+			&& ROUTES[index].path[3] == '/' && RoutesValid(index + 1));
+}
+
+static_assert(sizeof(ROUTES) / sizeof(ROUTES[0]) == rtCount, "every RouteId needs a route");
+static_assert(RoutesValid(), "ROUTES must be ordered by RouteId");
+
+/// Количество параметров в шаблоне пути
+constexpr size_t RouteParams(const char *path) {
+	return *path == '\0' ? 0 : (*path == '{' ? 1 : 0) + RouteParams(path + 1);
+}
+
+/// Имя метода API для метрик и трассировки: путь без префикса версии
+inline const char *RouteEndpoint(const Route &route) {
+	return route.path + sizeof(VSCALE_API_PREFIX) - 1;
+}
+
+/// Значение параметра шаблона пути: число или строка
+class RouteArg {
+public:
+	RouteArg(): m_text(nullptr), m_size(0), m_number(0) {}
+	RouteArg(int value): m_text(nullptr), m_size(0), m_number(value) {}
+	RouteArg(const string &value): m_text(value.data()), m_size(value.size()), m_number(0) {}
+
+	/// Записывает значение в буфер размера size, false - если не помещается
+	bool Write(char *out, size_t size, size_t &written) const {
+		if (m_text == nullptr) {
+			const int result = snprintf(out, size, "%d", m_number);
+			written = result > 0 ? (size_t) result : 0;
+			return result > 0 && written < size;
+		}
+		written = m_size;
+		if (m_size >= size)
+			return false;
+		memcpy(out, m_text, m_size);
+		return true;
+	}
+
+private:
+	const char *m_text;
+	size_t m_size;
+	int m_number;
+};
+
+/*
+* Запрос к методу API. Адрес (базовый адрес и шаблон пути с подставленными
+* параметрами) форматируется в буфер фиксированного размера без выделения
+* памяти, тело запроса записывается в буфер хендла при настройке.
+*/
+struct Request {
+	const Route *route;
+	const JsonValue *params;
+	RouteArg first;
+	char url[ROUTE_URL_BUFFER_SIZE];
+
+	void Format(const string &base, const RouteArg *args) {
+		char *out = url;
+		size_t left = sizeof(url), written = 0;
+		bool fits = base.size() < left;
+		if (fits) {
+			memcpy(out, base.data(), base.size());
+			out += base.size();
+			left -= base.size();
+		}
+		for (const char *c = route->path; fits && *c != '\0'; ++c) {
+			if (*c != '{') {
+				fits = left > 1;
+				if (fits) {
+					*out++ = *c;
+					--left;
+				}
+				continue;
+			}
+			while (*c != '}')
+				++c;
+			fits = (args++)->Write(out, left, written);
+			if (fits) {
+				out += written;
+				left -= written;
+			}
+		}
+		if (!fits)
+			throw BadRequest(URL_TOO_LONG_MESSAGE);
+		*out = '\0';
+	}
 
-namespace vscale {
+	const char *Endpoint() const {
+		return RouteEndpoint(*route);
+	}
+};
 
-class HttpRequest {
-public:
-	enum MethodRequest {
-		mrGET,
-		mrPOST,
-		mrPUT,
-		mrPATCH,
-		mrDELETE
-	};
+struct VscalePrivateData::PrivateData: std::enable_shared_from_this<PrivateData> {
+	string token;
+	/// Заголовки запросов клиента строятся один раз: с токеном и с токеном и Content-Type JSON
+	struct curl_slist *headers, *json_headers;
+
+	explicit PrivateData(const string &token): token(token), headers(nullptr), json_headers(nullptr) {
+		const string line = HEADER_TOKEN + token;
+		headers = curl_slist_append(nullptr, line.c_str());
+		json_headers = curl_slist_append(nullptr, line.c_str());
+		if (json_headers != nullptr)
+			json_headers = curl_slist_append(json_headers, HEADER_APPLICATION_JSON);
+	}
 
-	HttpRequest(): m_headers(nullptr) {
-		m_curl = curl_easy_init();
+	~PrivateData() {
+		curl_slist_free_all(headers);
+		curl_slist_free_all(json_headers);
 	}
 
-	~HttpRequest() {
-		ClearHeaders();
+	PrivateData(const PrivateData &) = delete;
+	PrivateData &operator=(const PrivateData &) = delete;
+
+	/*
+	* Запрос к методу API из таблицы ROUTES. Количество параметров пути
+	* и наличие тела проверяются при компиляции: Call - для методов без
+	* параметров в теле, CallWith - для методов, принимающих объект параметров.
+	*/
+	template <RouteId id, typename... Args>
+	Request Call(const Args &... args) const {
+		static_assert(ROUTES[id].body != rbParams, "route requires params, use CallWith");
+		return Make<id>(nullptr, args...);
+	}
 
-		if (m_curl)
-			curl_easy_cleanup(m_curl);
+	template <RouteId id, typename... Args>
+	Request CallWith(const JsonValue &params, const Args &... args) const {
+		static_assert(ROUTES[id].body == rbParams, "route does not accept params, use Call");
+		return Make<id>(&params, args...);
 	}
 
-	HttpRequest &SetURL(const string &url) {
-		curl_easy_setopt(m_curl, CURLOPT_URL, url.c_str());
-		if (url.compare(0, 8 , "https://") == 0) {
-			curl_easy_setopt(m_curl, CURLOPT_SSL_VERIFYHOST, 0L);
-			curl_easy_setopt(m_curl, CURLOPT_SSL_VERIFYPEER, 0L);
-		}
-		return *this;
+	template <RouteId id, typename... Args>
+	Request Make(const JsonValue *params, const Args &... args) const {
+		static_assert(RouteParams(ROUTES[id].path) == sizeof...(Args), "route path parameters mismatch");
+		const RouteArg list[] = {RouteArg(args)..., RouteArg()};
+		Request request;
+		request.route = &ROUTES[id];
+		request.params = params;
+		request.first = list[0];
+		request.Format(*TransportOptions::Instance().BaseURL(), list);
+		return request;
 	}
 
-	HttpRequest &SetHeader(const string &value) {
-		m_headers = curl_slist_append(m_headers, value.c_str());
-		return *this;
+	/// Ключ запроса в кэшах и таблице совместного выполнения
+	string Key(const Request &request) const {
+		string key(request.url);
+		key.push_back('\n');
+		key.append(token);
+		return key;
 	}
 
-	HttpRequest &ClearHeaders() {
-		if (m_headers != nullptr) {
-			curl_slist_free_all(m_headers);
-			m_headers = nullptr;
-		}
-		return *this;
+	string ValidatorKey(const Request &request) const {
+		if (!request.route->revalidate)
+			return string();
+		return Key(request);
 	}
 
-	static size_t WriteFuncCallback(char *ptr, size_t size, size_t nmemb, void *userdata) {
-		size_t realsize = size * nmemb;
-		if (realsize <= 0)
-			return 0;
-		string *response = (string *) userdata;
-		response->reserve(realsize);
-		response->append(ptr);
+	/*
+	* Настраивает хендл на выполнение запроса. Для условного запроса
+	* возвращает ранее сохраненный ответ, который будет использован при 304.
+	* conditional - разрешить условный запрос, если метод его допускает.
+	*/
+	ValidatorStore::Snapshot Setup(HttpRequest &http, const Request &request, bool conditional = true) const {
+		const Route &route = *request.route;
+		http.SetURL(request.url).SetHeaders(route.method == HttpRequest::mrGET ? headers : json_headers);
+		http.SetTraceTarget(request.Endpoint(), request.url);
+		string &body = http.Body();
+		body.clear();
+		if (request.params != nullptr) {
+			WriteCompactJson(*request.params, body);
+		} else if (route.body == rbId) {
+			char id[ROUTE_URL_BUFFER_SIZE];
+			size_t size = 0;
+			request.first.Write(id, sizeof(id), size);
+			body.append("{\"id\": \"", 8).append(id, size).append("\"}", 2);
+		}
 
-		return realsize;
+		ValidatorStore::Validator validator;
+		if (!conditional || !route.revalidate || !ValidatorStore::Instance().Find(ValidatorKey(request), validator))
+			return ValidatorStore::Snapshot();
+		if (!validator.etag.empty())
+			http.AddHeader(HEADER_IF_NONE_MATCH, validator.etag);
+		if (!validator.last_modified.empty())
+			http.AddHeader(HEADER_IF_MODIFIED_SINCE, validator.last_modified);
+		return validator.response;
 	}
 
-	static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userdata) {
-		size_t realsize = size * nitems;
-		if (realsize <= 0)
-			return 0;
-		string res(buffer);
-		string *header = (string *) userdata;
-		while (!res.empty()) {
-			string::size_type pos = res.find("\n");
-			if (pos == string::npos)
-				return realsize;
-			else {
-				string tmp = res.substr(0, pos);
-				size_t len = strlen(VSCALE_ERROR_MESSAGE);
-				if (tmp.compare(0, len, VSCALE_ERROR_MESSAGE) == 0) {
-					header->append(tmp.substr(len + 1, tmp.size() - len));
-					return realsize;
+	/*
+	* Завершение запроса, общее для синхронного и асинхронного выполнения.
+	* Не обращается к объекту, так как может вызываться после его удаления.
+	*/
+	static JsonValue Finish(HttpRequest &http, CURLcode code, const string &validator_key,
+			const ValidatorStore::Snapshot &cached) {
+		const string &body = http.Complete(code);
+		if (validator_key.empty())
+			return ParseResponse(body);
+		if (http.NotModified()) {
+			if (!cached)
+				throw BadRequest(DEFAULT_BAD_REQUEST + std::to_string(NOT_MODIFIED_RESPONSE_CODE_304));
+			return *cached;
+		}
+		JsonValue response = ParseResponse(body);
+		ValidatorStore::Instance().Store(validator_key, http, response);
+		return response;
+	}
+
+	/*
+	* Обработчик завершения асинхронного запроса. При временной ошибке
+	* ставит хендл в очередь движка повторно с задержкой, не блокируя поток.
+	* Ожидание ограничителя частоты также выполняется отложенной отправкой.
+	*/
+	struct AsyncCall {
+		HttpRequest::MethodRequest method;
+		/// Держит общие заголовки клиента, пока хендл выполняет запрос
+		std::shared_ptr<const PrivateData> owner;
+		const char *endpoint;
+		string validator_key;
+		ValidatorStore::Snapshot cached;
+		Completion done;
+		std::shared_ptr<std::promise<JsonValue>> promise;
+		RetryState retry;
+
+		void Submit(HandlePool::Handle http, std::chrono::milliseconds delay) {
+			try {
+				delay = std::max(delay, RateLimiter::Instance().Acquire(owner->token));
+			} catch (...) {
+				Deliver(JsonValue(), std::current_exception());
+				return;
+			}
+			AsyncEngine::Instance().Submit(std::move(http), *this, delay);
+		}
+
+		void operator()(HandlePool::Handle &http, CURLcode code) {
+			MetricsRegistry::Instance().Record(endpoint, method, *http, code);
+			http->FinishTrace(code);
+			std::chrono::milliseconds delay;
+			if (retry.Next(*http, code, delay)) {
+				code = http->Prepare(method);
+				if (code == CURLE_OK) {
+					Submit(std::move(http), delay);
+					return;
 				}
-				res.erase(0, pos + 1);
 			}
+
+			JsonValue response;
+			std::exception_ptr error;
+			try {
+				response = Finish(*http, code, validator_key, cached);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			Deliver(response, error);
 		}
-		return realsize;
+
+		void Deliver(const JsonValue &response, std::exception_ptr error) {
+			if (done) {
+				try {
+					done(response, error);
+				} catch (...) {}
+			}
+			if (error)
+				promise->set_exception(error);
+			else
+				promise->set_value(response);
+		}
+	};
+
+	/*
+	* Совместное выполнение одинаковых GET-запросов: пока запрос выполняется,
+	* такие же запросы (тот же адрес и токен) не отправляются, а ждут его
+	* результата. В потоке ввода-вывода запросы не объединяются, чтобы
+	* синхронный вызов из обработчика завершения не ждал сам себя.
+	*/
+	string FlightKey(const Request &request) const {
+		if (request.route->method != HttpRequest::mrGET || !FlightTable::Instance().Enabled())
+			return string();
+		return Key(request);
 	}
 
-	string Perform(MethodRequest method=mrGET, const string &data="") {
-		CURLcode code;
-		switch (method) {
-			case mrGET:
-				code = curl_easy_setopt(m_curl, CURLOPT_HTTPGET, 1L);
-				break;
-			case mrPOST:
-				code = curl_easy_setopt(m_curl, CURLOPT_POST, 1L);
-				break;
-			case mrPUT:
-				code = curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "PUT");
-				break;
-			case mrPATCH:
-				code = curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "PATCH");
-				break;
-			case mrDELETE:
-				code = curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-				break;
-			default:
-				code = CURLE_FAILED_INIT;
+	JsonValue Perform(const Request &request) const {
+		const string key = FlightKey(request);
+		if (key.empty() || AsyncEngine::InIoThread())
+			return Execute(request);
+
+		std::shared_ptr<std::promise<JsonValue>> promise = std::make_shared<std::promise<JsonValue>>();
+		std::future<JsonValue> result = promise->get_future();
+		const bool leader = FlightTable::Instance().Join(key, [promise](const JsonValue &response, std::exception_ptr error) {
+			if (error)
+				promise->set_exception(error);
+			else
+				promise->set_value(response);
+		});
+		if (leader) {
+			JsonValue response;
+			std::exception_ptr error;
+			try {
+				response = Execute(request);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			FlightTable::Instance().Land(key, response, error);
 		}
+		return result.get();
+	}
 
-		if (code == CURLE_OK && !data.empty()) {
-			curl_easy_setopt(m_curl, CURLOPT_POSTFIELDSIZE, (long) strlen(data.c_str()));
-			code = curl_easy_setopt(m_curl, CURLOPT_POSTFIELDS, data.c_str());
+	std::future<JsonValue> PerformAsync(const Request &request, const Completion &done) const {
+		const string key = FlightKey(request);
+		if (key.empty())
+			return ExecuteAsync(request, done);
+
+		std::shared_ptr<std::promise<JsonValue>> promise = std::make_shared<std::promise<JsonValue>>();
+		std::future<JsonValue> result = promise->get_future();
+		Completion deliver = [promise, done](const JsonValue &response, std::exception_ptr error) {
+			if (done) {
+				try {
+					done(response, error);
+				} catch (...) {}
+			}
+			if (error)
+				promise->set_exception(error);
+			else
+				promise->set_value(response);
+		};
+		// Результат синхронного ведущего запроса приходит в его потоке, а
+		// обработчик завершения должен выполняться в потоке ввода-вывода
+		const bool leader = FlightTable::Instance().Join(key, [deliver](const JsonValue &response, std::exception_ptr error) {
+			if (AsyncEngine::InIoThread())
+				deliver(response, error);
+			else
+				AsyncEngine::Instance().Post([deliver, response, error] { deliver(response, error); });
+		});
+		if (leader) {
+			// Без Land запрос, не дошедший до движка, навсегда остался бы в таблице
+			try {
+				ExecuteAsync(request, [key](const JsonValue &response, std::exception_ptr error) {
+					FlightTable::Instance().Land(key, response, error);
+				});
+			} catch (...) {
+				FlightTable::Instance().Land(key, JsonValue(), std::current_exception());
+			}
 		}
+		return result;
+	}
 
-		if (m_headers != nullptr && code == CURLE_OK)
-			code = curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+	JsonValue Execute(const Request &request) const {
+		if (TransportOptions::Instance().http_version == Transport::hvHTTP2 && !AsyncEngine::InIoThread())
+			return ExecuteAsync(request, Completion()).get();
+
+		HandlePool::Handle http = HandlePool::Instance().Acquire();
+		ValidatorStore::Snapshot cached = Setup(*http, request);
+		RetryState retry(request.route->method);
+		std::chrono::milliseconds delay;
+		for (;;) {
+			std::this_thread::sleep_for(RateLimiter::Instance().Acquire(token));
+			CURLcode code = http->Prepare(request.route->method);
+			if (code == CURLE_OK) {
+				http->StartTrace();
+				code = curl_easy_perform(http->Handle());
+			}
+			MetricsRegistry::Instance().Record(request.Endpoint(), request.route->method, *http, code);
+			http->FinishTrace(code);
+			if (!retry.Next(*http, code, delay))
+				return Finish(*http, code, ValidatorKey(request), cached);
+			std::this_thread::sleep_for(delay);
+		}
+	}
 
-		string response, vscale_error_msg;
-		if (code == CURLE_OK) {
-			curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, WriteFuncCallback);
-			curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &response);
-			curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
-			curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &vscale_error_msg);
-			curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, 30);
-			curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT, 30);
+	/*
+	* Потоковый запрос, выполняемый движком. Вызывающий поток ждет promise,
+	* поэтому sink и признак delivered остаются на его стеке.
+	*/
+	struct StreamCall {
+		HttpRequest::MethodRequest method;
+		std::shared_ptr<const PrivateData> owner;
+		const char *endpoint;
+		HttpRequest::BodySink sink;
+		const bool *delivered;
+		RetryState retry;
+		std::shared_ptr<std::promise<void>> promise;
+
+		void Submit(HandlePool::Handle http, std::chrono::milliseconds delay) {
+			try {
+				delay = std::max(delay, RateLimiter::Instance().Acquire(owner->token));
+			} catch (...) {
+				promise->set_exception(std::current_exception());
+				return;
+			}
+			AsyncEngine::Instance().Submit(std::move(http), *this, delay);
 		}
 
-		if (code == CURLE_OK)
-			code = curl_easy_perform(m_curl);
+		void operator()(HandlePool::Handle &http, CURLcode code) {
+			MetricsRegistry::Instance().Record(endpoint, method, *http, code);
+			http->FinishTrace(code);
+			std::chrono::milliseconds delay;
+			if (!*delivered && retry.Next(*http, code, delay)) {
+				code = http->Prepare(method, sink);
+				if (code == CURLE_OK) {
+					Submit(std::move(http), delay);
+					return;
+				}
+			}
+			try {
+				http->Complete(code);
+				promise->set_value();
+			} catch (...) {
+				promise->set_exception(std::current_exception());
+			}
+		}
+	};
 
-		if (code == CURLE_OK) {
-			long response_code = 0;
-			code = curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &response_code);
-			if (code == CURLE_OK && (response_code != SUCCESS_RESPONSE_CODE_200 || response_code != SUCCESS_RESPONSE_CODE_204)) {
-				if (!vscale_error_msg.empty())
-					throw BadRequest(vscale_error_msg);
-				throw BadRequest(DEFAULT_BAD_REQUEST + std::to_string(response_code));
+	/*
+	* Повтор потокового запроса возможен, только пока обработчику
+	* не передано ни одного элемента. В режиме HTTP/2 запрос, как и Execute,
+	* выполняется движком в общем соединении, а обработчик элементов
+	* вызывается в потоке ввода-вывода.
+	*/
+	void Stream(const Request &request, const ElementHandler &handler) const {
+		JsonArrayStream stream(handler);
+		HandlePool::Handle http = HandlePool::Instance().Acquire();
+		Setup(*http, request, false);
+		bool delivered = false;
+		HttpRequest::BodySink sink = [&stream, &delivered](const char *data, size_t size) {
+			delivered = true;
+			stream.Feed(data, size);
+		};
+		if (TransportOptions::Instance().http_version == Transport::hvHTTP2 && !AsyncEngine::InIoThread()) {
+			std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+			std::future<void> result = promise->get_future();
+			StreamCall call{request.route->method, shared_from_this(), request.Endpoint(), sink, &delivered,
+					RetryState(request.route->method), promise};
+			const CURLcode code = http->Prepare(request.route->method, sink);
+			if (code != CURLE_OK)
+				call(http, code);
+			else
+				call.Submit(std::move(http), std::chrono::milliseconds(0));
+			result.get();
+			stream.Finish();
+			return;
+		}
+
+		RetryState retry(request.route->method);
+		std::chrono::milliseconds delay;
+		for (;;) {
+			std::this_thread::sleep_for(RateLimiter::Instance().Acquire(token));
+			CURLcode code = http->Prepare(request.route->method, sink);
+			if (code == CURLE_OK) {
+				http->StartTrace();
+				code = curl_easy_perform(http->Handle());
+			}
+			MetricsRegistry::Instance().Record(request.Endpoint(), request.route->method, *http, code);
+			http->FinishTrace(code);
+			if (delivered || !retry.Next(*http, code, delay)) {
+				http->Complete(code);
+				break;
 			}
+			std::this_thread::sleep_for(delay);
 		}
+		stream.Finish();
+	}
+
+	std::future<JsonValue> ExecuteAsync(const Request &request, const Completion &done) const {
+		std::shared_ptr<std::promise<JsonValue>> promise = std::make_shared<std::promise<JsonValue>>();
+		std::future<JsonValue> result = promise->get_future();
+
+		HandlePool::Handle http = HandlePool::Instance().Acquire();
+		const HttpRequest::MethodRequest method = request.route->method;
+		AsyncCall handler{method, shared_from_this(), request.Endpoint(), ValidatorKey(request), Setup(*http, request), done, promise, RetryState(method)};
+
+		CURLcode code = http->Prepare(request.route->method);
+		if (code != CURLE_OK)
+			handler(http, code);
+		else
+			handler.Submit(std::move(http), std::chrono::milliseconds(0));
+		return result;
+	}
+
+	JsonValue Cached(ResponseCache::Endpoint endpoint, const Request &request) const {
+		ResponseCacheStore &cache = ResponseCacheStore::Instance();
+		if (!cache.Enabled())
+			return Perform(request);
 
+		JsonValue response;
+		const string key = Key(request);
+		if (!cache.Find(key, response)) {
+			response = Perform(request);
+			cache.Store(endpoint, key, response);
+		}
 		return response;
 	}
 
-private:
-	CURL *m_curl;
-	struct curl_slist *m_headers;
+	std::future<JsonValue> CachedAsync(ResponseCache::Endpoint endpoint, const Request &request, const Completion &done) const {
+		ResponseCacheStore &cache = ResponseCacheStore::Instance();
+		if (!cache.Enabled())
+			return PerformAsync(request, done);
+
+		JsonValue response;
+		const string key = Key(request);
+		if (cache.Find(key, response)) {
+			std::promise<JsonValue> promise;
+			if (done) {
+				try {
+					done(response, nullptr);
+				} catch (...) {}
+			}
+			promise.set_value(response);
+			return promise.get_future();
+		}
+		return PerformAsync(request, [endpoint, key, done](const JsonValue &response, std::exception_ptr error) {
+			if (!error)
+				ResponseCacheStore::Instance().Store(endpoint, key, response);
+			if (done)
+				done(response, error);
+		});
+	}
 };
 
-string AppendURLPath(const string &url, const string &path) {
-	if (url.compare(url.size() - 1, 1, "/") == 0)
-		return url + path;
-	return url + "/" + path;
-}
+/*
+* Выполняет пакет асинхронных запросов, держа в работе не более concurrency
+* из них. Очередной запрос запускается из обработчика завершения предыдущего.
+* Состояние пакета принадлежит обработчикам завершения наравне с вызывающим:
+* после последнего уведомления вызывающий поток возвращается и уничтожает свои
+* локальные объекты, а обработчик еще может выполняться. Вызов из потока ввода-вывода
+* (например, из Completion) ждал бы сам себя, поэтому отклоняется.
+*/
+template <typename Id>
+std::vector<BulkResult<Id>> PerformBulk(const std::vector<Id> &ids, size_t concurrency,
+		const std::function<void(const Id &id, const Completion &done)> &start,
+		const std::function<void(const BulkResult<Id> &result)> &observe = nullptr) {
+	if (AsyncEngine::InIoThread())
+		throw BadRequest(BULK_IN_IO_THREAD_MESSAGE);
+	if (ids.empty())
+		return std::vector<BulkResult<Id>>();
+
+	struct State {
+		std::vector<Id> ids;
+		std::vector<BulkResult<Id>> results;
+		std::function<void(const Id &id, const Completion &done)> start;
+		std::function<void(const BulkResult<Id> &result)> observe;
+		std::mutex mutex;
+		std::condition_variable finished;
+		size_t next, remaining;
+	};
+
+	struct Launcher {
+		static void Launch(const std::shared_ptr<State> &state, size_t index) {
+			state->start(state->ids[index], [state, index](const JsonValue &response, std::exception_ptr error) {
+				BulkResult<Id> &result = state->results[index];
+				result.id = state->ids[index];
+				result.success = !error;
+				result.response = response;
+				if (error) {
+					try {
+						std::rethrow_exception(error);
+					} catch (const std::exception &e) {
+						result.error = e.what();
+					} catch (...) {
+						result.error = "unknown error";
+					}
+				}
+				if (state->observe)
+					state->observe(result);
+
+				bool launch_next = false;
+				size_t following = 0;
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					launch_next = state->next < state->ids.size();
+					if (launch_next)
+						following = state->next++;
+					if (--state->remaining == 0)
+						state->finished.notify_all();
+				}
+				if (launch_next)
+					Launch(state, following);
+			});
+		}
+	};
 
-string TruncateURLPath(const string &src) {
-	string res = src;
-	const string::size_type pos = res.rfind('/');
-	if (pos != string::npos)
-		return res.substr(pos + 1);
-	return res;
+	std::shared_ptr<State> state = std::make_shared<State>();
+	state->ids = ids;
+	state->results.resize(ids.size());
+	state->start = start;
+	state->observe = observe;
+	state->next = std::min(std::max(concurrency, (size_t) 1), ids.size());
+	state->remaining = ids.size();
+
+	const size_t initial = state->next;
+	for (size_t i = 0; i < initial; ++i)
+		Launcher::Launch(state, i);
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state] { return state->remaining == 0; });
+	return std::move(state->results);
 }
 
-BadRequest::BadRequest(const string &what): m_what(what) {}
+/*
+* Пакетная операция над питанием серверов: PerformBulk по волнам. При options.wait
+* слот параллельности освобождается только после завершения операции над сервером,
+* поэтому одновременно недоступно не больше options.concurrency серверов.
+*/
+std::vector<BulkResult<int>> PerformPowerBulk(const string &token, const std::vector<int> &ids, const BulkOptions &options,
+		const std::function<void(int id, const Completion &done)> &start) {
+	std::unique_ptr<TaskWatcher> watcher;
+	if (options.wait)
+		watcher.reset(new TaskWatcher(token));
+
+	std::function<void(const int &id, const Completion &done)> operation = [&](const int &id, const Completion &done) {
+		start(id, [&watcher, id, done](const JsonValue &response, std::exception_ptr error) {
+			if (error || !watcher) {
+				done(response, error);
+				return;
+			}
+			watcher->WaitScalet(id, [response, done](const TaskInfo &task, std::exception_ptr error) {
+				if (!error && task.error)
+					error = std::make_exception_ptr(BadRequest(SCALET_TASK_FAILED_MESSAGE));
+				done(response, error);
+			});
+		});
+	};
 
-const char* BadRequest::what() const throw() {
-	return m_what.c_str();
-}
+	const size_t wave = options.wave == 0 ? std::max(ids.size(), (size_t) 1) : options.wave;
+	BulkProgress progress;
+	progress.total = ids.size();
+	progress.completed = 0;
+	progress.failed = 0;
+	progress.wave = 0;
+	progress.waves = (ids.size() + wave - 1) / wave;
+
+	std::mutex mutex;
+	std::function<void(const BulkResult<int> &result)> observe = [&](const BulkResult<int> &result) {
+		std::lock_guard<std::mutex> lock(mutex);
+		++progress.completed;
+		if (!result.success)
+			++progress.failed;
+		if (options.progress) {
+			try {
+				options.progress(progress, result);
+			} catch (...) {}
+		}
+	};
 
-struct VscalePrivateData::PrivateData {
-	string url, token;
-	HttpRequest http;
-};
+	std::vector<BulkResult<int>> results;
+	results.reserve(ids.size());
+	for (size_t first = 0; first < ids.size(); first += wave, ++progress.wave) {
+		const std::vector<int> chunk(ids.begin() + first, ids.begin() + std::min(first + wave, ids.size()));
+		std::vector<BulkResult<int>> done = PerformBulk<int>(chunk, options.concurrency, operation, observe);
+		std::move(done.begin(), done.end(), std::back_inserter(results));
+	}
+	return results;
+}
 
-VscalePrivateData::VscalePrivateData(const string &url, const string &token)
-		: m_data(new PrivateData)
+VscalePrivateData::VscalePrivateData(const string &token)
+		: m_data(new PrivateData(token))
 {
-	m_data->url = url;
-	m_data->token = token;
-	m_data->http.SetURL(url);
-	m_data->http.SetHeader(HEADER_TOKEN(token));
 }
 
-Account::Account(const string &token): VscalePrivateData(VSCALE_ACCOUNT_API_URL, token) {}
+Account::Account(const string &token): VscalePrivateData(token) {}
 Account::~Account() {}
 
 void Account::Info(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtAccountInfo>());
+}
+
+std::future<JsonValue> Account::InfoAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtAccountInfo>(), done);
 }
 
-Scalets::Scalets(const string &token): VscalePrivateData(VSCALE_SCALETS_API_URL, token) {}
+Scalets::Scalets(const string &token): VscalePrivateData(token) {}
 Scalets::~Scalets() {}
 
 void Scalets::List(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtScaletsList>());
+}
+
+std::future<JsonValue> Scalets::ListAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtScaletsList>(), done);
+}
+
+void Scalets::List(std::vector<ScaletInfo> &result) const {
+	m_data->Stream(m_data->Call<rtScaletsList>(), CollectInto(result));
+}
+
+void Scalets::List(const ElementHandler &handler) const {
+	m_data->Stream(m_data->Call<rtScaletsList>(), handler);
 }
 
 void Scalets::Create(const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token));
+	response = m_data->Perform(m_data->CallWith<rtScaletsCreate>(params));
+}
+
+std::future<JsonValue> Scalets::CreateAsync(const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtScaletsCreate>(params), done);
 }
 
 void Scalets::Delete(int id, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)))
-			.Perform(HttpRequest::mrDELETE);
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtScaletsDelete>(id));
+}
+
+std::future<JsonValue> Scalets::DeleteAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtScaletsDelete>(id), done);
 }
 
 void Scalets::Info(int id, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)));
-	response = m_data->http.Perform();
-	m_data->http.SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtScaletsInfo>(id));
+}
+
+std::future<JsonValue> Scalets::InfoAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtScaletsInfo>(id), done);
+}
+
+void Scalets::Info(int id, ScaletInfo &result) const {
+	result = ScaletInfo::FromJson(m_data->Perform(m_data->Call<rtScaletsInfo>(id)));
+}
+
+std::vector<BulkResult<int>> Scalets::InfoBulk(const std::vector<int> &ids, size_t concurrency) const {
+	return PerformBulk<int>(ids, concurrency, [this](const int &id, const Completion &done) {
+		InfoAsync(id, done);
+	});
 }
 
 void Scalets::Restart(int id, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id) + "/restart"));
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPATCH, "{\"id\": \"" + std::to_string(id) + "\"}");
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtScaletsRestart>(id));
+}
+
+std::future<JsonValue> Scalets::RestartAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtScaletsRestart>(id), done);
+}
+
+std::vector<BulkResult<int>> Scalets::RestartBulk(const std::vector<int> &ids, const BulkOptions &options) const {
+	return PerformPowerBulk(m_data->token, ids, options, [this](int id, const Completion &done) {
+		RestartAsync(id, done);
+	});
 }
 
 void Scalets::Rebuild(int id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id) + "/rebuild"));
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPATCH, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtScaletsRebuild>(params, id));
+}
+
+std::future<JsonValue> Scalets::RebuildAsync(int id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtScaletsRebuild>(params, id), done);
 }
 
 void Scalets::Stop(int id, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id) + "/stop"));
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPATCH, "{\"id\": \"" + std::to_string(id) + "\"}");
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtScaletsStop>(id));
+}
+
+std::future<JsonValue> Scalets::StopAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtScaletsStop>(id), done);
+}
+
+std::vector<BulkResult<int>> Scalets::StopBulk(const std::vector<int> &ids, const BulkOptions &options) const {
+	return PerformPowerBulk(m_data->token, ids, options, [this](int id, const Completion &done) {
+		StopAsync(id, done);
+	});
 }
 
 void Scalets::Start(int id, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id) + "/start"));
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPATCH, "{\"id\": \"" + std::to_string(id) + "\"}");
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtScaletsStart>(id));
+}
+
+std::future<JsonValue> Scalets::StartAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtScaletsStart>(id), done);
+}
+
+std::vector<BulkResult<int>> Scalets::StartBulk(const std::vector<int> &ids, const BulkOptions &options) const {
+	return PerformPowerBulk(m_data->token, ids, options, [this](int id, const Completion &done) {
+		StartAsync(id, done);
+	});
 }
 
 void Scalets::Upgrade(int id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id) + "/upgrade"));
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtScaletsUpgrade>(params, id));
+}
+
+std::future<JsonValue> Scalets::UpgradeAsync(int id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtScaletsUpgrade>(params, id), done);
 }
 
 void Scalets::Tasks(JsonValue &response) const {
-	response = m_data->http.SetURL(AppendURLPath(TruncateURLPath(m_data->url), "/task")).Perform();
-	m_data->http.SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtTasksList>());
+}
+
+std::future<JsonValue> Scalets::TasksAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtTasksList>(), done);
+}
+
+void Scalets::Tasks(std::vector<TaskInfo> &result) const {
+	m_data->Stream(m_data->Call<rtTasksList>(), CollectInto(result));
 }
 
 void Scalets::Backup(int id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id) + "/backup"));
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtScaletsBackup>(params, id));
 }
 
-ServerTags::ServerTags(const string &token): VscalePrivateData(VSCALE_SERVER_TAGS_API_URL, token) {}
+std::future<JsonValue> Scalets::BackupAsync(int id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtScaletsBackup>(params, id), done);
+}
+
+ServerTags::ServerTags(const string &token): VscalePrivateData(token) {}
 ServerTags::~ServerTags() {}
 
 void ServerTags::List(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtServerTagsList>());
+}
+
+std::future<JsonValue> ServerTags::ListAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtServerTagsList>(), done);
+}
+
+void ServerTags::List(std::vector<TagInfo> &result) const {
+	m_data->Stream(m_data->Call<rtServerTagsList>(), CollectInto(result));
 }
 
 void ServerTags::Create(const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token));
+	response = m_data->Perform(m_data->CallWith<rtServerTagsCreate>(params));
+}
+
+std::future<JsonValue> ServerTags::CreateAsync(const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtServerTagsCreate>(params), done);
 }
 
 void ServerTags::Update(int id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)));
-	response = m_data->http.Perform(HttpRequest::mrPUT, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtServerTagsUpdate>(params, id));
+}
+
+std::future<JsonValue> ServerTags::UpdateAsync(int id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtServerTagsUpdate>(params, id), done);
 }
 
 void ServerTags::Delete(int id, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)))
-			.Perform(HttpRequest::mrDELETE);
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtServerTagsDelete>(id));
+}
+
+std::future<JsonValue> ServerTags::DeleteAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtServerTagsDelete>(id), done);
 }
 
-Backup::Backup(const string &token): VscalePrivateData(VSCALE_BACKUP_API_URL, token) {}
+Backup::Backup(const string &token): VscalePrivateData(token) {}
 Backup::~Backup() {}
 
 void Backup::List(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtBackupList>());
+}
+
+std::future<JsonValue> Backup::ListAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtBackupList>(), done);
+}
+
+void Backup::List(std::vector<BackupInfo> &result) const {
+	m_data->Stream(m_data->Call<rtBackupList>(), CollectInto(result));
 }
 
 void Backup::Delete(const string &id, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.SetURL(AppendURLPath(m_data->url, id))
-			.Perform(HttpRequest::mrDELETE);
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtBackupDelete>(id));
+}
+
+std::future<JsonValue> Backup::DeleteAsync(const string &id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtBackupDelete>(id), done);
 }
 
 void Backup::Info(const string &id, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, id));
-	response = m_data->http.Perform();
-	m_data->http.SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtBackupInfo>(id));
+}
+
+std::future<JsonValue> Backup::InfoAsync(const string &id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtBackupInfo>(id), done);
 }
 
-Background::Background(const string &token): VscalePrivateData("", token) {}
+void Backup::Info(const string &id, BackupInfo &result) const {
+	result = BackupInfo::FromJson(m_data->Perform(m_data->Call<rtBackupInfo>(id)));
+}
+
+Background::Background(const string &token): VscalePrivateData(token) {}
 Background::~Background() {}
 
 void Background::Locations(JsonValue &response) const {
-	m_data->http.SetURL(VSCALE_LOCATIONS_API_URL);
-	response = m_data->http.Perform();
+	response = m_data->Cached(ResponseCache::epLocations, m_data->Call<rtLocations>());
+}
+
+std::future<JsonValue> Background::LocationsAsync(Completion done) const {
+	return m_data->CachedAsync(ResponseCache::epLocations, m_data->Call<rtLocations>(), done);
 }
 
 void Background::Images(JsonValue &response) const {
-	m_data->http.SetURL(VSCALE_IMAGES_API_URL);
-	response = m_data->http.Perform();
+	response = m_data->Cached(ResponseCache::epImages, m_data->Call<rtImages>());
 }
 
-Configurations::Configurations(const string &token): VscalePrivateData("", token) {}
+std::future<JsonValue> Background::ImagesAsync(Completion done) const {
+	return m_data->CachedAsync(ResponseCache::epImages, m_data->Call<rtImages>(), done);
+}
+
+Configurations::Configurations(const string &token): VscalePrivateData(token) {}
 Configurations::~Configurations() {}
 
 void Configurations::RPlans(JsonValue &response) const {
-	m_data->http.SetURL(VSCALE_RPLANS_API_URL);
-	response = m_data->http.Perform();
+	response = m_data->Cached(ResponseCache::epRPlans, m_data->Call<rtRPlans>());
+}
+
+std::future<JsonValue> Configurations::RPlansAsync(Completion done) const {
+	return m_data->CachedAsync(ResponseCache::epRPlans, m_data->Call<rtRPlans>(), done);
 }
 
 void Configurations::BillingPrices(JsonValue &response) const {
-	m_data->http.SetURL(VSCALE_BILLING_PRICES_API_URL);
-	response = m_data->http.Perform();
+	response = m_data->Cached(ResponseCache::epBillingPrices, m_data->Call<rtBillingPrices>());
 }
 
-SSHKeys::SSHKeys(const string &token): VscalePrivateData(VSCALE_SSHKEYS_API_URL, token) {}
+std::future<JsonValue> Configurations::BillingPricesAsync(Completion done) const {
+	return m_data->CachedAsync(ResponseCache::epBillingPrices, m_data->Call<rtBillingPrices>(), done);
+}
+
+SSHKeys::SSHKeys(const string &token): VscalePrivateData(token) {}
 SSHKeys::~SSHKeys() {}
 
 void SSHKeys::List(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtSSHKeysList>());
+}
+
+std::future<JsonValue> SSHKeys::ListAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtSSHKeysList>(), done);
 }
 
 void SSHKeys::Create(const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token));
+	response = m_data->Perform(m_data->CallWith<rtSSHKeysCreate>(params));
+}
+
+std::future<JsonValue> SSHKeys::CreateAsync(const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtSSHKeysCreate>(params), done);
 }
 
 void SSHKeys::Delete(int id, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)))
-			.Perform(HttpRequest::mrDELETE);
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtSSHKeysDelete>(id));
+}
+
+std::future<JsonValue> SSHKeys::DeleteAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtSSHKeysDelete>(id), done);
 }
 
-Notifications::Notifications(const string &token): VscalePrivateData(VSCALE_NOTIFICATIONS_API_URL, token) {}
+Notifications::Notifications(const string &token): VscalePrivateData(token) {}
 Notifications::~Notifications() {}
 
 void Notifications::Update(const JsonValue &params, JsonValue &response) const {
-	response = m_data->http.Perform(HttpRequest::mrPUT, params.toStyledString());
+	response = m_data->Perform(m_data->CallWith<rtNotificationsUpdate>(params));
+}
+
+std::future<JsonValue> Notifications::UpdateAsync(const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtNotificationsUpdate>(params), done);
 }
 
 void Notifications::Info(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtNotificationsInfo>());
+}
+
+std::future<JsonValue> Notifications::InfoAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtNotificationsInfo>(), done);
 }
 
-Billing::Billing(const string &token): VscalePrivateData("", token) {}
+Billing::Billing(const string &token): VscalePrivateData(token) {}
 Billing::~Billing() {}
 
 void Billing::Balance(JsonValue &response) const {
-	m_data->http.SetURL(VSCALE_BILLING_BALANCE_API_URL);
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtBillingBalance>());
+}
+
+std::future<JsonValue> Billing::BalanceAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtBillingBalance>(), done);
 }
 
 void Billing::Payments(JsonValue &response) const {
-	m_data->http.SetURL(VSCALE_BILLING_PAYMENTS_API_URL);
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtBillingPayments>());
+}
+
+std::future<JsonValue> Billing::PaymentsAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtBillingPayments>(), done);
+}
+
+void Billing::Payments(const ElementHandler &handler) const {
+	m_data->Stream(m_data->Call<rtBillingPayments>(), handler);
 }
 
 void Billing::Consumption(const string &start_date, const string &end_date, JsonValue &response) const {
-	m_data->http.SetURL(VSCALE_BILLING_CONSUMPTION_API_URL "?start=" + start_date + "&end=" + end_date);
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtBillingConsumption>(start_date, end_date));
+}
+
+std::future<JsonValue> Billing::ConsumptionAsync(const string &start_date, const string &end_date, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtBillingConsumption>(start_date, end_date), done);
 }
 
-Domain::Domain(const string &token): VscalePrivateData(VSCALE_DOMAIN_API_URL, token) {}
+Domain::Domain(const string &token): VscalePrivateData(token) {}
 Domain::~Domain() {}
 
 void Domain::List(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtDomainList>());
+}
+
+std::future<JsonValue> Domain::ListAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainList>(), done);
 }
 
 void Domain::Create(const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token));
+	response = m_data->Perform(m_data->CallWith<rtDomainCreate>(params));
+}
+
+std::future<JsonValue> Domain::CreateAsync(const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtDomainCreate>(params), done);
 }
 
 void Domain::Update(int id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)));
-	response = m_data->http.Perform(HttpRequest::mrPATCH, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtDomainUpdate>(params, id));
+}
+
+std::future<JsonValue> Domain::UpdateAsync(int id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtDomainUpdate>(params, id), done);
 }
 
 void Domain::Delete(int id, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)))
-			.Perform(HttpRequest::mrDELETE);
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtDomainDelete>(id));
+}
+
+std::future<JsonValue> Domain::DeleteAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainDelete>(id), done);
 }
 
 void Domain::Info(int id, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)));
-	response = m_data->http.Perform();
-	m_data->http.SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtDomainInfo>(id));
 }
 
-DomainRecord::DomainRecord(const string &token): VscalePrivateData(VSCALE_DOMAIN_API_URL, token) {}
+std::future<JsonValue> Domain::InfoAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainInfo>(id), done);
+}
+
+DomainRecord::DomainRecord(const string &token): VscalePrivateData(token) {}
 DomainRecord::~DomainRecord() {}
 
 void DomainRecord::List(int domain_id, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(domain_id) + "/records"));
-	response = m_data->http.Perform();
-	m_data->http.SetURL(m_data->url);
+	response = m_data->Perform(m_data->Call<rtDomainRecordList>(domain_id));
+}
+
+std::future<JsonValue> DomainRecord::ListAsync(int domain_id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainRecordList>(domain_id), done);
+}
+
+void DomainRecord::List(int domain_id, std::vector<DomainRecordInfo> &result) const {
+	m_data->Stream(m_data->Call<rtDomainRecordList>(domain_id), CollectInto(result));
+}
+
+void DomainRecord::List(int domain_id, const ElementHandler &handler) const {
+	m_data->Stream(m_data->Call<rtDomainRecordList>(domain_id), handler);
 }
 
 void DomainRecord::Create(int domain_id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(domain_id) + "/records"))
-			.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtDomainRecordCreate>(params, domain_id));
+}
+
+std::future<JsonValue> DomainRecord::CreateAsync(int domain_id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtDomainRecordCreate>(params, domain_id), done);
 }
 
 void DomainRecord::Update(int domain_id, int record_id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(domain_id) + "/records/" + std::to_string(record_id)))
-			.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtDomainRecordUpdate>(params, domain_id, record_id));
+}
+
+std::future<JsonValue> DomainRecord::UpdateAsync(int domain_id, int record_id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtDomainRecordUpdate>(params, domain_id, record_id), done);
 }
 
 void DomainRecord::Delete(int domain_id, int record_id) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(domain_id) + "/records/" + std::to_string(record_id)))
-			.SetHeader(HEADER_APPLICATION_JSON).Perform(HttpRequest::mrDELETE);
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	m_data->Perform(m_data->Call<rtDomainRecordDelete>(domain_id, record_id));
+}
+
+std::future<JsonValue> DomainRecord::DeleteAsync(int domain_id, int record_id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainRecordDelete>(domain_id, record_id), done);
 }
 
 void DomainRecord::Info(int domain_id, int record_id, JsonValue &response) const {
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(domain_id) + "/records/" + std::to_string(record_id)));
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtDomainRecordInfo>(domain_id, record_id));
+}
+
+std::future<JsonValue> DomainRecord::InfoAsync(int domain_id, int record_id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainRecordInfo>(domain_id, record_id), done);
 }
 
-DomainsTags::DomainsTags(const string &token): VscalePrivateData(VSCALE_DOMAIN_TAGS_API_URL, token) {}
+void DomainRecord::Info(int domain_id, int record_id, DomainRecordInfo &result) const {
+	result = DomainRecordInfo::FromJson(m_data->Perform(m_data->Call<rtDomainRecordInfo>(domain_id, record_id)));
+}
+
+std::vector<BulkResult<std::pair<int, int>>> DomainRecord::InfoBulk(const std::vector<std::pair<int, int>> &ids,
+		size_t concurrency) const {
+	return PerformBulk<std::pair<int, int>>(ids, concurrency, [this](const std::pair<int, int> &id, const Completion &done) {
+		InfoAsync(id.first, id.second, done);
+	});
+}
+
+DomainsTags::DomainsTags(const string &token): VscalePrivateData(token) {}
 DomainsTags::~DomainsTags() {}
 
 void DomainsTags::List(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtDomainTagsList>());
+}
+
+std::future<JsonValue> DomainsTags::ListAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainTagsList>(), done);
 }
 
 void DomainsTags::Create(const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token));
+	response = m_data->Perform(m_data->CallWith<rtDomainTagsCreate>(params));
+}
+
+std::future<JsonValue> DomainsTags::CreateAsync(const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtDomainTagsCreate>(params), done);
 }
 
 void DomainsTags::Update(int id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)));
-	response = m_data->http.Perform(HttpRequest::mrPUT, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtDomainTagsUpdate>(params, id));
+}
+
+std::future<JsonValue> DomainsTags::UpdateAsync(int id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtDomainTagsUpdate>(params, id), done);
 }
 
 void DomainsTags::Delete(int id) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)))
-			.Perform(HttpRequest::mrDELETE);
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	m_data->Perform(m_data->Call<rtDomainTagsDelete>(id));
+}
+
+std::future<JsonValue> DomainsTags::DeleteAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainTagsDelete>(id), done);
 }
 
 void DomainsTags::Info(int id, JsonValue &response) const {
-	response = m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id))).Perform();
+	response = m_data->Perform(m_data->Call<rtDomainTagsInfo>(id));
 }
 
-PTRRecords::PTRRecords(const string &token): VscalePrivateData(VSCALE_PTR_RECORDS_API_URL, token) {}
+std::future<JsonValue> DomainsTags::InfoAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtDomainTagsInfo>(id), done);
+}
+
+PTRRecords::PTRRecords(const string &token): VscalePrivateData(token) {}
 PTRRecords::~PTRRecords() {}
 
 void PTRRecords::List(JsonValue &response) const {
-	response = m_data->http.Perform();
+	response = m_data->Perform(m_data->Call<rtPTRRecordsList>());
+}
+
+std::future<JsonValue> PTRRecords::ListAsync(Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtPTRRecordsList>(), done);
 }
 
 void PTRRecords::Create(const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	response = m_data->http.Perform(HttpRequest::mrPOST, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token));
+	response = m_data->Perform(m_data->CallWith<rtPTRRecordsCreate>(params));
+}
+
+std::future<JsonValue> PTRRecords::CreateAsync(const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtPTRRecordsCreate>(params), done);
 }
 
 void PTRRecords::Update(int id, const JsonValue &params, JsonValue &response) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)));
-	response = m_data->http.Perform(HttpRequest::mrPUT, params.toStyledString());
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	response = m_data->Perform(m_data->CallWith<rtPTRRecordsUpdate>(params, id));
+}
+
+std::future<JsonValue> PTRRecords::UpdateAsync(int id, const JsonValue &params, Completion done) const {
+	return m_data->PerformAsync(m_data->CallWith<rtPTRRecordsUpdate>(params, id), done);
 }
 
 void PTRRecords::Delete(int id) const {
-	m_data->http.SetHeader(HEADER_APPLICATION_JSON);
-	m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id)))
-			.Perform(HttpRequest::mrDELETE);
-	m_data->http.ClearHeaders().SetHeader(HEADER_TOKEN(m_data->token)).SetURL(m_data->url);
+	m_data->Perform(m_data->Call<rtPTRRecordsDelete>(id));
+}
+
+std::future<JsonValue> PTRRecords::DeleteAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtPTRRecordsDelete>(id), done);
 }
 
 void PTRRecords::Info(int id, JsonValue &response) const {
-	response = m_data->http.SetURL(AppendURLPath(m_data->url, std::to_string(id))).Perform();
+	response = m_data->Perform(m_data->Call<rtPTRRecordsInfo>(id));
+}
+
+std::future<JsonValue> PTRRecords::InfoAsync(int id, Completion done) const {
+	return m_data->PerformAsync(m_data->Call<rtPTRRecordsInfo>(id), done);
 }
 } // namespace vscale
@@ -0,0 +1,196 @@
+#include <vscale/vscale.h>
+#include <gtest/gtest.h>
+#include "stub_server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+/// Номер сервера из пути вида /v1/scalets/{id}[/...]
+int ScaletId(const std::string &path) {
+	return atoi(path.c_str() + strlen("/v1/scalets/"));
+}
+
+class BulkTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		Transport::SetBaseURL(m_server.BaseURL());
+		RetryPolicy::Disable();
+	}
+
+	void TearDown() override {
+		RetryPolicy::Enable();
+		Transport::SetBaseURL("");
+	}
+
+	StubServer m_server;
+};
+
+TEST_F(BulkTest, InfoBulkKeepsOrderAndPerIdErrors) {
+	m_server.Handle("GET", "/v1/scalets/", [](const StubRequest &request, StubResponse &response) {
+		const int id = ScaletId(request.path);
+		if (id % 3 == 0) {
+			response.status = 404;
+			response.headers.emplace_back("Vscale-Error-Message", "scalet not found");
+			return;
+		}
+		response.body = "{\"ctid\": " + std::to_string(id) + "}";
+	});
+
+	std::vector<int> ids;
+	for (int id = 1; id <= 30; ++id)
+		ids.push_back(id);
+	const std::vector<BulkResult<int>> results = Scalets("token").InfoBulk(ids, 4);
+	ASSERT_EQ(ids.size(), results.size());
+	for (size_t i = 0; i < ids.size(); ++i) {
+		EXPECT_EQ(ids[i], results[i].id);
+		EXPECT_EQ(ids[i] % 3 != 0, results[i].success);
+		if (results[i].success)
+			EXPECT_EQ(ids[i], results[i].response["ctid"].asInt());
+		else
+			EXPECT_FALSE(results[i].error.empty());
+	}
+}
+
+TEST_F(BulkTest, RejectedFromCompletion) {
+	m_server.Handle("GET", "/v1/account", [](const StubRequest &, StubResponse &response) {
+		response.body = "{}";
+	});
+
+	Scalets scalets("token");
+	std::promise<bool> rejected;
+	Account("token").InfoAsync([&scalets, &rejected](const JsonValue &, std::exception_ptr) {
+		try {
+			scalets.InfoBulk(std::vector<int>(1, 1), 1);
+			rejected.set_value(false);
+		} catch (const BadRequest &) {
+			rejected.set_value(true);
+		}
+	}).wait();
+	EXPECT_TRUE(rejected.get_future().get());
+}
+
+TEST_F(BulkTest, RestartBulkRunsWavesInOrder) {
+	std::mutex mutex;
+	std::vector<int> order;
+	int active = 0, max_active = 0;
+	m_server.Handle("PATCH", "/v1/scalets/", [&](const StubRequest &request, StubResponse &response) {
+		const int id = ScaletId(request.path);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			order.push_back(id);
+			max_active = std::max(max_active, ++active);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--active;
+		}
+		response.body = "{\"ctid\": " + std::to_string(id) + "}";
+	});
+
+	BulkOptions options;
+	options.wave = 2;
+	options.wait = false;
+	std::vector<size_t> waves;
+	options.progress = [&waves](const BulkProgress &progress, const BulkResult<int> &result) {
+		EXPECT_EQ(3u, progress.waves);
+		EXPECT_EQ((size_t) (result.id - 1) / 2, progress.wave);
+		waves.push_back(progress.wave);
+	};
+	const std::vector<int> ids = {1, 2, 3, 4, 5};
+	const std::vector<BulkResult<int>> results = Scalets("token").RestartBulk(ids, options);
+
+	ASSERT_EQ(ids.size(), results.size());
+	for (size_t i = 0; i < ids.size(); ++i) {
+		EXPECT_EQ(ids[i], results[i].id);
+		EXPECT_TRUE(results[i].success);
+		EXPECT_EQ(ids[i], results[i].response["ctid"].asInt());
+	}
+	EXPECT_EQ(5u, m_server.Count("PATCH", "/v1/scalets/"));
+	EXPECT_EQ(2, max_active);
+	ASSERT_EQ(ids.size(), order.size());
+	// Серверы следующей волны запрашиваются только после ответов на всю предыдущую
+	EXPECT_EQ(std::set<int>({1, 2}), std::set<int>(order.begin(), order.begin() + 2));
+	EXPECT_EQ(std::set<int>({3, 4}), std::set<int>(order.begin() + 2, order.begin() + 4));
+	EXPECT_EQ(5, order[4]);
+	EXPECT_TRUE(std::is_sorted(waves.begin(), waves.end()));
+}
+
+TEST_F(BulkTest, RestartBulkReportsPerIdFailures) {
+	m_server.Handle("PATCH", "/v1/scalets/", [](const StubRequest &request, StubResponse &response) {
+		const int id = ScaletId(request.path);
+		if (id == 3 || id == 6) {
+			response.status = 409;
+			response.headers.emplace_back("Vscale-Error-Message", "scalet is locked");
+			return;
+		}
+		response.body = "{\"ctid\": " + std::to_string(id) + "}";
+	});
+
+	BulkOptions options;
+	options.wave = 4;
+	options.concurrency = 2;
+	options.wait = false;
+	BulkProgress last = BulkProgress();
+	options.progress = [&last](const BulkProgress &progress, const BulkResult<int> &) {
+		last = progress;
+	};
+	const std::vector<int> ids = {1, 2, 3, 4, 5, 6, 7};
+	const std::vector<BulkResult<int>> results = Scalets("token").RestartBulk(ids, options);
+
+	ASSERT_EQ(ids.size(), results.size());
+	for (size_t i = 0; i < ids.size(); ++i) {
+		const bool failed = ids[i] == 3 || ids[i] == 6;
+		EXPECT_EQ(ids[i], results[i].id);
+		EXPECT_EQ(!failed, results[i].success);
+		if (failed)
+			EXPECT_EQ("scalet is locked", results[i].error);
+		else
+			EXPECT_EQ(ids[i], results[i].response["ctid"].asInt());
+	}
+	// Ошибка не прерывает ни волну, ни следующие волны
+	EXPECT_EQ(7u, m_server.Count("PATCH", "/v1/scalets/"));
+	EXPECT_EQ(7u, last.total);
+	EXPECT_EQ(7u, last.completed);
+	EXPECT_EQ(2u, last.failed);
+	EXPECT_EQ(1u, last.wave);
+	EXPECT_EQ(2u, last.waves);
+}
+
+TEST_F(BulkTest, RestartBulkWaitReportsFailedTasks) {
+	m_server.Handle("PATCH", "/v1/scalets/", [](const StubRequest &request, StubResponse &response) {
+		response.body = "{\"ctid\": " + std::to_string(ScaletId(request.path)) + "}";
+	});
+	// Перезапуск сервера 2 принят API, но сама операция завершилась ошибкой
+	m_server.Handle("GET", "/v1/tasks", [](const StubRequest &, StubResponse &response) {
+		response.body = "[";
+		for (int id = 1; id <= 3; ++id) {
+			if (id != 1)
+				response.body += ", ";
+			response.body += "{\"id\": \"restart-" + std::to_string(id) + "\", \"scalet\": " + std::to_string(id)
+					+ ", \"method\": \"scalet_restart\", \"done\": true, \"error\": " + (id == 2 ? "true" : "false") + "}";
+		}
+		response.body += "]";
+	});
+
+	BulkOptions options;
+	options.wait = true;
+	const std::vector<int> ids = {1, 2, 3};
+	const std::vector<BulkResult<int>> results = Scalets("wait-token").RestartBulk(ids, options);
+
+	ASSERT_EQ(ids.size(), results.size());
+	EXPECT_TRUE(results[0].success);
+	EXPECT_FALSE(results[1].success);
+	EXPECT_EQ("scalet operation failed", results[1].error);
+	EXPECT_TRUE(results[2].success);
+}
+
+} // namespace
@@ -0,0 +1,194 @@
+#include <vscale/consumption.h>
+#include <gtest/gtest.h>
+#include "stub_server.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <dirent.h>
+#include <mutex>
+#include <unistd.h>
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+#define SECONDS_PER_DAY 	86400
+
+time_t ParseDay(const std::string &date) {
+	struct tm day = tm();
+	sscanf(date.c_str(), "%d-%d-%d", &day.tm_year, &day.tm_mon, &day.tm_mday);
+	day.tm_year -= 1900;
+	day.tm_mon -= 1;
+	return timegm(&day);
+}
+
+std::string FormatDay(time_t time) {
+	struct tm day;
+	gmtime_r(&time, &day);
+	char buffer[16];
+	strftime(buffer, sizeof(buffer), "%Y-%m-%d", &day);
+	return buffer;
+}
+
+/// Значение параметра name из строки запроса
+std::string Query(const std::string &path, const std::string &name) {
+	const size_t position = path.find(name + "=");
+	if (position == std::string::npos)
+		return std::string();
+	const size_t begin = position + name.size() + 1;
+	return path.substr(begin, path.find('&', begin) - begin);
+}
+
+/// Файлы каталога path
+std::vector<std::string> Files(const std::string &path) {
+	std::vector<std::string> files;
+	DIR *dir = opendir(path.c_str());
+	if (dir == nullptr)
+		return files;
+	while (struct dirent *entry = readdir(dir)) {
+		const std::string name = entry->d_name;
+		if (name != "." && name != "..")
+			files.push_back(name);
+	}
+	closedir(dir);
+	return files;
+}
+
+/*
+* Заглушка отдает за каждый день периода, включая end, списание 1 по
+* серверу 7 и 2 по серверу 8, чтобы лишние дни на границах месяцев
+* попадали в ответы.
+*/
+class ConsumptionTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		Transport::SetBaseURL(m_server.BaseURL());
+		RetryPolicy::Disable();
+		m_server.Handle("GET", "/v1/billing/consumption", [this](const StubRequest &request, StubResponse &response) {
+			const std::string start = Query(request.path, "start");
+			const std::string end = Query(request.path, "end");
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_periods.emplace_back(start, end);
+			}
+			response.body = "{";
+			for (time_t day = ParseDay(start); day <= ParseDay(end); day += SECONDS_PER_DAY) {
+				if (response.body.size() > 1)
+					response.body += ", ";
+				response.body += "\"" + FormatDay(day) + "\": {\"summ\": 3, \"scalets\": {\"7\": 1, \"8\": \"2\"}}";
+			}
+			response.body += "}";
+		});
+	}
+
+	void TearDown() override {
+		RetryPolicy::Enable();
+		Transport::SetBaseURL("");
+	}
+
+	std::vector<std::pair<std::string, std::string>> Periods() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<std::pair<std::string, std::string>> periods = m_periods;
+		std::sort(periods.begin(), periods.end());
+		return periods;
+	}
+
+	StubServer m_server;
+	std::mutex m_mutex;
+	std::vector<std::pair<std::string, std::string>> m_periods;
+};
+
+TEST_F(ConsumptionTest, SplitsMonthsAcrossYearBoundary) {
+	ConsumptionFetcher fetcher("token");
+	const ConsumptionReport report = fetcher.Fetch("2023-11-15", "2024-02-10");
+
+	// Каждый месяц запрашивается целиком до первого дня следующего
+	const std::vector<std::pair<std::string, std::string>> expected = {
+		{"2023-11-01", "2023-12-01"},
+		{"2023-12-01", "2024-01-01"},
+		{"2024-01-01", "2024-02-01"},
+		{"2024-02-01", "2024-03-01"}
+	};
+	EXPECT_EQ(expected, Periods());
+
+	// Частичные первый и последний месяцы: 16 + 31 + 31 + 10 дней
+	const size_t days = 88;
+	EXPECT_EQ("2023-11-15", report.start_date);
+	EXPECT_EQ("2024-02-10", report.end_date);
+	ASSERT_EQ(days, report.days.size());
+	EXPECT_EQ("2023-11-15", report.days.begin()->first);
+	EXPECT_EQ("2024-02-10", report.days.rbegin()->first);
+	// Дни на стыке месяцев, пришедшие в двух ответах, учтены один раз
+	EXPECT_DOUBLE_EQ(3, report.days.at("2023-12-01"));
+	EXPECT_DOUBLE_EQ(3, report.days.at("2024-01-01"));
+	EXPECT_DOUBLE_EQ(3 * days, report.total);
+	EXPECT_DOUBLE_EQ(days, report.scalets.at(7));
+	EXPECT_DOUBLE_EQ(2 * days, report.scalets.at(8));
+	EXPECT_EQ(days, report.scalet_days.at(7).size());
+}
+
+TEST_F(ConsumptionTest, ClosedMonthsAreServedFromCache) {
+	char buffer[] = "/tmp/vscale-consumption-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(buffer));
+	const std::string directory = buffer;
+	ConsumptionFetcher::Options options;
+	options.cache_dir = directory;
+
+	ConsumptionReport first;
+	{
+		ConsumptionFetcher fetcher("token", options);
+		first = fetcher.Fetch("2023-12-20", "2024-01-05");
+		EXPECT_EQ(2u, fetcher.GetStats().requests);
+
+		// Другой период внутри тех же месяцев берется из памяти
+		const ConsumptionReport inner = fetcher.Fetch("2023-12-31", "2024-01-01");
+		EXPECT_EQ(2u, inner.days.size());
+		const ConsumptionFetcher::Stats stats = fetcher.GetStats();
+		EXPECT_EQ(2u, stats.requests);
+		EXPECT_EQ(2u, stats.memory_hits);
+		EXPECT_EQ(2u, stats.cached_months);
+	}
+	// Временные файлы записи не остаются
+	EXPECT_EQ(2u, Files(directory).size());
+
+	{
+		ConsumptionFetcher fetcher("token", options);
+		const ConsumptionReport second = fetcher.Fetch("2023-12-20", "2024-01-05");
+		EXPECT_EQ(first.days, second.days);
+		EXPECT_DOUBLE_EQ(first.total, second.total);
+		const ConsumptionFetcher::Stats stats = fetcher.GetStats();
+		EXPECT_EQ(0u, stats.requests);
+		EXPECT_EQ(2u, stats.disk_hits);
+	}
+	EXPECT_EQ(2u, m_server.Count("GET", "/v1/billing/consumption"));
+
+	for (const auto &file : Files(directory))
+		remove((directory + "/" + file).c_str());
+	rmdir(directory.c_str());
+}
+
+TEST_F(ConsumptionTest, OpenMonthIsRequestedUntilToday) {
+	const time_t now = time(nullptr);
+	const std::string today = FormatDay(now);
+	const std::string month_start = today.substr(0, 8) + "01";
+
+	ConsumptionFetcher fetcher("token");
+	const ConsumptionReport report = fetcher.Fetch(month_start, today);
+	fetcher.Fetch(month_start, today);
+
+	// Текущий месяц не кешируется и запрашивается до завтрашнего дня
+	const std::vector<std::pair<std::string, std::string>> periods = Periods();
+	ASSERT_EQ(2u, periods.size());
+	for (const auto &period : periods) {
+		EXPECT_EQ(month_start, period.first);
+		EXPECT_EQ(FormatDay(now + SECONDS_PER_DAY), period.second);
+	}
+	EXPECT_EQ(0u, fetcher.GetStats().memory_hits);
+	EXPECT_EQ(0u, fetcher.GetStats().cached_months);
+	EXPECT_EQ(today, report.days.rbegin()->first);
+	EXPECT_EQ((size_t) atoi(today.c_str() + 8), report.days.size());
+}
+
+} // namespace
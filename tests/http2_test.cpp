@@ -0,0 +1,70 @@
+#include <vscale/vscale.h>
+#include <gtest/gtest.h>
+#include "stub_server.h"
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+class Http2Test : public ::testing::Test {
+protected:
+	void SetUp() override {
+		Transport::SetBaseURL(m_server.BaseURL());
+		Transport::SetHttpVersion(Transport::hvHTTP2);
+		RetryPolicy::Disable();
+		m_server.Handle("GET", "/v1/scalets", [](const StubRequest &request, StubResponse &response) {
+			if (request.path != "/v1/scalets") {
+				response.body = "{\"ctid\": " + request.path.substr(request.path.rfind('/') + 1) + "}";
+				return;
+			}
+			response.body = "[";
+			for (int id = 1; id <= 500; ++id)
+				response.body += (id > 1 ? ", " : "") + string("{\"ctid\": ") + std::to_string(id) + ", \"name\": \"scalet\"}";
+			response.body += "]";
+		});
+	}
+
+	void TearDown() override {
+		RetryPolicy::Enable();
+		Transport::SetHttpVersion(Transport::hvHTTP1_1);
+		Transport::SetBaseURL("");
+	}
+
+	StubServer m_server{StubServer::smTLS};
+};
+
+TEST_F(Http2Test, SyncAsyncAndStreamingShareOneConnection) {
+	Scalets scalets("token");
+	JsonValue response;
+	scalets.Info(1, response);
+	EXPECT_EQ(1, response["ctid"].asInt());
+
+	std::vector<std::future<JsonValue>> pending;
+	for (int id = 1; id <= 100; ++id)
+		pending.push_back(scalets.InfoAsync(id));
+	for (int id = 1; id <= 100; ++id)
+		EXPECT_EQ(id, pending[id - 1].get()["ctid"].asInt());
+
+	int elements = 0;
+	scalets.List([&elements](const JsonValue &element) {
+		EXPECT_EQ(++elements, element["ctid"].asInt());
+	});
+	EXPECT_EQ(500, elements);
+
+	for (const auto &request : m_server.Requests())
+		EXPECT_TRUE(request.http2) << request.path;
+	EXPECT_EQ(102u, m_server.GetStats().requests);
+	EXPECT_EQ(m_server.GetStats().connections, m_server.GetStats().http2_connections);
+	EXPECT_LE(m_server.GetStats().connections, 2u);
+}
+
+TEST_F(Http2Test, StreamingHandlerErrorReachesCaller) {
+	Scalets scalets("token");
+	EXPECT_THROW(scalets.List([](const JsonValue &element) {
+		if (element["ctid"].asInt() == 10)
+			throw BadRequest("stop");
+	}), BadRequest);
+}
+
+} // namespace
@@ -0,0 +1,113 @@
+#include <vscale/inventory.h>
+#include <gtest/gtest.h>
+#include "stub_server.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <mutex>
+#include <unistd.h>
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+class InventoryTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		Transport::SetBaseURL(m_server.BaseURL());
+		RetryPolicy::Disable();
+		m_tags = "[{\"id\": 5, \"name\": \"web\", \"scalets\": [1, 2]}, {\"id\": 6, \"name\": \"db\", \"scalets\": [3]}]";
+		// В списке серверов теги - ссылки без имени
+		m_server.Handle("GET", "/v1/scalets/tags", [this](const StubRequest &, StubResponse &response) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			response.body = m_tags;
+		});
+		m_server.Handle("GET", "/v1/scalets", [](const StubRequest &, StubResponse &response) {
+			response.body = "[{\"ctid\": 1, \"name\": \"a\", \"location\": \"spb0\", \"tags\": [5]},"
+					" {\"ctid\": 2, \"name\": \"b\", \"location\": \"msk0\", \"tags\": [{\"id\": 5}]},"
+					" {\"ctid\": 3, \"name\": \"c\", \"location\": \"spb0\", \"tags\": [6]}]";
+		});
+		m_server.Handle("GET", "/v1/", [](const StubRequest &, StubResponse &response) {
+			response.body = "[]";
+		});
+	}
+
+	void TearDown() override {
+		RetryPolicy::Enable();
+		Transport::SetBaseURL("");
+	}
+
+	void SetTags(const std::string &tags) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tags = tags;
+	}
+
+	static std::vector<int> Ids(const std::vector<ScaletInfo> &scalets) {
+		std::vector<int> ids;
+		for (const auto &scalet : scalets)
+			ids.push_back(scalet.ctid);
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	StubServer m_server;
+	std::mutex m_mutex;
+	std::string m_tags;
+};
+
+TEST_F(InventoryTest, ScaletsByTagResolvesBareTagIds) {
+	Inventory inventory("token");
+	inventory.Refresh();
+	EXPECT_EQ(std::vector<int>({1, 2}), Ids(inventory.ScaletsByTag("web")));
+	EXPECT_EQ(std::vector<int>({3}), Ids(inventory.ScaletsByTag("db")));
+	EXPECT_EQ(std::vector<int>({1}), Ids(inventory.ScaletsByTag("web", "spb0")));
+	EXPECT_TRUE(inventory.ScaletsByTag("").empty());
+}
+
+TEST_F(InventoryTest, TagChangesReindexScalets) {
+	Inventory inventory("token");
+	inventory.Refresh();
+	// Переименование тега и сервер, которого еще нет в списке серверов
+	SetTags("[{\"id\": 5, \"name\": \"frontend\", \"scalets\": [2, 4]}, {\"id\": 6, \"name\": \"db\", \"scalets\": [3]}]");
+	inventory.Refresh();
+	EXPECT_TRUE(inventory.ScaletsByTag("web").empty());
+	EXPECT_EQ(std::vector<int>({2}), Ids(inventory.ScaletsByTag("frontend")));
+	EXPECT_EQ(std::vector<int>({3}), Ids(inventory.ScaletsByTag("db")));
+}
+
+TEST_F(InventoryTest, RefreshAsyncSavesSnapshotAtomically) {
+	char buffer[] = "/tmp/vscale-inventory-XXXXXX";
+	ASSERT_NE(nullptr, mkdtemp(buffer));
+	const std::string directory = buffer;
+	const std::string snapshot = directory + "/inventory.bin";
+	{
+		Inventory inventory("token");
+		inventory.RefreshAsync(snapshot).get();
+		inventory.RefreshAsync(snapshot).get();
+		// Деструктор ждет незавершенное обновление
+		inventory.RefreshAsync(snapshot);
+	}
+
+	// Временные файлы записи не остаются
+	std::vector<std::string> files;
+	DIR *dir = opendir(directory.c_str());
+	ASSERT_NE(nullptr, dir);
+	while (struct dirent *entry = readdir(dir)) {
+		if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+			files.push_back(entry->d_name);
+	}
+	closedir(dir);
+	EXPECT_EQ(std::vector<std::string>(1, "inventory.bin"), files);
+
+	Inventory loaded("token");
+	EXPECT_TRUE(loaded.Load(snapshot));
+	EXPECT_EQ(std::vector<int>({1, 2}), Ids(loaded.ScaletsByTag("web")));
+
+	for (const auto &file : files)
+		remove((directory + "/" + file).c_str());
+	rmdir(directory.c_str());
+}
+
+} // namespace
@@ -0,0 +1,304 @@
+#include <vscale/provisioner.h>
+#include <gtest/gtest.h>
+#include "stub_server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+#define FIRST_CTID 		100
+#define NODE_LIMIT 		8
+
+JsonValue ParseBody(const std::string &body) {
+	JsonValue value;
+	std::istringstream stream(body);
+	std::string errors;
+	Json::parseFromStream(Json::CharReaderBuilder(), stream, &value, &errors);
+	return value;
+}
+
+/// Номер сервера из пути вида /v1/scalets/{id}
+int ScaletId(const std::string &path) {
+	return atoi(path.c_str() + strlen("/v1/scalets/"));
+}
+
+/// Публичный адрес сервера ctid, который отдает заглушка
+std::string Address(int ctid) {
+	return "10.0.0." + std::to_string(ctid - FIRST_CTID);
+}
+
+/// Серверы из тела обновления тега
+std::set<int> TagScalets(const StubRequest &request) {
+	const JsonValue params = ParseBody(request.body);
+	std::set<int> scalets;
+	for (const JsonValue &ctid : params["scalets"])
+		scalets.insert(ctid.asInt());
+	return scalets;
+}
+
+/*
+* Заглушка API создания серверов: сервер node-N получает идентификатор
+* FIRST_CTID + N, операции над серверами сразу завершены.
+*/
+class ProvisionerTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		Transport::SetBaseURL(m_server.BaseURL());
+		RetryPolicy::Disable();
+		// Операция создания каждого сервера уже завершена, для серверов из m_failed_tasks - ошибкой
+		m_server.Handle("GET", "/v1/tasks", [this](const StubRequest &, StubResponse &response) {
+			response.body = "[";
+			for (int ctid = FIRST_CTID; ctid < FIRST_CTID + NODE_LIMIT; ++ctid) {
+				if (ctid != FIRST_CTID)
+					response.body += ", ";
+				response.body += "{\"id\": \"create-" + std::to_string(ctid) + "\", \"scalet\": " + std::to_string(ctid)
+						+ ", \"method\": \"scalet_create\", \"done\": true, \"error\": "
+						+ (m_failed_tasks.count(ctid) != 0 ? "true" : "false") + "}";
+			}
+			response.body += "]";
+		});
+		m_server.Handle("GET", "/v1/scalets/tags", [](const StubRequest &, StubResponse &response) {
+			response.body = "[{\"id\": 10, \"name\": \"web\", \"scalets\": [1]}, {\"id\": 11, \"name\": \"db\", \"scalets\": []}]";
+		});
+		m_server.Handle("PUT", "/v1/scalets/tags/", [this](const StubRequest &request, StubResponse &response) {
+			if (m_tag_handler)
+				m_tag_handler(request);
+			response.body = "{}";
+		});
+		m_server.Handle("GET", "/v1/scalets/", [](const StubRequest &request, StubResponse &response) {
+			const int ctid = ScaletId(request.path);
+			response.body = "{\"ctid\": " + std::to_string(ctid) + ", \"public_address\": {\"address\": \"" + Address(ctid) + "\"}}";
+		});
+		m_server.Handle("POST", "/v1/scalets", [](const StubRequest &request, StubResponse &response) {
+			const std::string name = ParseBody(request.body)["name"].asString();
+			response.body = "{\"ctid\": " + std::to_string(FIRST_CTID + atoi(name.c_str() + strlen("node-"))) + "}";
+		});
+	}
+
+	void TearDown() override {
+		RetryPolicy::Enable();
+		Transport::SetBaseURL("");
+	}
+
+	static Provisioner::Node MakeNode(int number) {
+		Provisioner::Node node;
+		node.params["name"] = "node-" + std::to_string(number);
+		return node;
+	}
+
+	/// Номер первого полученного запроса, для которого match возвращает true
+	size_t Position(const std::function<bool(const StubRequest &request)> &match) const {
+		const std::vector<StubRequest> requests = m_server.Requests();
+		for (size_t i = 0; i < requests.size(); ++i) {
+			if (match(requests[i]))
+				return i;
+		}
+		return requests.size();
+	}
+
+	std::function<void(const StubRequest &request)> m_tag_handler;
+	/// Задается до Run
+	std::set<int> m_failed_tasks;
+	StubServer m_server;
+};
+
+TEST_F(ProvisionerTest, StagesRunInOrderPerNode) {
+	m_server.Handle("GET", "/v1/sshkeys", [](const StubRequest &, StubResponse &response) {
+		response.body = "[{\"id\": 7, \"key\": \"ssh-rsa known\"}]";
+	});
+	m_server.Handle("POST", "/v1/sshkeys", [](const StubRequest &, StubResponse &response) {
+		response.body = "{\"id\": 8}";
+	});
+	m_server.Handle("POST", "/v1/domains/ptr/", [](const StubRequest &request, StubResponse &response) {
+		if (ParseBody(request.body)["content"].asString() == "node-2.example.com") {
+			response.status = 400;
+			response.headers.emplace_back("Vscale-Error-Message", "ptr rejected");
+			return;
+		}
+		response.body = "{}";
+	});
+	m_server.Handle("POST", "/v1/domains/5/records", [](const StubRequest &, StubResponse &response) {
+		response.body = "{}";
+	});
+
+	Provisioner::Options options;
+	JsonValue known, added;
+	known["key"] = "ssh-rsa known";
+	added["key"] = "ssh-rsa added";
+	added["name"] = "added";
+	options.keys = {known, added};
+
+	std::vector<Provisioner::Node> nodes;
+	for (int number = 0; number < 4; ++number) {
+		Provisioner::Node node = MakeNode(number);
+		node.tags.push_back(10);
+		node.ptr = "node-" + std::to_string(number) + ".example.com";
+		node.domain_id = 5;
+		node.record_name = "node-" + std::to_string(number);
+		nodes.push_back(node);
+	}
+	Provisioner provisioner("token", options);
+	const std::vector<Provisioner::Result> results = provisioner.Run(nodes);
+
+	ASSERT_EQ(nodes.size(), results.size());
+	EXPECT_EQ(1u, m_server.Count("POST", "/v1/sshkeys"));
+	const size_t first_create = Position([](const StubRequest &request) {
+		return request.method == "POST" && request.path == "/v1/scalets";
+	});
+	EXPECT_LT(Position([](const StubRequest &request) { return request.path == "/v1/sshkeys"; }), first_create);
+
+	for (int number = 0; number < 4; ++number) {
+		const int ctid = FIRST_CTID + number;
+		const std::string address = Address(ctid);
+		const Provisioner::Result &result = results[number];
+		EXPECT_EQ(ctid, result.ctid);
+		EXPECT_EQ(address, result.address);
+
+		const size_t create = Position([number](const StubRequest &request) {
+			const JsonValue params = ParseBody(request.body);
+			return request.method == "POST" && request.path == "/v1/scalets" && params["name"].asString() == "node-" + std::to_string(number)
+					&& params["keys"] == ParseBody("[7, 8]");
+		});
+		const size_t info = Position([ctid](const StubRequest &request) {
+			return request.method == "GET" && request.path == "/v1/scalets/" + std::to_string(ctid);
+		});
+		const size_t tag = Position([ctid](const StubRequest &request) {
+			return request.method == "PUT" && TagScalets(request).count(ctid) != 0;
+		});
+		const size_t ptr = Position([address](const StubRequest &request) {
+			return request.path == "/v1/domains/ptr/" && ParseBody(request.body)["ip"].asString() == address;
+		});
+		const size_t record = Position([address](const StubRequest &request) {
+			return request.path == "/v1/domains/5/records" && ParseBody(request.body)["content"].asString() == address;
+		});
+		EXPECT_LT(create, info);
+		EXPECT_LT(info, tag);
+		EXPECT_LT(tag, ptr);
+		if (number == 2) {
+			// Ошибка останавливает конвейер только для этого сервера
+			EXPECT_FALSE(result.success);
+			EXPECT_EQ(Provisioner::psPTR, result.stage);
+			EXPECT_EQ("ptr rejected", result.error);
+			EXPECT_EQ(m_server.Requests().size(), record);
+		} else {
+			EXPECT_TRUE(result.success);
+			EXPECT_EQ(Provisioner::psCount, result.stage);
+			EXPECT_LT(ptr, record);
+			EXPECT_LT(record, m_server.Requests().size());
+		}
+	}
+
+	EXPECT_EQ(4u, provisioner.GetStats(Provisioner::psCreate).succeeded);
+	EXPECT_EQ(1u, provisioner.GetStats(Provisioner::psPTR).failed);
+	EXPECT_EQ(3u, provisioner.GetStats(Provisioner::psRecord).succeeded);
+}
+
+TEST_F(ProvisionerTest, TagUpdatesAreSerializedAndBatched) {
+	std::mutex mutex;
+	int active[2] = {0, 0}, max_active[2] = {0, 0};
+	std::vector<std::set<int>> updates[2];
+	m_tag_handler = [&](const StubRequest &request) {
+		const int tag = request.path == "/v1/scalets/tags/10" ? 0 : 1;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			max_active[tag] = std::max(max_active[tag], ++active[tag]);
+			updates[tag].push_back(TagScalets(request));
+		}
+		// Обновление выполняется, пока остальные серверы не дойдут до этапа тегов:
+		// запрос адреса - последний перед ним
+		const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (m_server.Count("GET", "/v1/scalets/10") < 6 && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		std::lock_guard<std::mutex> lock(mutex);
+		--active[tag];
+	};
+
+	std::vector<Provisioner::Node> nodes;
+	for (int number = 0; number < 6; ++number) {
+		Provisioner::Node node = MakeNode(number);
+		node.tags.push_back(10);
+		if (number % 2 != 0)
+			node.tags.push_back(11);
+		nodes.push_back(node);
+	}
+	const std::vector<Provisioner::Result> results = Provisioner("token").Run(nodes);
+	for (const auto &result : results)
+		EXPECT_TRUE(result.success) << result.error;
+
+	// Обновления одного тега не пересекаются, и каждое следующее содержит серверы
+	// предыдущего, так как заменяет весь список
+	std::set<int> web = {1}, db;
+	for (int number = 0; number < 6; ++number) {
+		web.insert(FIRST_CTID + number);
+		if (number % 2 != 0)
+			db.insert(FIRST_CTID + number);
+	}
+	EXPECT_EQ(1, max_active[0]);
+	EXPECT_EQ(1, max_active[1]);
+	// Первое обновление - для первого дошедшего сервера, второе - для всех остальных
+	ASSERT_EQ(2u, updates[0].size());
+	ASSERT_EQ(2u, updates[1].size());
+	EXPECT_EQ(web, updates[0].back());
+	EXPECT_EQ(db, updates[1].back());
+	for (const auto &tag : updates) {
+		for (size_t i = 1; i < tag.size(); ++i)
+			EXPECT_TRUE(std::includes(tag[i].begin(), tag[i].end(), tag[i - 1].begin(), tag[i - 1].end()));
+	}
+	EXPECT_EQ(updates[0].size() + updates[1].size(), m_server.Count("PUT", "/v1/scalets/tags/"));
+}
+
+TEST_F(ProvisionerTest, FailedCreateTaskStopsNode) {
+	m_server.Handle("POST", "/v1/domains/", [](const StubRequest &, StubResponse &response) {
+		response.body = "{}";
+	});
+	m_failed_tasks.insert(FIRST_CTID + 1);
+
+	std::vector<Provisioner::Node> nodes;
+	for (int number = 0; number < 3; ++number) {
+		Provisioner::Node node = MakeNode(number);
+		node.tags.push_back(10);
+		node.ptr = "node-" + std::to_string(number) + ".example.com";
+		node.domain_id = 5;
+		node.record_name = "node-" + std::to_string(number);
+		nodes.push_back(node);
+	}
+	const std::vector<Provisioner::Result> results = Provisioner("token").Run(nodes);
+
+	ASSERT_EQ(nodes.size(), results.size());
+	EXPECT_TRUE(results[0].success) << results[0].error;
+	EXPECT_TRUE(results[2].success) << results[2].error;
+
+	// Сервер создан, но операция создания не удалась: дальше конвейер не идет
+	const int failed = FIRST_CTID + 1;
+	EXPECT_FALSE(results[1].success);
+	EXPECT_EQ(Provisioner::psWait, results[1].stage);
+	EXPECT_EQ("scalet operation failed", results[1].error);
+	EXPECT_EQ(failed, results[1].ctid);
+	EXPECT_TRUE(results[1].address.empty());
+
+	const size_t none = m_server.Requests().size();
+	EXPECT_EQ(none, Position([failed](const StubRequest &request) {
+		return request.method == "GET" && request.path == "/v1/scalets/" + std::to_string(failed);
+	}));
+	EXPECT_EQ(none, Position([failed](const StubRequest &request) {
+		return request.method == "PUT" && TagScalets(request).count(failed) != 0;
+	}));
+	EXPECT_EQ(none, Position([](const StubRequest &request) {
+		return request.path.compare(0, strlen("/v1/domains/"), "/v1/domains/") == 0
+				&& request.body.find("node-1") != std::string::npos;
+	}));
+	EXPECT_EQ(2u, m_server.Count("POST", "/v1/domains/ptr/"));
+	EXPECT_EQ(2u, m_server.Count("POST", "/v1/domains/5/records"));
+}
+
+} // namespace
@@ -0,0 +1,114 @@
+#include <vscale/vscale.h>
+#include <gtest/gtest.h>
+#include "stub_server.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifdef __SANITIZE_THREAD__
+// Под TSAN запрос стоит миллисекунды процессорного времени, задержка должна оставаться больше
+#define STRESS_SERVER_DELAY 			std::chrono::milliseconds(50)
+#else
+#define STRESS_SERVER_DELAY 			std::chrono::milliseconds(5)
+#endif
+#define STRESS_DURATION 			std::chrono::milliseconds(400)
+#define STRESS_MAX_THREADS 			8
+#define STRESS_MIN_EFFICIENCY 			0.6
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/*
+* Сервер отвечает с задержкой, поэтому пропускная способность ограничена
+* задержкой, а не процессором: при отсутствии общей блокировки на пути запроса
+* она растет линейно с числом потоков даже на одном ядре.
+*/
+class StressTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		Transport::SetBaseURL(m_server.BaseURL());
+		RetryPolicy::Disable();
+		SingleFlight::Disable();
+		m_server.Handle("GET", "/v1/", [](const StubRequest &request, StubResponse &response) {
+			std::this_thread::sleep_for(STRESS_SERVER_DELAY);
+			response.body = "{\"path\": \"" + request.path + "\"}";
+		});
+	}
+
+	void TearDown() override {
+		SingleFlight::Enable();
+		RetryPolicy::Enable();
+		Transport::SetBaseURL("");
+	}
+
+	/// Синхронные запросы из threads потоков, возвращает запросы в секунду
+	double Throughput(unsigned threads) {
+		std::atomic<uint64_t> calls(0), failures(0);
+		std::vector<std::thread> workers;
+		const Clock::time_point started = Clock::now();
+		const Clock::time_point deadline = started + STRESS_DURATION;
+		for (unsigned i = 0; i < threads; ++i) {
+			workers.emplace_back([&calls, &failures, deadline, i]() {
+				Scalets scalets("token");
+				ServerTags tags("token");
+				JsonValue response;
+				while (Clock::now() < deadline) {
+					try {
+						if (i % 2 == 0)
+							scalets.Info((int) i, response);
+						else
+							tags.List(response);
+						++calls;
+					} catch (const BadRequest &) {
+						++failures;
+					}
+				}
+			});
+		}
+		for (auto &worker : workers)
+			worker.join();
+		EXPECT_EQ(0u, failures.load());
+		return calls / std::chrono::duration<double>(Clock::now() - started).count();
+	}
+
+	StubServer m_server{StubServer::smPlain, false};
+};
+
+TEST_F(StressTest, SyncThroughputScalesWithThreads) {
+	const double base = Throughput(1);
+	ASSERT_GT(base, 0);
+	for (unsigned threads = 2; threads <= STRESS_MAX_THREADS; threads *= 2) {
+		const double throughput = Throughput(threads);
+		EXPECT_GE(throughput, base * threads * STRESS_MIN_EFFICIENCY) << threads << " threads";
+	}
+}
+
+TEST_F(StressTest, AsyncFromManyThreads) {
+	const unsigned threads = STRESS_MAX_THREADS;
+	const int per_thread = 100;
+	std::atomic<int> completed(0);
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < threads; ++i) {
+		workers.emplace_back([&completed, i]() {
+			Scalets scalets("token");
+			std::vector<std::future<JsonValue>> pending;
+			for (int id = 0; id < per_thread; ++id) {
+				pending.push_back(scalets.InfoAsync((int) i * per_thread + id, [&completed](const JsonValue &, std::exception_ptr error) {
+					if (!error)
+						++completed;
+				}));
+			}
+			for (int id = 0; id < per_thread; ++id)
+				EXPECT_EQ("/v1/scalets/" + std::to_string(i * per_thread + id), pending[id].get()["path"].asString());
+		});
+	}
+	for (auto &worker : workers)
+		worker.join();
+	EXPECT_EQ((int) threads * per_thread, completed.load());
+}
+
+} // namespace
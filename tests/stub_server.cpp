@@ -0,0 +1,1010 @@
+#include "stub_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#define STUB_HTTP2_PREFACE 			"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define STUB_HTTP2_PREFACE_SIZE 		24
+#define STUB_HTTP2_FRAME_HEADER 		9
+#define STUB_HTTP2_MAX_FRAME 			16384
+#define STUB_HTTP2_MAX_STREAMS 			1000
+#define STUB_HPACK_TABLE_SIZE 			4096
+#define STUB_HPACK_ENTRY_OVERHEAD 		32
+#define STUB_READ_BUFFER 			16384
+
+namespace vscale {
+namespace test {
+
+using std::string;
+
+namespace {
+
+/// Таблицы HPACK (RFC 7541, приложения A и B)
+const uint32_t HUFFMAN_CODES[256] = {
+	0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+	0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+	0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+	0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+	0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+	0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+	0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+	0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+	0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+	0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+	0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+	0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+	0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+	0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+	0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+	0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+	0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+	0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+	0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+	0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+	0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+	0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+	0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+	0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+	0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+	0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+	0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+	0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+	0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+	0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee
+};
+
+const uint8_t HUFFMAN_LENGTHS[256] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26
+};
+
+const char *const STATIC_TABLE[61][2] = {
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""}
+};
+
+enum FrameType {
+	ftData = 0x0,
+	ftHeaders = 0x1,
+	ftRstStream = 0x3,
+	ftSettings = 0x4,
+	ftPing = 0x6,
+	ftGoAway = 0x7,
+	ftWindowUpdate = 0x8,
+	ftContinuation = 0x9
+};
+
+enum FrameFlag {
+	ffEndStream = 0x1,
+	ffAck = 0x1,
+	ffEndHeaders = 0x4,
+	ffPadded = 0x8,
+	ffPriority = 0x20
+};
+
+string Lower(string value) {
+	for (auto &c : value)
+		c = (char) tolower((unsigned char) c);
+	return value;
+}
+
+string Trim(const string &value) {
+	size_t begin = 0, end = value.size();
+	while (begin < end && isspace((unsigned char) value[begin]))
+		++begin;
+	while (end > begin && isspace((unsigned char) value[end - 1]))
+		--end;
+	return value.substr(begin, end - begin);
+}
+
+const char *Reason(int status) {
+	switch (status) {
+		case 200: return "OK";
+		case 201: return "Created";
+		case 204: return "No Content";
+		case 304: return "Not Modified";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 429: return "Too Many Requests";
+		case 500: return "Internal Server Error";
+		case 503: return "Service Unavailable";
+		default: return "Status";
+	}
+}
+
+string Gzip(const string &data) {
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+	string out(deflateBound(&stream, data.size()), '\0');
+	stream.next_in = (Bytef *) data.data();
+	stream.avail_in = (uInt) data.size();
+	stream.next_out = (Bytef *) &out[0];
+	stream.avail_out = (uInt) out.size();
+	deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+	return out;
+}
+
+/// Сокет соединения и, в режиме TLS, сессия OpenSSL
+class Connection {
+public:
+	Connection(int fd, SSL *ssl): m_fd(fd), m_ssl(ssl) {}
+
+	long Read(char *buffer, size_t size) {
+		if (m_ssl != nullptr)
+			return SSL_read(m_ssl, buffer, (int) size);
+		return recv(m_fd, buffer, size, 0);
+	}
+
+	bool Write(const char *data, size_t size) {
+		while (size > 0) {
+			const long written = m_ssl != nullptr ? SSL_write(m_ssl, data, (int) size) : send(m_fd, data, size, MSG_NOSIGNAL);
+			if (written <= 0)
+				return false;
+			data += written;
+			size -= (size_t) written;
+		}
+		return true;
+	}
+
+	bool Write(const string &data) {
+		return Write(data.data(), data.size());
+	}
+
+	int Fd() const {
+		return m_fd;
+	}
+
+	/// Есть расшифрованные, но еще не прочитанные данные
+	bool Buffered() const {
+		return m_ssl != nullptr && SSL_pending(m_ssl) > 0;
+	}
+
+	/// Дочитывает в buffer, пока в нем не будет хотя бы size байт
+	bool Fill(string &buffer, size_t size) {
+		char chunk[STUB_READ_BUFFER];
+		while (buffer.size() < size) {
+			const long read = Read(chunk, sizeof(chunk));
+			if (read <= 0)
+				return false;
+			buffer.append(chunk, (size_t) read);
+		}
+		return true;
+	}
+
+private:
+	int m_fd;
+	SSL *m_ssl;
+};
+
+/// Декодер Хаффмана HPACK: код и его длина -> символ
+class HuffmanTable {
+public:
+	static const HuffmanTable &Instance() {
+		static HuffmanTable instance;
+		return instance;
+	}
+
+	bool Decode(const uint8_t *data, size_t size, string &out) const {
+		uint64_t code = 0;
+		unsigned length = 0;
+		for (size_t i = 0; i < size; ++i) {
+			for (int bit = 7; bit >= 0; --bit) {
+				code = (code << 1) | ((data[i] >> bit) & 1);
+				if (++length > 30)
+					return false;
+				auto it = m_symbols.find(((uint64_t) length << 32) | code);
+				if (it != m_symbols.end()) {
+					out.push_back((char) it->second);
+					code = 0;
+					length = 0;
+				}
+			}
+		}
+		// Остаток - дополнение единичными битами не длиннее байта
+		return length < 8;
+	}
+
+private:
+	HuffmanTable() {
+		for (unsigned symbol = 0; symbol < 256; ++symbol)
+			m_symbols[((uint64_t) HUFFMAN_LENGTHS[symbol] << 32) | HUFFMAN_CODES[symbol]] = (uint8_t) symbol;
+	}
+
+	std::unordered_map<uint64_t, uint8_t> m_symbols;
+};
+
+/// Декодер заголовков HPACK одного соединения
+class HpackDecoder {
+public:
+	typedef std::pair<string, string> Field;
+
+	HpackDecoder(): m_size(0), m_max_size(STUB_HPACK_TABLE_SIZE) {}
+
+	bool Decode(const string &block, std::vector<Field> &fields) {
+		const uint8_t *p = (const uint8_t *) block.data();
+		const uint8_t *end = p + block.size();
+		while (p < end) {
+			uint64_t index = 0;
+			Field field;
+			if (*p & 0x80) {
+				if (!Integer(p, end, 7, index) || !Entry(index, field))
+					return false;
+				fields.push_back(field);
+			} else if (*p & 0x40) {
+				if (!Literal(p, end, 6, field))
+					return false;
+				Insert(field);
+				fields.push_back(field);
+			} else if (*p & 0x20) {
+				if (!Integer(p, end, 5, index))
+					return false;
+				m_max_size = (size_t) index;
+				Evict();
+			} else {
+				if (!Literal(p, end, 4, field))
+					return false;
+				fields.push_back(field);
+			}
+		}
+		return true;
+	}
+
+private:
+	static bool Integer(const uint8_t *&p, const uint8_t *end, int prefix, uint64_t &value) {
+		const uint8_t mask = (uint8_t) ((1 << prefix) - 1);
+		value = *p++ & mask;
+		if (value < mask)
+			return true;
+		for (unsigned shift = 0; p < end && shift < 56; shift += 7) {
+			const uint8_t byte = *p++;
+			value += (uint64_t) (byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	static bool String(const uint8_t *&p, const uint8_t *end, string &out) {
+		if (p >= end)
+			return false;
+		const bool huffman = (*p & 0x80) != 0;
+		uint64_t size = 0;
+		if (!Integer(p, end, 7, size) || size > (uint64_t) (end - p))
+			return false;
+		if (huffman && !HuffmanTable::Instance().Decode(p, (size_t) size, out))
+			return false;
+		if (!huffman)
+			out.assign((const char *) p, (size_t) size);
+		p += size;
+		return true;
+	}
+
+	bool Literal(const uint8_t *&p, const uint8_t *end, int prefix, Field &field) {
+		uint64_t index = 0;
+		if (!Integer(p, end, prefix, index))
+			return false;
+		if (index != 0) {
+			Field named;
+			if (!Entry(index, named))
+				return false;
+			field.first = named.first;
+		} else if (!String(p, end, field.first)) {
+			return false;
+		}
+		return String(p, end, field.second);
+	}
+
+	bool Entry(uint64_t index, Field &field) const {
+		if (index == 0)
+			return false;
+		if (index <= 61) {
+			field = Field(STATIC_TABLE[index - 1][0], STATIC_TABLE[index - 1][1]);
+			return true;
+		}
+		index -= 62;
+		if (index >= m_table.size())
+			return false;
+		field = m_table[(size_t) index];
+		return true;
+	}
+
+	void Insert(const Field &field) {
+		m_table.push_front(field);
+		m_size += field.first.size() + field.second.size() + STUB_HPACK_ENTRY_OVERHEAD;
+		Evict();
+	}
+
+	void Evict() {
+		while (m_size > m_max_size && !m_table.empty()) {
+			m_size -= m_table.back().first.size() + m_table.back().second.size() + STUB_HPACK_ENTRY_OVERHEAD;
+			m_table.pop_back();
+		}
+	}
+
+	std::deque<Field> m_table;
+	size_t m_size, m_max_size;
+};
+
+/// Целое HPACK с префиксом prefix бит, flags - старшие биты первого байта
+void EncodeInteger(string &out, int prefix, uint8_t flags, uint64_t value) {
+	const uint64_t mask = (1u << prefix) - 1;
+	if (value < mask) {
+		out.push_back((char) (flags | value));
+		return;
+	}
+	out.push_back((char) (flags | mask));
+	value -= mask;
+	while (value >= 0x80) {
+		out.push_back((char) (0x80 | (value & 0x7f)));
+		value >>= 7;
+	}
+	out.push_back((char) value);
+}
+
+/// Поле заголовка как литерал без индексирования с новым именем
+void EncodeField(string &out, const string &name, const string &value) {
+	out.push_back('\0');
+	EncodeInteger(out, 7, 0, name.size());
+	out.append(name);
+	EncodeInteger(out, 7, 0, value.size());
+	out.append(value);
+}
+
+string Frame(uint8_t type, uint8_t flags, uint32_t stream, const char *payload, size_t size) {
+	string frame;
+	frame.reserve(STUB_HTTP2_FRAME_HEADER + size);
+	frame.push_back((char) ((size >> 16) & 0xff));
+	frame.push_back((char) ((size >> 8) & 0xff));
+	frame.push_back((char) (size & 0xff));
+	frame.push_back((char) type);
+	frame.push_back((char) flags);
+	frame.push_back((char) ((stream >> 24) & 0x7f));
+	frame.push_back((char) ((stream >> 16) & 0xff));
+	frame.push_back((char) ((stream >> 8) & 0xff));
+	frame.push_back((char) (stream & 0xff));
+	frame.append(payload, size);
+	return frame;
+}
+
+string WindowUpdate(uint32_t stream, uint32_t increment) {
+	const char payload[4] = {(char) ((increment >> 24) & 0x7f), (char) ((increment >> 16) & 0xff),
+			(char) ((increment >> 8) & 0xff), (char) (increment & 0xff)};
+	return Frame(ftWindowUpdate, 0, stream, payload, sizeof(payload));
+}
+
+uint32_t ReadUint32(const char *data) {
+	const uint8_t *p = (const uint8_t *) data;
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+const unsigned char ALPN_PROTOCOLS[] = "\x02h2\x08http/1.1";
+
+int SelectProtocol(SSL *, const unsigned char **out, unsigned char *outlen, const unsigned char *in, unsigned int inlen, void *) {
+	if (SSL_select_next_proto((unsigned char **) out, outlen, ALPN_PROTOCOLS, sizeof(ALPN_PROTOCOLS) - 1, in, inlen)
+			!= OPENSSL_NPN_NEGOTIATED)
+		return SSL_TLSEXT_ERR_NOACK;
+	return SSL_TLSEXT_ERR_OK;
+}
+
+/// Контекст TLS с самоподписанным сертификатом на 127.0.0.1
+SSL_CTX *CreateContext() {
+	SSL_CTX *context = SSL_CTX_new(TLS_server_method());
+	EVP_PKEY *key = EVP_EC_gen("P-256");
+	X509 *certificate = X509_new();
+	X509_set_version(certificate, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+	X509_gmtime_adj(X509_getm_notBefore(certificate), -3600);
+	X509_gmtime_adj(X509_getm_notAfter(certificate), 86400);
+	X509_set_pubkey(certificate, key);
+	X509_NAME *name = X509_get_subject_name(certificate);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *) "127.0.0.1", -1, -1, 0);
+	X509_set_issuer_name(certificate, name);
+	X509_sign(certificate, key, EVP_sha256());
+	SSL_CTX_use_certificate(context, certificate);
+	SSL_CTX_use_PrivateKey(context, key);
+	X509_free(certificate);
+	EVP_PKEY_free(key);
+	SSL_CTX_set_alpn_select_cb(context, SelectProtocol, nullptr);
+	SSL_CTX_set_session_id_context(context, (const unsigned char *) "vscale", 6);
+	return context;
+}
+
+} // namespace
+
+string StubRequest::Header(const string &name) const {
+	auto it = headers.find(name);
+	return it != headers.end() ? it->second : string();
+}
+
+class StubServer::Impl {
+public:
+	Impl(Mode mode, bool record): m_mode(mode), m_record(record), m_context(nullptr), m_stopped(false), m_handlers(0) {
+		signal(SIGPIPE, SIG_IGN);
+		ResetStats();
+		if (m_mode == smTLS)
+			m_context = CreateContext();
+
+		m_listener = socket(AF_INET, SOCK_STREAM, 0);
+		const int enable = 1;
+		setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = 0;
+		socklen_t length = sizeof(address);
+		if (bind(m_listener, (sockaddr *) &address, sizeof(address)) != 0 || listen(m_listener, SOMAXCONN) != 0
+				|| getsockname(m_listener, (sockaddr *) &address, &length) != 0)
+			throw std::runtime_error("stub server: cannot listen");
+		m_port = ntohs(address.sin_port);
+		m_acceptor = std::thread(&Impl::Accept, this);
+	}
+
+	~Impl() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopped = true;
+			for (int fd : m_sockets)
+				shutdown(fd, SHUT_RDWR);
+		}
+		shutdown(m_listener, SHUT_RDWR);
+		m_acceptor.join();
+		close(m_listener);
+		for (auto &worker : m_workers)
+			worker.join();
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idle.wait(lock, [this] { return m_handlers == 0; });
+		lock.unlock();
+		if (m_context != nullptr)
+			SSL_CTX_free(m_context);
+	}
+
+	string BaseURL() const {
+		return string(m_mode == smTLS ? "https" : "http") + "://127.0.0.1:" + std::to_string(m_port);
+	}
+
+	void Handle(const string &method, const string &prefix, const StubHandler &handler) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_routes.push_back(Route{method, prefix, handler});
+	}
+
+	std::vector<StubRequest> Requests() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_requests;
+	}
+
+	size_t Count(const string &method, const string &prefix) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t count = 0;
+		for (const auto &request : m_requests) {
+			if ((method.empty() || request.method == method) && request.path.compare(0, prefix.size(), prefix) == 0)
+				++count;
+		}
+		return count;
+	}
+
+	Stats GetStats() const {
+		Stats stats;
+		stats.connections = m_connections;
+		stats.handshakes = m_handshakes;
+		stats.resumed = m_resumed;
+		stats.http2_connections = m_http2_connections;
+		stats.requests = m_served;
+		stats.bytes_in = m_bytes_in;
+		stats.bytes_out = m_bytes_out;
+		return stats;
+	}
+
+	void Reset() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.clear();
+		ResetStats();
+	}
+
+private:
+	struct Route {
+		string method, prefix;
+		StubHandler handler;
+	};
+
+	struct Stream {
+		StubRequest request;
+		string block;
+	};
+
+	void ResetStats() {
+		m_connections = 0;
+		m_handshakes = 0;
+		m_resumed = 0;
+		m_http2_connections = 0;
+		m_served = 0;
+		m_bytes_in = 0;
+		m_bytes_out = 0;
+	}
+
+	void Accept() {
+		for (;;) {
+			const int fd = accept(m_listener, nullptr, nullptr);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_stopped) {
+				if (fd >= 0)
+					close(fd);
+				return;
+			}
+			if (fd < 0)
+				continue;
+			const int enable = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+			++m_connections;
+			m_sockets.insert(fd);
+			m_workers.emplace_back(&Impl::Serve, this, fd);
+		}
+	}
+
+	void Serve(int fd) {
+		SSL *ssl = nullptr;
+		bool http2 = false;
+		if (m_context != nullptr) {
+			ssl = SSL_new(m_context);
+			SSL_set_fd(ssl, fd);
+			if (SSL_accept(ssl) == 1) {
+				++m_handshakes;
+				if (SSL_session_reused(ssl))
+					++m_resumed;
+				const unsigned char *protocol = nullptr;
+				unsigned int length = 0;
+				SSL_get0_alpn_selected(ssl, &protocol, &length);
+				http2 = length == 2 && memcmp(protocol, "h2", 2) == 0;
+			} else {
+				SSL_free(ssl);
+				ssl = nullptr;
+				Close(fd);
+				return;
+			}
+		}
+
+		Connection connection(fd, ssl);
+		if (http2) {
+			++m_http2_connections;
+			ServeHttp2(connection);
+		} else {
+			ServeHttp1(connection);
+		}
+		if (ssl != nullptr) {
+			SSL_shutdown(ssl);
+			SSL_free(ssl);
+		}
+		Close(fd);
+	}
+
+	void Close(int fd) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_sockets.erase(fd);
+		close(fd);
+	}
+
+	void ServeHttp1(Connection &connection) {
+		string buffer;
+		for (;;) {
+			size_t head_end;
+			while ((head_end = buffer.find("\r\n\r\n")) == string::npos) {
+				if (!connection.Fill(buffer, buffer.size() + 1))
+					return;
+			}
+
+			StubRequest request;
+			request.http2 = false;
+			const string head = buffer.substr(0, head_end);
+			buffer.erase(0, head_end + 4);
+			size_t line_end = head.find("\r\n");
+			const string line = head.substr(0, line_end);
+			const size_t method_end = line.find(' ');
+			const size_t path_end = line.find(' ', method_end + 1);
+			if (method_end == string::npos || path_end == string::npos)
+				return;
+			request.method = line.substr(0, method_end);
+			request.path = line.substr(method_end + 1, path_end - method_end - 1);
+			const bool keep_alive = line.compare(path_end + 1, string::npos, "HTTP/1.1") == 0;
+			while (line_end != string::npos) {
+				const size_t begin = line_end + 2;
+				line_end = head.find("\r\n", begin);
+				const string header = head.substr(begin, line_end == string::npos ? string::npos : line_end - begin);
+				const size_t colon = header.find(':');
+				if (colon != string::npos)
+					request.headers[Lower(Trim(header.substr(0, colon)))] = Trim(header.substr(colon + 1));
+			}
+
+			const size_t length = (size_t) atol(request.Header("content-length").c_str());
+			if (Lower(request.Header("expect")) == "100-continue" && !connection.Write("HTTP/1.1 100 Continue\r\n\r\n"))
+				return;
+			if (!connection.Fill(buffer, length))
+				return;
+			request.body = buffer.substr(0, length);
+			buffer.erase(0, length);
+
+			const bool close = !keep_alive || Lower(request.Header("connection")) == "close";
+			StubResponse response;
+			Dispatch(request, response);
+
+			string out = "HTTP/1.1 " + std::to_string(response.status) + " " + Reason(response.status) + "\r\n";
+			out += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+			for (const auto &header : response.headers)
+				out += header.first + ": " + header.second + "\r\n";
+			if (close)
+				out += "Connection: close\r\n";
+			out += "\r\n";
+			out += response.body;
+			if (!connection.Write(out) || close)
+				return;
+		}
+	}
+
+	/*
+	* Сервер HTTP/2 без приоритетов и управления потоком на отправку:
+	* ответы заглушки малы по сравнению с окнами, которые объявляет libcurl.
+	* Каждый запрос обрабатывается отдельным потоком, как на HTTP/1.1 - отдельным
+	* соединением, поэтому медленные обработчики не выстраиваются в очередь.
+	* Сессией TLS пользуется только поток соединения: готовые ответы он забирает
+	* из очереди, о пополнении которой узнает через pipe.
+	*/
+	void ServeHttp2(Connection &connection) {
+		string buffer;
+		if (!connection.Fill(buffer, STUB_HTTP2_PREFACE_SIZE) || buffer.compare(0, STUB_HTTP2_PREFACE_SIZE, STUB_HTTP2_PREFACE) != 0)
+			return;
+		buffer.erase(0, STUB_HTTP2_PREFACE_SIZE);
+
+		const char settings[6] = {0x00, 0x03, 0x00, 0x00, (char) ((STUB_HTTP2_MAX_STREAMS >> 8) & 0xff), (char) (STUB_HTTP2_MAX_STREAMS & 0xff)};
+		if (!connection.Write(Frame(ftSettings, 0, 0, settings, sizeof(settings))))
+			return;
+
+		ReadFrames(connection, buffer, std::make_shared<Outbox>());
+	}
+
+	struct Outbox {
+		std::mutex mutex;
+		string data;
+		int wakeup[2];
+
+		Outbox() {
+			if (pipe(wakeup) != 0)
+				throw std::runtime_error("stub server: cannot create pipe");
+		}
+
+		~Outbox() {
+			close(wakeup[0]);
+			close(wakeup[1]);
+		}
+
+		void Push(const string &frames) {
+			std::lock_guard<std::mutex> lock(mutex);
+			data += frames;
+			const char byte = 0;
+			if (write(wakeup[1], &byte, 1) < 0)
+				return;
+		}
+	};
+
+	/// Ждет size байт в buffer, попутно отправляя готовые ответы
+	static bool Receive(Connection &connection, string &buffer, size_t size, Outbox &outbox) {
+		char chunk[STUB_READ_BUFFER];
+		while (buffer.size() < size) {
+			if (!connection.Buffered()) {
+				pollfd fds[2] = {{connection.Fd(), POLLIN, 0}, {outbox.wakeup[0], POLLIN, 0}};
+				if (poll(fds, 2, -1) < 0)
+					return false;
+				if (fds[1].revents & POLLIN) {
+					if (read(outbox.wakeup[0], chunk, sizeof(chunk)) < 0)
+						return false;
+					string frames;
+					{
+						std::lock_guard<std::mutex> lock(outbox.mutex);
+						frames.swap(outbox.data);
+					}
+					if (!connection.Write(frames))
+						return false;
+				}
+				if (fds[0].revents == 0)
+					continue;
+			}
+			const long received = connection.Read(chunk, sizeof(chunk));
+			if (received <= 0)
+				return false;
+			buffer.append(chunk, (size_t) received);
+		}
+		return true;
+	}
+
+	void ReadFrames(Connection &connection, string &buffer, const std::shared_ptr<Outbox> &outbox) {
+		HpackDecoder decoder;
+		std::unordered_map<uint32_t, Stream> streams;
+		for (;;) {
+			if (!Receive(connection, buffer, STUB_HTTP2_FRAME_HEADER, *outbox))
+				return;
+			const uint8_t *header = (const uint8_t *) buffer.data();
+			const size_t length = ((size_t) header[0] << 16) | ((size_t) header[1] << 8) | header[2];
+			const uint8_t type = header[3];
+			const uint8_t flags = header[4];
+			const uint32_t id = ReadUint32(buffer.data() + 5) & 0x7fffffff;
+			if (!Receive(connection, buffer, STUB_HTTP2_FRAME_HEADER + length, *outbox))
+				return;
+			string payload = buffer.substr(STUB_HTTP2_FRAME_HEADER, length);
+			buffer.erase(0, STUB_HTTP2_FRAME_HEADER + length);
+			bool ended = false;
+			switch (type) {
+				case ftSettings:
+					if (!(flags & ffAck) && !connection.Write(Frame(ftSettings, ffAck, 0, nullptr, 0)))
+						return;
+					continue;
+				case ftPing:
+					if (!(flags & ffAck) && !connection.Write(Frame(ftPing, ffAck, 0, payload.data(), payload.size())))
+						return;
+					continue;
+				case ftGoAway:
+					return;
+				case ftRstStream:
+					streams.erase(id);
+					continue;
+				case ftHeaders:
+				case ftContinuation: {
+					Stream &stream = streams[id];
+					size_t begin = 0, end = payload.size();
+					if (type == ftHeaders && (flags & ffPadded) && !payload.empty()) {
+						end -= std::min(end, (size_t) (uint8_t) payload[0]);
+						begin = 1;
+					}
+					if (type == ftHeaders && (flags & ffPriority))
+						begin += 5;
+					if (begin < end)
+						stream.block.append(payload, begin, end - begin);
+					if (type == ftHeaders && (flags & ffEndStream))
+						stream.request.http2 = true;
+					if (!(flags & ffEndHeaders))
+						continue;
+					std::vector<HpackDecoder::Field> fields;
+					if (!decoder.Decode(stream.block, fields))
+						return;
+					stream.block.clear();
+					for (const auto &field : fields) {
+						if (field.first == ":method")
+							stream.request.method = field.second;
+						else if (field.first == ":path")
+							stream.request.path = field.second;
+						else if (field.first[0] != ':')
+							stream.request.headers[field.first] = field.second;
+					}
+					// Флаг END_STREAM приходит в HEADERS; до конца блока заголовков он хранится в http2
+					ended = stream.request.http2;
+					break;
+				}
+				case ftData: {
+					auto it = streams.find(id);
+					if (it == streams.end())
+						continue;
+					size_t begin = 0, end = payload.size();
+					if ((flags & ffPadded) && !payload.empty()) {
+						end -= std::min(end, (size_t) (uint8_t) payload[0]);
+						begin = 1;
+					}
+					if (begin < end)
+						it->second.request.body.append(payload, begin, end - begin);
+					if (!payload.empty()) {
+						string update = WindowUpdate(0, (uint32_t) payload.size());
+						if (!(flags & ffEndStream))
+							update += WindowUpdate(id, (uint32_t) payload.size());
+						if (!connection.Write(update))
+							return;
+					}
+					ended = (flags & ffEndStream) != 0;
+					break;
+				}
+				default:
+					continue;
+			}
+			if (!ended)
+				continue;
+
+			StubRequest request = std::move(streams[id].request);
+			streams.erase(id);
+			request.http2 = true;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				++m_handlers;
+			}
+			std::thread([this, id, request, outbox]() {
+				StubResponse response;
+				Dispatch(request, response);
+				outbox->Push(Http2Response(id, response));
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (--m_handlers == 0)
+					m_idle.notify_all();
+			}).detach();
+		}
+	}
+
+	static string Http2Response(uint32_t id, const StubResponse &response) {
+		string block;
+		EncodeField(block, ":status", std::to_string(response.status));
+		EncodeField(block, "content-length", std::to_string(response.body.size()));
+		for (const auto &header : response.headers)
+			EncodeField(block, Lower(header.first), header.second);
+
+		string out = Frame(ftHeaders, ffEndHeaders | (response.body.empty() ? ffEndStream : 0), id, block.data(), block.size());
+		for (size_t offset = 0; offset < response.body.size(); offset += STUB_HTTP2_MAX_FRAME) {
+			const size_t size = std::min((size_t) STUB_HTTP2_MAX_FRAME, response.body.size() - offset);
+			const bool last = offset + size == response.body.size();
+			out += Frame(ftData, last ? ffEndStream : 0, id, response.body.data() + offset, size);
+		}
+		return out;
+	}
+
+	void Dispatch(const StubRequest &request, StubResponse &response) {
+		StubHandler handler;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_record)
+				m_requests.push_back(request);
+			for (const auto &route : m_routes) {
+				if ((route.method.empty() || route.method == request.method) && request.path.compare(0, route.prefix.size(), route.prefix) == 0) {
+					handler = route.handler;
+					break;
+				}
+			}
+		}
+		if (handler)
+			handler(request, response);
+		else
+			response.status = 404;
+
+		if (response.compress && !response.body.empty() && request.Header("accept-encoding").find("gzip") != string::npos) {
+			response.body = Gzip(response.body);
+			response.headers.emplace_back("Content-Encoding", "gzip");
+		}
+		++m_served;
+		m_bytes_in += request.body.size();
+		m_bytes_out += response.body.size();
+	}
+
+	const Mode m_mode;
+	const bool m_record;
+	SSL_CTX *m_context;
+	int m_listener, m_port;
+	std::thread m_acceptor;
+	mutable std::mutex m_mutex;
+	bool m_stopped;
+	/// Выполняющиеся обработчики запросов HTTP/2
+	size_t m_handlers;
+	std::condition_variable m_idle;
+	std::set<int> m_sockets;
+	std::list<std::thread> m_workers;
+	std::vector<Route> m_routes;
+	std::vector<StubRequest> m_requests;
+	std::atomic<uint64_t> m_connections, m_handshakes, m_resumed, m_http2_connections, m_served, m_bytes_in, m_bytes_out;
+};
+
+StubServer::StubServer(Mode mode, bool record): m_impl(new Impl(mode, record)) {}
+StubServer::~StubServer() {}
+
+string StubServer::BaseURL() const {
+	return m_impl->BaseURL();
+}
+
+void StubServer::Handle(const string &method, const string &prefix, const StubHandler &handler) {
+	m_impl->Handle(method, prefix, handler);
+}
+
+std::vector<StubRequest> StubServer::Requests() const {
+	return m_impl->Requests();
+}
+
+size_t StubServer::Count(const string &method, const string &prefix) const {
+	return m_impl->Count(method, prefix);
+}
+
+StubServer::Stats StubServer::GetStats() const {
+	return m_impl->GetStats();
+}
+
+void StubServer::Reset() {
+	m_impl->Reset();
+}
+
+} // namespace test
+} // namespace vscale
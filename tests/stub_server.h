@@ -0,0 +1,105 @@
+#ifndef __VSCALE_STUB_SERVER_H__
+#define __VSCALE_STUB_SERVER_H__
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vscale {
+namespace test {
+
+/*
+* @brief Запрос, полученный заглушкой
+*/
+struct StubRequest {
+	std::string method, path, body;
+	/// Заголовки, имена в нижнем регистре
+	std::map<std::string, std::string> headers;
+	/// Запрос получен по HTTP/2
+	bool http2;
+
+	/// Значение заголовка name (в нижнем регистре) или пустая строка
+	std::string Header(const std::string &name) const;
+};
+
+/*
+* @brief Ответ заглушки
+*/
+struct StubResponse {
+	int status;
+	std::string body;
+	std::vector<std::pair<std::string, std::string>> headers;
+	/// Сжать тело gzip, если клиент указал его в Accept-Encoding
+	bool compress;
+
+	StubResponse(): status(200), compress(true) {}
+};
+
+typedef std::function<void(const StubRequest &request, StubResponse &response)> StubHandler;
+
+/*
+* @brief HTTP-сервер API для тестов и бенчмарков, работающий в том же процессе
+* @detail Слушает случайный порт на 127.0.0.1, каждое соединение обслуживается
+* отдельным потоком, поэтому обработчики вызываются параллельно и должны быть
+* потокобезопасны. В режиме smTLS сервер использует самоподписанный сертификат и
+* по ALPN предпочитает HTTP/2 (h2), иначе HTTP/1.1. Запросы без подходящего
+* обработчика получают 404.
+*/
+class StubServer {
+public:
+	enum Mode {
+		smPlain,
+		smTLS
+	};
+
+	struct Stats {
+		/// Принятые соединения, TLS-рукопожатия (из них возобновленных сессий), соединения HTTP/2
+		uint64_t connections, handshakes, resumed, http2_connections;
+		/// Обработанные запросы, байты тел запросов и тел ответов (после сжатия)
+		uint64_t requests, bytes_in, bytes_out;
+	};
+
+	/*
+	* @param [in] mode Протокол
+	* @param [in] record Сохранять полученные запросы для Requests и Count
+	*/
+	explicit StubServer(Mode mode = smPlain, bool record = true);
+	~StubServer();
+
+	/// Базовый адрес для Transport::SetBaseURL
+	std::string BaseURL() const;
+
+	/*
+	* @brief Добавить обработчик
+	* @detail Обработчики проверяются в порядке добавления, подходит первый с тем же
+	* методом (пустой - любой) и путем, начинающимся с prefix.
+	*/
+	void Handle(const std::string &method, const std::string &prefix, const StubHandler &handler);
+
+	/// Все полученные запросы в порядке получения
+	std::vector<StubRequest> Requests() const;
+
+	/// Количество полученных запросов method к путям, начинающимся с prefix
+	size_t Count(const std::string &method, const std::string &prefix) const;
+
+	Stats GetStats() const;
+
+	/// Забыть полученные запросы и обнулить счетчики
+	void Reset();
+
+private:
+	StubServer(const StubServer &) = delete;
+	StubServer &operator=(const StubServer &) = delete;
+
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace test
+} // namespace vscale
+
+#endif // __VSCALE_STUB_SERVER_H__
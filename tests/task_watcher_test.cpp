@@ -0,0 +1,150 @@
+#include <vscale/task_watcher.h>
+#include <gtest/gtest.h>
+#include "stub_server.h"
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/// Запись списка операций
+std::string Task(const std::string &id, int scalet, bool done, bool error, const std::string &inserted = "2024-01-01 10:00:00") {
+	return "{\"id\": \"" + id + "\", \"scalet\": " + std::to_string(scalet) + ", \"method\": \"scalet_restart\", \"d_insert\": \""
+			+ inserted + "\", \"done\": " + (done ? "true" : "false") + ", \"error\": " + (error ? "true" : "false") + "}";
+}
+
+/*
+* Заглушка списка операций: ответ на каждый опрос строит m_tasks по его
+* номеру (с единицы); пустая строка - ответ 500.
+*/
+class TaskWatcherTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		Transport::SetBaseURL(m_server.BaseURL());
+		RetryPolicy::Disable();
+		m_server.Handle("GET", "/v1/tasks", [this](const StubRequest &, StubResponse &response) {
+			std::function<std::string(int poll)> tasks;
+			int poll;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_polls.push_back(Clock::now());
+				poll = (int) m_polls.size();
+				tasks = m_tasks;
+			}
+			response.body = tasks ? tasks(poll) : "[]";
+			if (response.body.empty())
+				response.status = 500;
+		});
+	}
+
+	void TearDown() override {
+		RetryPolicy::Enable();
+		Transport::SetBaseURL("");
+	}
+
+	void SetTasks(const std::function<std::string(int poll)> &tasks) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks = tasks;
+	}
+
+	std::vector<Clock::time_point> Polls() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_polls;
+	}
+
+	StubServer m_server;
+	std::mutex m_mutex;
+	std::function<std::string(int poll)> m_tasks;
+	std::vector<Clock::time_point> m_polls;
+};
+
+TEST_F(TaskWatcherTest, LastWatcherDestroyedInItsOwnCallback) {
+	SetTasks([](int) { return "[" + Task("t1", 1, true, false) + "]"; });
+	std::shared_ptr<TaskWatcher> watcher = std::make_shared<TaskWatcher>("self-destroy");
+	std::promise<void> destroyed;
+	std::shared_ptr<TaskWatcher> *owner = &watcher;
+	std::future<TaskInfo> result = watcher->WaitScalet(1, [owner, &destroyed](const TaskInfo &, std::exception_ptr) {
+		owner->reset();
+		destroyed.set_value();
+	});
+
+	destroyed.get_future().get();
+	EXPECT_TRUE(result.get().done);
+	EXPECT_FALSE(watcher);
+}
+
+TEST_F(TaskWatcherTest, PendingWaitersFailWhenStopped) {
+	std::future<TaskInfo> result;
+	{
+		TaskWatcher watcher("stopped");
+		result = watcher.WaitScalet(1);
+	}
+	EXPECT_THROW(result.get(), BadRequest);
+}
+
+TEST_F(TaskWatcherTest, ScaletTaskInProgressThenDone) {
+	// Старая неудачная операция над тем же сервером не подменяет текущую
+	const std::string old = Task("t0", 1, true, true, "2023-12-31 10:00:00");
+	SetTasks([old](int poll) {
+		return "[" + old + ", " + Task("t1", 1, poll >= 2, false) + ", " + Task("t2", 2, false, false) + "]";
+	});
+
+	const TaskInfo task = TaskWatcher("progress").WaitScalet(1).get();
+	EXPECT_EQ("t1", task.id);
+	EXPECT_TRUE(task.done);
+	EXPECT_FALSE(task.error);
+	EXPECT_EQ(2u, Polls().size());
+}
+
+TEST_F(TaskWatcherTest, ScaletTaskDoneWithError) {
+	// Завершенная операция остается в списке с error, а не пропадает из него
+	SetTasks([](int poll) {
+		return "[" + Task("t1", 1, poll >= 2, poll >= 2) + "]";
+	});
+
+	bool reported = false;
+	TaskWatcher watcher("failed");
+	std::future<TaskInfo> result = watcher.WaitScalet(1, [&reported](const TaskInfo &task, std::exception_ptr error) {
+		reported = !error && task.error;
+	});
+	const TaskInfo task = result.get();
+	EXPECT_EQ("t1", task.id);
+	EXPECT_TRUE(task.done);
+	EXPECT_TRUE(task.error);
+	EXPECT_TRUE(reported);
+}
+
+TEST_F(TaskWatcherTest, TaskMissingFromListFails) {
+	TaskWatcher watcher("missing");
+	std::future<TaskInfo> by_scalet = watcher.WaitScalet(1);
+	std::future<TaskInfo> by_id = watcher.Wait("t1");
+	EXPECT_THROW(by_scalet.get(), BadRequest);
+	EXPECT_THROW(by_id.get(), BadRequest);
+}
+
+TEST_F(TaskWatcherTest, FailedPollsBackOff) {
+	SetTasks([](int poll) {
+		if (poll <= 2)
+			return std::string();
+		return "[" + Task("t1", 1, poll >= 4, false) + "]";
+	});
+
+	const TaskInfo task = TaskWatcher("back-off").WaitScalet(1).get();
+	EXPECT_TRUE(task.done);
+
+	// Период удваивается после каждой неудачи, а после успешного опроса снова
+	// определяется временем ожидания (половина прошедшего) без множителя
+	const std::vector<Clock::time_point> polls = Polls();
+	ASSERT_EQ(4u, polls.size());
+	EXPECT_GE(polls[1] - polls[0], std::chrono::milliseconds(1900));
+	EXPECT_GE(polls[2] - polls[1], std::chrono::milliseconds(3900));
+	EXPECT_LT(polls[3] - polls[2], polls[2] - polls[1]);
+	EXPECT_LT(polls[3] - polls[2], (polls[2] - polls[0]) / 2 + std::chrono::milliseconds(500));
+}
+
+} // namespace
@@ -0,0 +1,108 @@
+#include <vscale/vscale.h>
+#include <gtest/gtest.h>
+#include "stub_server.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace vscale;
+using namespace vscale::test;
+
+namespace {
+
+class TransportTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		Transport::SetBaseURL(m_server.BaseURL());
+		RetryPolicy::Disable();
+	}
+
+	void TearDown() override {
+		RetryPolicy::Enable();
+		Transport::SetHttpVersion(Transport::hvHTTP1_1);
+		Transport::SetBaseURL("");
+	}
+
+	StubServer m_server;
+};
+
+TEST_F(TransportTest, SendsTokenAndParsesResponse) {
+	m_server.Handle("GET", "/v1/account", [](const StubRequest &request, StubResponse &response) {
+		response.body = "{\"info\": {\"name\": \"" + request.Header("x-token") + "\"}}";
+	});
+
+	JsonValue response;
+	Account("secret").Info(response);
+	EXPECT_EQ("secret", response["info"]["name"].asString());
+	EXPECT_EQ(1u, m_server.Count("GET", "/v1/account"));
+}
+
+TEST_F(TransportTest, ErrorStatusThrows) {
+	m_server.Handle("GET", "/v1/scalets/", [](const StubRequest &, StubResponse &response) {
+		response.status = 404;
+		response.headers.emplace_back("Vscale-Error-Message", "scalet not found");
+	});
+
+	JsonValue response;
+	EXPECT_THROW(Scalets("token").Info(7, response), BadRequest);
+}
+
+TEST_F(TransportTest, AsyncRequestsReuseConnections) {
+	m_server.Handle("GET", "/v1/scalets/", [](const StubRequest &request, StubResponse &response) {
+		response.body = "{\"ctid\": " + request.path.substr(request.path.rfind('/') + 1) + "}";
+	});
+
+	Scalets scalets("token");
+	uint64_t connections = 0;
+	for (int round = 0; round < 2; ++round) {
+		std::vector<std::future<JsonValue>> pending;
+		for (int id = 1; id <= 20; ++id)
+			pending.push_back(scalets.InfoAsync(id));
+		for (int id = 1; id <= 20; ++id)
+			EXPECT_EQ(id, pending[id - 1].get()["ctid"].asInt());
+		if (round == 0)
+			connections = m_server.GetStats().connections;
+	}
+	EXPECT_EQ(40u, m_server.GetStats().requests);
+	EXPECT_EQ(connections, m_server.GetStats().connections);
+}
+
+TEST_F(TransportTest, CoalescedCompletionRunsOffCallerThread) {
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool entered = false, released = false;
+	m_server.Handle("GET", "/v1/account", [&](const StubRequest &, StubResponse &response) {
+		std::unique_lock<std::mutex> lock(mutex);
+		entered = true;
+		cv.notify_all();
+		cv.wait(lock, [&] { return released; });
+		response.body = "{\"info\": {\"name\": \"shared\"}}";
+	});
+
+	Account account("token");
+	std::thread::id leader_thread, completion_thread;
+	std::thread leader([&] {
+		leader_thread = std::this_thread::get_id();
+		JsonValue response;
+		account.Info(response);
+	});
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&] { return entered; });
+	}
+	std::future<JsonValue> follower = account.InfoAsync([&](const JsonValue &, std::exception_ptr) {
+		completion_thread = std::this_thread::get_id();
+	});
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		released = true;
+	}
+	cv.notify_all();
+	leader.join();
+
+	EXPECT_EQ("shared", follower.get()["info"]["name"].asString());
+	EXPECT_EQ(1u, m_server.Count("GET", "/v1/account"));
+	EXPECT_NE(leader_thread, completion_thread);
+}
+
+} // namespace